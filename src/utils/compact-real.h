@@ -0,0 +1,236 @@
+#pragma once
+
+#include <Kokkos_Core.hpp>
+
+#include <cstdint>
+#include <cstring>
+
+// x86 half precision conversion instructions (same rounding as the software path)
+#if defined(__F16C__) && !defined(__CUDA_ARCH__)
+#include <immintrin.h>
+#define KBOIDS_USE_F16C
+#endif
+
+/*
+ * 16-bit storage types for boids data (positions, velocities).
+ *
+ * Kernels are bandwidth bound : storing coordinates on 16 bits halves the memory
+ * traffic of updatePositions and of permutations. These types are storage only,
+ * they convert implicitly from and to float, so that kernels read them into float
+ * registers, compute, and round the result back when storing it.
+ *
+ * - bfloat16   : 8-bit exponent, 7-bit mantissa (float range, ~2 decimal digits)
+ * - half       : IEEE binary16, 5-bit exponent, 10-bit mantissa (|v| < 65504)
+ * - fixed16<K> : signed fixed point, uniform step 2^(K-15) over [-2^K, 2^K)
+ *   (saturates outside)
+ *
+ * Conversions are software, and identical on host and device (half uses F16C
+ * instructions on x86 when available, e.g. with -march=native).
+ */
+
+namespace kboids {
+
+//! raw bits of a float
+KOKKOS_INLINE_FUNCTION
+uint32_t float_bits(float v)
+{
+  uint32_t u;
+  memcpy(&u, &v, sizeof(u));
+  return u;
+}
+
+//! float from raw bits
+KOKKOS_INLINE_FUNCTION
+float bits_float(uint32_t u)
+{
+  float v;
+  memcpy(&v, &u, sizeof(v));
+  return v;
+}
+
+//! 2^k (compile time)
+constexpr float exp2i(int k)
+{
+  float v = 1;
+  for (; k > 0; --k) v *= 2;
+  for (; k < 0; ++k) v /= 2;
+  return v;
+}
+
+//===============================================================================
+//===============================================================================
+/**
+ * Brain floating point : upper half of a float (rounded to nearest even).
+ */
+struct bfloat16
+{
+  uint16_t bits;
+
+  KOKKOS_DEFAULTED_FUNCTION
+  bfloat16() = default;
+
+  KOKKOS_INLINE_FUNCTION
+  bfloat16(float v)
+  {
+    const uint32_t u = float_bits(v);
+
+    if ((u & 0x7fffffff) > 0x7f800000)
+      bits = static_cast<uint16_t>((u >> 16) | 0x40); // quiet NaN
+    else
+      bits = static_cast<uint16_t>((u + 0x7fff + ((u >> 16) & 1)) >> 16);
+  }
+
+  KOKKOS_INLINE_FUNCTION
+  operator float() const { return bits_float(static_cast<uint32_t>(bits) << 16); }
+
+}; // struct bfloat16
+
+//===============================================================================
+//===============================================================================
+/**
+ * IEEE 754 binary16 (rounded to nearest even, overflows to infinity).
+ */
+struct half
+{
+  uint16_t bits;
+
+  KOKKOS_DEFAULTED_FUNCTION
+  half() = default;
+
+  KOKKOS_INLINE_FUNCTION
+  half(float v)
+  {
+#ifdef KBOIDS_USE_F16C
+    bits = _cvtss_sh(v, _MM_FROUND_TO_NEAREST_INT);
+#else
+    const uint32_t u    = float_bits(v);
+    const uint32_t sign = (u >> 16) & 0x8000;
+    const uint32_t absu = u & 0x7fffffff;
+
+    if (absu > 0x7f800000)
+    {
+      // NaN
+      bits = static_cast<uint16_t>(sign | 0x7e00);
+    }
+    else if (absu >= 0x477ff000)
+    {
+      // rounds to a magnitude >= 65520 : infinity
+      bits = static_cast<uint16_t>(sign | 0x7c00);
+    }
+    else if (absu < 0x38800000)
+    {
+      // subnormal half (or zero) : |v| < 2^-14, step is 2^-24
+      const uint32_t mant  = (absu & 0x7fffff) | 0x800000;
+      const int      shift = 126 - static_cast<int>(absu >> 23);
+
+      if (shift > 24)
+      {
+        bits = static_cast<uint16_t>(sign);
+      }
+      else
+      {
+        const uint32_t half_mant = mant >> shift;
+        const uint32_t rest      = mant & ((1u << shift) - 1);
+        const uint32_t halfway   = 1u << (shift - 1);
+        const uint32_t round_up  = (rest > halfway) or (rest == halfway and (half_mant & 1));
+        bits = static_cast<uint16_t>(sign | (half_mant + round_up));
+      }
+    }
+    else
+    {
+      // normal half : rebias exponent, round mantissa to 10 bits
+      const uint32_t r = absu - 0x38000000;
+      bits = static_cast<uint16_t>(sign | ((r + 0xfff + ((r >> 13) & 1)) >> 13));
+    }
+#endif
+  }
+
+  KOKKOS_INLINE_FUNCTION
+  operator float() const
+  {
+#ifdef KBOIDS_USE_F16C
+    return _cvtsh_ss(bits);
+#else
+    const uint32_t sign = static_cast<uint32_t>(bits & 0x8000) << 16;
+    const uint32_t expo = (bits >> 10) & 0x1f;
+    const uint32_t mant = bits & 0x3ff;
+
+    if (expo == 0x1f)
+      return bits_float(sign | 0x7f800000 | (mant << 13)); // inf, NaN
+
+    if (expo == 0)
+    {
+      // zero or subnormal : mant . 2^-24
+      const float v = static_cast<float>(mant) * 5.9604644775390625e-8f;
+      return sign ? -v : v;
+    }
+
+    return bits_float(sign | ((expo + 112) << 23) | (mant << 13));
+#endif
+  }
+
+}; // struct half
+
+//===============================================================================
+//===============================================================================
+/**
+ * Signed 16-bit fixed point covering [-2^RangeLog2, 2^RangeLog2).
+ */
+template <int RangeLog2>
+struct fixed16
+{
+  int16_t bits;
+
+  //! value of one unit in the last place
+  static constexpr float step = exp2i(RangeLog2 - 15);
+
+  //! 1/step (exact, step is a power of 2)
+  static constexpr float inv_step = exp2i(15 - RangeLog2);
+
+  KOKKOS_DEFAULTED_FUNCTION
+  fixed16() = default;
+
+  KOKKOS_INLINE_FUNCTION
+  fixed16(float v)
+  {
+    // saturate (NaN maps to 0), then round to nearest even (v * inv_step is
+    // exact, inv_step being a power of 2; rintf in the default rounding mode)
+    float s = v * inv_step;
+    s = (s >  32767.0f) ?  32767.0f : s;
+    s = (s < -32768.0f) ? -32768.0f : s;
+    s = (s == s) ? s : 0.0f;
+    bits = static_cast<int16_t>(rintf(s));
+  }
+
+  KOKKOS_INLINE_FUNCTION
+  operator float() const { return static_cast<float>(bits) * step; }
+
+}; // struct fixed16
+
+//===============================================================================
+//===============================================================================
+/**
+ * Largest magnitude a storage type can hold (float range for float and double).
+ */
+template <typename T>
+struct storage_range
+{
+  static constexpr float max = 3.4e38f;
+};
+
+template <>
+struct storage_range<half>
+{
+  static constexpr float max = 65504.0f;
+};
+
+template <int RangeLog2>
+struct storage_range<fixed16<RangeLog2>>
+{
+  static constexpr float max = exp2i(RangeLog2);
+};
+
+template <typename T>
+constexpr float storage_limit() { return storage_range<T>::max; }
+
+} // namespace kboids
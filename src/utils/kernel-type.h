@@ -0,0 +1,191 @@
+#pragma once
+
+#include <string>
+
+namespace kboids {
+
+//! variants of the updatePositions kernel (selected at run time)
+enum class UpdateKernel
+{
+  SCALAR, //!< one boid per iteration
+  SIMD,    //!< one SIMD vector of boids per iteration (see utils/simd-utils.h)
+  PREFETCH //!< batches of boids, partner positions prefetched ahead (see utils/prefetch-utils.h)
+};
+
+//===============================================================================
+//===============================================================================
+inline const char* kernel_name(UpdateKernel kernel)
+{
+  switch (kernel)
+  {
+  case UpdateKernel::SIMD     : return "simd";
+  case UpdateKernel::PREFETCH : return "prefetch";
+  default                     : return "scalar";
+  }
+}
+
+//! friends/ennemies shuffle algorithms (selected at run time)
+enum class ShuffleMode
+{
+  DENSE,  //!< draw a random number for every boid
+  SPARSE, //!< only visit boids to refresh (geometric skip sampling)
+  AUTO    //!< sparse for small rates, dense otherwise
+};
+
+//! in AUTO mode, sparse shuffle is used below this rate
+constexpr float SPARSE_SHUFFLE_MAX_RATE = 0.25;
+
+//===============================================================================
+//===============================================================================
+/**
+ * Should a shuffle with the given rate use the sparse algorithm ?
+ */
+inline bool use_sparse_shuffle(ShuffleMode mode, float rate)
+{
+  return mode == ShuffleMode::SPARSE or
+    (mode == ShuffleMode::AUTO and rate < SPARSE_SHUFFLE_MAX_RATE);
+}
+
+//===============================================================================
+//===============================================================================
+inline const char* shuffle_mode_name(ShuffleMode mode)
+{
+  switch (mode)
+  {
+  case ShuffleMode::DENSE  : return "dense";
+  case ShuffleMode::SPARSE : return "sparse";
+  default                  : return "auto";
+  }
+}
+
+//===============================================================================
+//===============================================================================
+/**
+ * Parse a shuffle mode name.
+ *
+ * \return false if name is not a valid mode name (mode is left unchanged)
+ */
+inline bool shuffle_mode_from_string(const std::string& name, ShuffleMode& mode)
+{
+  if (name == "dense")
+    mode = ShuffleMode::DENSE;
+  else if (name == "sparse")
+    mode = ShuffleMode::SPARSE;
+  else if (name == "auto")
+    mode = ShuffleMode::AUTO;
+  else
+    return false;
+
+  return true;
+}
+
+//! accumulation of per box data (version 2, selected at run time)
+enum class BoxAccumulation
+{
+  ATOMIC,  //!< atomic updates of the box arrays
+  SCATTER, //!< Kokkos::Experimental::ScatterView (duplicated arrays on host, atomics on device)
+  PRIVATE, //!< per team histograms in scratch memory, summed at the end
+  AUTO     //!< chosen from the number of boxes and the number of threads
+};
+
+//! in AUTO mode, atomics are used when there are at least that many boxes per thread
+constexpr int ATOMIC_MIN_BOXES_PER_THREAD = 64;
+
+//! minimum number of boids accumulated by a team in private histograms
+constexpr int PRIVATE_MIN_BOIDS_PER_TEAM = 4096;
+
+//===============================================================================
+//===============================================================================
+inline const char* box_accumulation_name(BoxAccumulation accumulation)
+{
+  switch (accumulation)
+  {
+  case BoxAccumulation::ATOMIC  : return "atomic";
+  case BoxAccumulation::SCATTER : return "scatter";
+  case BoxAccumulation::PRIVATE : return "private";
+  default                       : return "auto";
+  }
+}
+
+//===============================================================================
+//===============================================================================
+/**
+ * Parse a box accumulation name.
+ *
+ * \return false if name is not a valid name (accumulation is left unchanged)
+ */
+inline bool box_accumulation_from_string(const std::string& name, BoxAccumulation& accumulation)
+{
+  if (name == "atomic")
+    accumulation = BoxAccumulation::ATOMIC;
+  else if (name == "scatter")
+    accumulation = BoxAccumulation::SCATTER;
+  else if (name == "private")
+    accumulation = BoxAccumulation::PRIVATE;
+  else if (name == "auto")
+    accumulation = BoxAccumulation::AUTO;
+  else
+    return false;
+
+  return true;
+}
+
+//! numbering of grid boxes (version 2, selected at run time)
+enum class CellOrder
+{
+  ROW_MAJOR, //!< i + nx*j
+  MORTON     //!< rank along a Z-order curve (neighbour boxes are mostly close)
+};
+
+//===============================================================================
+//===============================================================================
+inline const char* cell_order_name(CellOrder order)
+{
+  switch (order)
+  {
+  case CellOrder::MORTON : return "morton";
+  default                : return "row";
+  }
+}
+
+//===============================================================================
+//===============================================================================
+/**
+ * Parse a cell order name.
+ *
+ * \return false if name is not a valid name (order is left unchanged)
+ */
+inline bool cell_order_from_string(const std::string& name, CellOrder& order)
+{
+  if (name == "row")
+    order = CellOrder::ROW_MAJOR;
+  else if (name == "morton")
+    order = CellOrder::MORTON;
+  else
+    return false;
+
+  return true;
+}
+
+//===============================================================================
+//===============================================================================
+/**
+ * Parse a kernel name.
+ *
+ * \return false if name is not a valid kernel name (kernel is left unchanged)
+ */
+inline bool kernel_from_string(const std::string& name, UpdateKernel& kernel)
+{
+  if (name == "scalar")
+    kernel = UpdateKernel::SCALAR;
+  else if (name == "simd")
+    kernel = UpdateKernel::SIMD;
+  else if (name == "prefetch")
+    kernel = UpdateKernel::PREFETCH;
+  else
+    return false;
+
+  return true;
+}
+
+} // namespace kboids
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <Kokkos_Core.hpp>
+
+#include <cstdint>
+
+/*
+ * Morton (Z-order) curve helpers.
+ *
+ * A 2D integer coordinate (i,j) is mapped to a single index by interleaving
+ * the bits of i and j; points close in 2D are (mostly) close along the curve.
+ */
+
+namespace kboids {
+
+//! number of bits used per coordinate (so that a morton code fits in a positive int)
+constexpr int MORTON_BITS = 15;
+
+//===============================================================================
+//===============================================================================
+/**
+ * Spread the lower 16 bits of v, i.e. insert a 0 bit between each bit.
+ */
+KOKKOS_INLINE_FUNCTION
+uint32_t morton_spread(uint32_t v)
+{
+  v &= 0x0000ffff;
+  v = (v | (v << 8)) & 0x00ff00ff;
+  v = (v | (v << 4)) & 0x0f0f0f0f;
+  v = (v | (v << 2)) & 0x33333333;
+  v = (v | (v << 1)) & 0x55555555;
+  return v;
+}
+
+//===============================================================================
+//===============================================================================
+/**
+ * Inverse of morton_spread : gather even bits of v.
+ */
+KOKKOS_INLINE_FUNCTION
+uint32_t morton_compact(uint32_t v)
+{
+  v &= 0x55555555;
+  v = (v | (v >> 1)) & 0x33333333;
+  v = (v | (v >> 2)) & 0x0f0f0f0f;
+  v = (v | (v >> 4)) & 0x00ff00ff;
+  v = (v | (v >> 8)) & 0x0000ffff;
+  return v;
+}
+
+//===============================================================================
+//===============================================================================
+/**
+ * Morton index of integer coordinates (i,j), i and j in [0, 2^16).
+ */
+KOKKOS_INLINE_FUNCTION
+uint32_t morton_encode(uint32_t i, uint32_t j)
+{
+  return morton_spread(i) | (morton_spread(j) << 1);
+}
+
+//===============================================================================
+//===============================================================================
+/**
+ * Morton index of a real position (x,y) inside bounding box [xmin,xmax]x[ymin,ymax],
+ * quantized over MORTON_BITS bits per direction.
+ */
+KOKKOS_INLINE_FUNCTION
+int morton_key(float x, float y,
+               float xmin, float xmax,
+               float ymin, float ymax)
+{
+  constexpr int nmax = (1 << MORTON_BITS) - 1;
+
+  const float sx = (xmax > xmin) ? nmax / (xmax - xmin) : 0;
+  const float sy = (ymax > ymin) ? nmax / (ymax - ymin) : 0;
+
+  int i = (int) ((x - xmin) * sx);
+  int j = (int) ((y - ymin) * sy);
+
+  i = (i < 0) ? 0 : ((i > nmax) ? nmax : i);
+  j = (j < 0) ? 0 : ((j > nmax) ? nmax : j);
+
+  return (int) morton_encode(i, j);
+}
+
+} // namespace kboids
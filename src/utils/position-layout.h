@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Kokkos_Core.hpp>
+
+/*
+ * Compile-time layout policy for boids positions.
+ *
+ * Positions are always stored in a rank-2 view pos(i,dir) (dir=0 for x, dir=1 for y);
+ * x and y are 1d views (subviews) of this storage, so that kernels are written once
+ * for both layouts :
+ * - default (LayoutLeft) : x and y are contiguous separate arrays (structure of arrays)
+ * - KBOIDS_INTERLEAVED_POSITIONS (LayoutRight) : positions are stored as packed {x,y}
+ *   pairs, a friend/ennemy lookup only touches one cache line, and the storage can
+ *   directly be used as an OpenGL vertex buffer.
+ */
+
+namespace kboids {
+
+#ifdef KBOIDS_INTERLEAVED_POSITIONS
+using PositionLayout = Kokkos::LayoutRight;
+constexpr bool interleaved_positions = true;
+#else
+using PositionLayout = Kokkos::LayoutLeft;
+constexpr bool interleaved_positions = false;
+#endif
+
+//! storage for 2d positions
+template <typename MemorySpace, typename Scalar = float>
+using PositionView = Kokkos::View<Scalar*[2], PositionLayout, MemorySpace>;
+
+//! type of a 1d view on a single coordinate of a PositionView (contiguous or strided)
+template <typename PosView>
+using CoordView = Kokkos::Subview<PosView, Kokkos::ALL_t, int>;
+
+//===============================================================================
+//===============================================================================
+/**
+ * Return a 1d view on coordinate dir (0 for x, 1 for y) of positions.
+ */
+template <typename PosView>
+CoordView<PosView> coordinate(const PosView& pos, int dir)
+{
+  return Kokkos::subview(pos, Kokkos::ALL, dir);
+}
+
+} // namespace kboids
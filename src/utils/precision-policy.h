@@ -0,0 +1,135 @@
+#pragma once
+
+#include <Kokkos_Core.hpp>
+
+#include <math.h>
+
+#include "utils/compact-real.h"
+
+/*
+ * Precision policies for boids data and kernels.
+ *
+ * A policy defines
+ * - storage_for<K> : type used to store boids data in memory, for values in
+ *   [-2^K, 2^K) (only the fixed point format depends on K)
+ * - storage_t : storage type of versions 0 and 1 positions (in [-4,4))
+ * - value_t   : type storage decodes to (for reductions, random init)
+ * - compute_t : type used for arithmetic inside kernels
+ *
+ * 16-bit storage formats (see utils/compact-real.h) decode to float registers,
+ * they trade accuracy for half the memory traffic.
+ *
+ * The default policy is chosen at compile time (cmake option KBOIDS_PRECISION).
+ */
+
+namespace kboids {
+
+//! single precision storage and arithmetic
+struct FloatPrecision
+{
+  template <int RangeLog2>
+  using storage_for = float;
+  using storage_t = float;
+  using value_t   = float;
+  using compute_t = float;
+  static constexpr const char* name = "float";
+};
+
+//! single precision storage, double precision arithmetic
+struct MixedPrecision
+{
+  template <int RangeLog2>
+  using storage_for = float;
+  using storage_t = float;
+  using value_t   = float;
+  using compute_t = double;
+  static constexpr const char* name = "mixed";
+};
+
+//! double precision storage and arithmetic
+struct DoublePrecision
+{
+  template <int RangeLog2>
+  using storage_for = double;
+  using storage_t = double;
+  using value_t   = double;
+  using compute_t = double;
+  static constexpr const char* name = "double";
+};
+
+//! bfloat16 storage, single precision arithmetic
+struct Bf16Precision
+{
+  template <int RangeLog2>
+  using storage_for = bfloat16;
+  using storage_t = bfloat16;
+  using value_t   = float;
+  using compute_t = float;
+  static constexpr const char* name = "bf16";
+};
+
+//! IEEE half precision storage, single precision arithmetic
+struct Fp16Precision
+{
+  template <int RangeLog2>
+  using storage_for = half;
+  using storage_t = half;
+  using value_t   = float;
+  using compute_t = float;
+  static constexpr const char* name = "fp16";
+};
+
+//! 16-bit fixed point storage, single precision arithmetic
+struct Fixed16Precision
+{
+  template <int RangeLog2>
+  using storage_for = fixed16<RangeLog2>;
+  using storage_t = fixed16<2>;
+  using value_t   = float;
+  using compute_t = float;
+  static constexpr const char* name = "fixed16";
+};
+
+#if defined(KBOIDS_PRECISION_FLOAT)
+using DefaultPrecision = FloatPrecision;
+#elif defined(KBOIDS_PRECISION_DOUBLE)
+using DefaultPrecision = DoublePrecision;
+#elif defined(KBOIDS_PRECISION_BF16)
+using DefaultPrecision = Bf16Precision;
+#elif defined(KBOIDS_PRECISION_FP16)
+using DefaultPrecision = Fp16Precision;
+#elif defined(KBOIDS_PRECISION_FIXED16)
+using DefaultPrecision = Fixed16Precision;
+#else
+using DefaultPrecision = MixedPrecision;
+#endif
+
+//===============================================================================
+//===============================================================================
+/**
+ * Reciprocal square root.
+ *
+ * On Cuda, this is the hardware approximation; on CPU, the compiler turns it
+ * into a rsqrt instruction (+ Newton iteration) when fast-math is enabled.
+ */
+KOKKOS_INLINE_FUNCTION
+float rsqrt(float v)
+{
+#ifdef __CUDA_ARCH__
+  return ::rsqrtf(v);
+#else
+  return 1.0f / sqrtf(v);
+#endif
+}
+
+KOKKOS_INLINE_FUNCTION
+double rsqrt(double v)
+{
+#ifdef __CUDA_ARCH__
+  return ::rsqrt(v);
+#else
+  return 1.0 / sqrt(v);
+#endif
+}
+
+} // namespace kboids
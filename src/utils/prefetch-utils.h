@@ -0,0 +1,97 @@
+#pragma once
+
+#include <Kokkos_Core.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "utils/random-utils.h"
+
+/*
+ * Software prefetch helpers for the gather-pipelined updatePositions kernel.
+ *
+ * Friend/ennemy positions are random reads : with a plain loop, the core only
+ * overlaps the few misses its out-of-order window can see. Prefetching partner
+ * positions of boid index+distance while computing boid index keeps up to
+ * ~distance misses in flight (memory-level parallelism).
+ *
+ * On device (Cuda), latency is hidden by warp scheduling, prefetch kernels are
+ * host only.
+ */
+
+//! prefetch (for reading, keep in all cache levels) the cache line holding addr
+#if defined(__CUDA_ARCH__) || defined(__HIP_DEVICE_COMPILE__)
+#define KBOIDS_PREFETCH(addr)
+#elif defined(__GNUC__) || defined(__clang__)
+#define KBOIDS_PREFETCH(addr) __builtin_prefetch((addr), 0, 3)
+#else
+#define KBOIDS_PREFETCH(addr)
+#endif
+
+namespace kboids {
+
+//! can prefetch kernels run on ExecutionSpace ?
+template <typename ExecutionSpace>
+constexpr bool prefetch_enabled =
+  Kokkos::SpaceAccessibility<ExecutionSpace, Kokkos::HostSpace>::accessible;
+
+//! number of boids per batch in prefetch kernels (each batch is a software pipeline)
+constexpr int PREFETCH_BATCH_SIZE = 4096;
+
+//! default prefetch distance (in boids)
+constexpr int PREFETCH_DEFAULT_DISTANCE = 16;
+
+//===============================================================================
+//===============================================================================
+/**
+ * Measure the latency (in nanoseconds) of a dependent random load in a buffer
+ * of the given size (pointer chasing along a single random cycle of cache lines).
+ *
+ * With this latency L, a kernel doing R random loads per second on T threads
+ * keeps on average R.L/T loads in flight per thread (Little's law).
+ */
+inline double measure_load_latency(size_t bytes, uint64_t seed, int nLoads = 1<<22)
+{
+  // one node per cache line
+  constexpr size_t line = 64 / sizeof(size_t);
+
+  size_t nLines = bytes / 64;
+  nLines = (nLines < 2) ? 2 : nLines;
+
+  std::vector<size_t> next(nLines * line);
+
+  // random cyclic permutation (Sattolo's algorithm)
+  std::vector<size_t> order(nLines);
+  for (size_t i=0; i<nLines; ++i)
+    order[i] = i;
+
+  CounterRNG rng(seed);
+  for (size_t i=nLines-1; i>0; --i)
+  {
+    const size_t j = uniform_int(rng(0, i)[0], static_cast<int>(i));
+    std::swap(order[i], order[j]);
+  }
+
+  for (size_t i=0; i<nLines; ++i)
+    next[order[i]*line] = order[(i+1) % nLines]*line;
+
+  // warm up (TLB, page faults), then measure
+  size_t p = 0;
+  for (size_t i=0; i<nLines; ++i)
+    p = next[p];
+
+  const auto start = std::chrono::steady_clock::now();
+  for (int i=0; i<nLoads; ++i)
+    p = next[p];
+  const auto stop = std::chrono::steady_clock::now();
+
+  // make the chase observable, so that it is not optimized away
+  volatile size_t sink = p;
+  (void) sink;
+
+  return std::chrono::duration<double, std::nano>(stop - start).count() / nLoads;
+
+} // measure_load_latency
+
+} // namespace kboids
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <Kokkos_Core.hpp>
+
+#include <cstdint>
+#include <math.h>
+
+/*
+ * Counter-based random number generation (Philox4x32-10, Salmon et al., SC'11).
+ *
+ * Random numbers are a pure function of (seed, stream, index) : there is no state
+ * to check out of a pool, any kernel can draw random numbers for item index of a
+ * given stream, and results do not depend on backend nor on the number of threads.
+ *
+ * Convention used here : each kernel launch drawing random numbers uses a new
+ * stream, and index is the boid index.
+ */
+
+namespace kboids {
+
+//! 4 random 32-bit words
+struct RandomWords
+{
+  uint32_t v[4];
+
+  KOKKOS_INLINE_FUNCTION
+  uint32_t operator[](int i) const { return v[i]; }
+};
+
+//===============================================================================
+//===============================================================================
+/**
+ * Philox4x32-10 generator keyed by a 64-bit seed.
+ */
+class CounterRNG
+{
+
+public:
+
+  KOKKOS_INLINE_FUNCTION
+  CounterRNG(uint64_t seed = 0)
+    : m_key{static_cast<uint32_t>(seed), static_cast<uint32_t>(seed >> 32)}
+  {}
+
+  //! random words for item index of stream stream
+  KOKKOS_INLINE_FUNCTION
+  RandomWords operator()(uint64_t stream, uint64_t index) const
+  {
+    uint32_t c[4] = {static_cast<uint32_t>(index),  static_cast<uint32_t>(index >> 32),
+                     static_cast<uint32_t>(stream), static_cast<uint32_t>(stream >> 32)};
+    uint32_t k[2] = {m_key[0], m_key[1]};
+
+    for (int round=0; round<10; ++round)
+    {
+      if (round > 0)
+      {
+        k[0] += 0x9E3779B9;
+        k[1] += 0xBB67AE85;
+      }
+
+      const uint64_t p0 = static_cast<uint64_t>(0xD2511F53) * c[0];
+      const uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57) * c[2];
+
+      const uint32_t hi0 = static_cast<uint32_t>(p0 >> 32), lo0 = static_cast<uint32_t>(p0);
+      const uint32_t hi1 = static_cast<uint32_t>(p1 >> 32), lo1 = static_cast<uint32_t>(p1);
+
+      c[0] = hi1 ^ c[1] ^ k[0];
+      c[1] = lo1;
+      c[2] = hi0 ^ c[3] ^ k[1];
+      c[3] = lo0;
+    }
+
+    return RandomWords{{c[0], c[1], c[2], c[3]}};
+  }
+
+private:
+  uint32_t m_key[2];
+
+}; // class CounterRNG
+
+//===============================================================================
+//===============================================================================
+/**
+ * Uniform real in [a,b) from a random word.
+ */
+template <typename T>
+KOKKOS_INLINE_FUNCTION
+T uniform_real(uint32_t u, T a, T b)
+{
+  // use as many bits as the mantissa can hold, so that b is never reached
+  const T r = (sizeof(T) == 4) ?
+    static_cast<T>(u >> 8) * static_cast<T>(1.0/16777216.0) :
+    static_cast<T>(u)      * static_cast<T>(1.0/4294967296.0);
+  return a + (b-a)*r;
+}
+
+//===============================================================================
+//===============================================================================
+/**
+ * Uniform integer in [0,n) from a random word (multiply-shift, no division).
+ */
+KOKKOS_INLINE_FUNCTION
+int uniform_int(uint32_t u, int n)
+{
+  return static_cast<int>((static_cast<uint64_t>(u) * static_cast<uint32_t>(n)) >> 32);
+}
+
+//===============================================================================
+//===============================================================================
+/**
+ * Uniform integer in [a,b) from a random word.
+ */
+KOKKOS_INLINE_FUNCTION
+int uniform_int(uint32_t u, int a, int b)
+{
+  return a + uniform_int(u, b-a);
+}
+
+//===============================================================================
+//===============================================================================
+/**
+ * Geometric skip : number of failures before the next success in a sequence of
+ * Bernoulli trials of probability p, from a random word.
+ *
+ * Walking a sequence with skips drawn this way selects each item independently
+ * with probability p, in O(p.n) instead of O(n) draws.
+ *
+ * \param[in] log1m_p is log(1-p) (negative, -infinity when p=1)
+ * \param[in] kmax is the maximum returned value
+ */
+KOKKOS_INLINE_FUNCTION
+int geometric_skip(uint32_t u, double log1m_p, int kmax)
+{
+  // uniform in (0,1]
+  const double r = (static_cast<double>(u) + 1.0) * (1.0/4294967296.0);
+  const double k = floor(log(r) / log1m_p);
+  return (k < kmax) ? static_cast<int>(k) : kmax;
+}
+
+} // namespace kboids
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <Kokkos_Core.hpp>
+
+#ifdef KBOIDS_USE_SIMD_MATH
+#include <simd.hpp>
+#endif
+
+/*
+ * Explicit SIMD helpers, built on top of kokkos/simd-math (cmake option USE_SIMD_MATH).
+ *
+ * SIMD kernels process a block of simd_t<T>::size() boids per iteration, they are
+ * only available on host execution spaces (native vector ABI).
+ */
+
+namespace kboids {
+
+//! can SIMD kernels run on ExecutionSpace ?
+template <typename ExecutionSpace>
+constexpr bool simd_enabled =
+#ifdef KBOIDS_USE_SIMD_MATH
+  Kokkos::SpaceAccessibility<ExecutionSpace, Kokkos::HostSpace>::accessible;
+#else
+  false;
+#endif
+
+#ifdef KBOIDS_USE_SIMD_MATH
+
+//! native (host) SIMD vector of T
+template <typename T>
+using simd_t = simd::simd<T, simd::simd_abi::native>;
+
+//===============================================================================
+//===============================================================================
+/**
+ * SIMD version of compute_direction : unit vectors from (x1,y1) to (x2,y2),
+ * lanes where both points are closer than 1e-6 are masked to (0,0).
+ */
+template <typename T>
+inline void simd_direction(simd_t<T> x1, simd_t<T> y1,
+                           simd_t<T> x2, simd_t<T> y2,
+                           simd_t<T>& x, simd_t<T>& y)
+{
+  const simd_t<T> ddx = x2-x1;
+  const simd_t<T> ddy = y2-y1;
+  const simd_t<T> norm2 = ddx*ddx + ddy*ddy;
+
+  const simd_t<T> inv_norm = simd::choose(norm2 < simd_t<T>(T(1e-12)),
+                                          simd_t<T>(T(0)),
+                                          simd_t<T>(T(1)) / simd::sqrt(norm2));
+
+  x = ddx*inv_norm;
+  y = ddy*inv_norm;
+}
+
+#endif // KBOIDS_USE_SIMD_MATH
+
+} // namespace kboids
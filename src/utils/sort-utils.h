@@ -2,6 +2,7 @@
 
 #include <Kokkos_Core.hpp>
 #include <Kokkos_Sort.hpp>
+#include <utility>
 #ifdef USE_THRUST_SORT
 #include <thrust/device_ptr.h>
 #include <thrust/execution_policy.h>
@@ -59,8 +60,8 @@ sort(ViewType view)
 
   int const n = view.extent(0);
 
-  // TODO : add execution space as template parameter
-  auto space = Kokkos::DefaultExecutionSpace{};
+  // sort is performed in the execution space associated to the view
+  auto space = typename ViewType::execution_space{};
 
 #ifdef USE_THRUST_SORT
 
@@ -111,7 +112,7 @@ sort(ViewType view)
     Kokkos::View<SizeType *, typename ViewType::device_type> permute(
       Kokkos::view_alloc(Kokkos::WithoutInitializing,
                          "permute"), n);
-    iota(Kokkos::DefaultExecutionSpace{}, permute);
+    iota(space, permute);
     return permute;
   }
 
@@ -129,24 +130,332 @@ sort(ViewType view)
 
 //===============================================================================
 //===============================================================================
+/**
+ * Stable counting sort of integer keys in [0, nBins), with its work views
+ * (allocated once, reused by every sort : keep it as a member of the data it
+ * sorts).
+ *
+ * Keys are sorted by digits of RADIX_BITS bits, least significant first (one
+ * pass per digit, a single pass when nBins <= RADIX). Each pass is a stable
+ * counting sort in two steps : keys are split into blocks (see blocks_for),
+ * the number of keys per (digit, block) is counted, then an exclusive scan in
+ * digit major order gives the slot of the first key of each (digit, block),
+ * and every block scatters its keys in order from there. Slots do not depend on
+ * thread scheduling (no atomics) : keys of a bin keep their original order,
+ * however crowded the bin.
+ *
+ * Cost is O(n) per pass, with at most 4 passes for 32-bit keys (2 up to 65536
+ * bins). There are BLOCKS_PER_THREAD blocks per thread of the execution space,
+ * of at least RADIX keys, so that all threads count and scatter while the
+ * (digit, block) table stays at most n ints, whatever the number of bins. A
+ * single pass scattering from the bin offsets would need a (bin, block) table,
+ * i.e. nBins/RADIX times more memory, or blocks of about nBins keys (a handful
+ * of threads when bins hold a few keys each, as boxes do).
+ *
+ * \code
+ * kboids::CountingSort<VecInt> countingSort(n);
+ * auto permutation = countingSort.sort(keys, n, nBins);
+ * \endcode
+ */
+template <class ViewType,
+          class SizeType = unsigned int>
+struct CountingSort
+{
+  static_assert(ViewType::rank == 1, "Only sorting a View of rank 1");
+
+  using device_type     = typename ViewType::device_type;
+  using PermutationView = Kokkos::View<SizeType *, device_type>;
+  using CountView       = Kokkos::View<int *, device_type>;
+
+  //! bits per digit, number of digit values
+  static constexpr int RADIX_BITS = 8;
+  static constexpr int RADIX      = 1 << RADIX_BITS;
+
+  //! minimum number of keys per block (one thread per block)
+  static constexpr int MIN_BLOCK_SIZE = RADIX;
+
+  //! number of blocks per thread (load balance)
+  static constexpr int BLOCKS_PER_THREAD = 4;
+
+  //! number of blocks for n keys
+  static int blocks_for(int n)
+  {
+    const int nThreads = typename ViewType::execution_space().concurrency();
+
+    int nBlocks = (n + MIN_BLOCK_SIZE - 1) / MIN_BLOCK_SIZE;
+    if (nBlocks > BLOCKS_PER_THREAD * nThreads)
+      nBlocks = BLOCKS_PER_THREAD * nThreads;
+
+    return (nBlocks < 1) ? 1 : nBlocks;
+  }
+
+  CountingSort() = default;
+
+  //! \param[in] n is the maximum number of keys
+  CountingSort(int n)
+    : permutation("counting sort permutation", n),
+      permutation_tmp("counting sort permutation tmp", n),
+      keys_tmp("counting sort keys tmp", n),
+      counts("counting sort block counts", RADIX * blocks_for(n))
+  {}
+
+  //! permutations (the last sorted one is returned by sort)
+  PermutationView permutation, permutation_tmp;
+
+  //! keys of odd passes
+  ViewType keys_tmp;
+
+  //! number of keys per (digit, block), then their first slot
+  CountView counts;
+
+  /**
+   * Sort keys(0..n-1) in [0, nBins).
+   *
+   * \param[in,out] keys are the keys to sort (sorted on exit)
+   * \param[in] n is the number of keys (at most the size given on construction)
+   * \param[in] nBins is the number of key values
+   *
+   * \return the permutation : sorted key i was keys(permutation(i)) (a work view,
+   *         valid until the next sort)
+   */
+  PermutationView sort(ViewType keys, int n, int nBins)
+  {
+    using range_policy = Kokkos::RangePolicy<typename ViewType::execution_space>;
+
+    int nPasses = 1;
+    while (nPasses*RADIX_BITS < 31 and ((nBins-1) >> (nPasses*RADIX_BITS)) > 0)
+      ++nPasses;
+
+    const int nBlocks   = blocks_for(n);
+    const int blockSize = (n + nBlocks - 1) / nBlocks;
+
+    ViewType        keys_in  = keys;
+    ViewType        keys_out = keys_tmp;
+    PermutationView perm_in  = permutation_tmp;
+    PermutationView perm_out = permutation;
+    CountView       slots    = counts;
+
+    for (int pass = 0; pass < nPasses; ++pass)
+    {
+      const int  shift = pass * RADIX_BITS;
+      const bool first = (pass == 0);
+
+      // number of keys per (digit, block)
+      Kokkos::parallel_for("counting sort count", range_policy(0, nBlocks),
+        KOKKOS_LAMBDA(const int block)
+        {
+          for (int d = 0; d < RADIX; ++d)
+            slots(d*nBlocks + block) = 0;
+
+          const int begin = block * blockSize;
+          const int end   = (begin + blockSize < n) ? begin + blockSize : n;
+          for (int i = begin; i < end; ++i)
+            slots(((keys_in(i) >> shift) & (RADIX-1))*nBlocks + block) += 1;
+        });
+
+      // slot of the first key of each (digit, block) : exclusive scan, digit major
+      Kokkos::parallel_scan("counting sort offsets", range_policy(0, RADIX*nBlocks),
+        KOKKOS_LAMBDA(const int i, int& update, const bool final)
+        {
+          const int c = slots(i);
+
+          if (final)
+            slots(i) = update;
+
+          update += c;
+        });
+
+      // scatter, keys of a block in order
+      Kokkos::parallel_for("counting sort scatter", range_policy(0, nBlocks),
+        KOKKOS_LAMBDA(const int block)
+        {
+          const int begin = block * blockSize;
+          const int end   = (begin + blockSize < n) ? begin + blockSize : n;
+          for (int i = begin; i < end; ++i)
+          {
+            const int slot = slots(((keys_in(i) >> shift) & (RADIX-1))*nBlocks + block)++;
+            keys_out(slot) = keys_in(i);
+            perm_out(slot) = first ? SizeType(i) : perm_in(i);
+          }
+        });
+
+      std::swap(keys_in,  keys_out);
+      std::swap(perm_in,  perm_out);
+    }
+
+    // odd number of passes : sorted keys are in keys_tmp
+    if (keys_in.data() != keys.data())
+      Kokkos::parallel_for("counting sort keys", range_policy(0, n),
+        KOKKOS_LAMBDA(const int i)
+        {
+          keys(i) = keys_in(i);
+        });
+
+    return perm_in;
+  }
+
+}; // struct CountingSort
+
+//===============================================================================
+//===============================================================================
+/**
+ * Copy entry (row) j of src into entry (row) i of dst.
+ *
+ * For a rank 2 view, all components of the row are copied, e.g. both
+ * coordinates of a 2d position.
+ */
+template <class ViewType>
+KOKKOS_INLINE_FUNCTION
+void copy_entry(const ViewType& dst, int i, const ViewType& src, int j)
+{
+  if constexpr (ViewType::rank == 1)
+  {
+    dst(i) = src(j);
+  }
+  else
+  {
+    for (int k = 0; k < (int) dst.extent(1); ++k)
+      dst(i,k) = src(j,k);
+  }
+}
+
+//===============================================================================
+//===============================================================================
+/**
+ * Permute view entries : view(i) <- view(permutation(i)).
+ *
+ * view_tmp is used as output and swapped with view on exit.
+ * Views of rank 2 are permuted along their first dimension.
+ */
 template <class ViewType,
           class SizeType = unsigned int>
 void apply_permutation(ViewType& view,
                        ViewType& view_tmp,
                        Kokkos::View<SizeType *, typename ViewType::device_type> permutation)
 {
+  static_assert(ViewType::rank == 1 or ViewType::rank == 2,
+                "apply_permutation requires a View of rank 1 or 2");
+
   int const n = view.extent(0);
 
-  Kokkos::parallel_for("Apply permutation", n,
+  using range_policy = Kokkos::RangePolicy<typename ViewType::execution_space>;
+
+  Kokkos::parallel_for("Apply permutation", range_policy(0, n),
     KOKKOS_LAMBDA(const int index)
     {
-      view_tmp(index) = view(permutation(index));
+      copy_entry(view_tmp, index, view, permutation(index));
     });
 
   std::swap(view, view_tmp);
 
 }
 
+//===============================================================================
+//===============================================================================
+/**
+ * A view to permute, with its temporary output view (see apply_permutation).
+ */
+template <class ViewType>
+struct PermutationPayload
+{
+  ViewType& view;
+  ViewType& view_tmp;
+};
+
+//! \return payload permuting view, using view_tmp as output
+template <class ViewType>
+PermutationPayload<ViewType> payload(ViewType& view, ViewType& view_tmp)
+{
+  return PermutationPayload<ViewType>{view, view_tmp};
+}
+
+//===============================================================================
+//===============================================================================
+/**
+ * List of (output, input) views copied entry by entry in a single kernel.
+ */
+template <class... ViewTypes>
+struct PermutationViews;
+
+template <>
+struct PermutationViews<>
+{
+  KOKKOS_INLINE_FUNCTION
+  void copy(int, int) const {}
+};
+
+template <class ViewType, class... ViewTypes>
+struct PermutationViews<ViewType, ViewTypes...>
+{
+  ViewType dst, src;
+  PermutationViews<ViewTypes...> next;
+
+  //! copy entry j of every input view into entry i of its output view
+  KOKKOS_INLINE_FUNCTION
+  void copy(int i, int j) const
+  {
+    copy_entry(dst, i, src, j);
+    next.copy(i, j);
+  }
+};
+
+//! (output, input) views of payloads
+inline PermutationViews<> permutation_views()
+{
+  return PermutationViews<>{};
+}
+
+template <class ViewType, class... ViewTypes>
+PermutationViews<ViewType, ViewTypes...>
+permutation_views(const PermutationPayload<ViewType>& first,
+                  const PermutationPayload<ViewTypes>&... others)
+{
+  return PermutationViews<ViewType, ViewTypes...>{first.view_tmp, first.view,
+                                                  permutation_views(others...)};
+}
+
+//===============================================================================
+//===============================================================================
+/**
+ * Permute entries of several views at once : view(i) <- view(permutation(i))
+ * for every payload, in a single kernel (one read of the permutation per entry).
+ *
+ * \code
+ * kboids::apply_permutation(permutation,
+ *                           kboids::payload(pos, pos_tmp),
+ *                           kboids::payload(dx, dx_tmp));
+ * \endcode
+ *
+ * Views may have different value types, layouts and ranks (1 or 2, permuted
+ * along their first dimension), but must have the same first extent and live in
+ * the same execution space; temporary views must be distinct. Each view is
+ * swapped with its temporary on exit.
+ */
+template <class PermutationView, class ViewType, class... ViewTypes>
+void apply_permutation(const PermutationView& permutation,
+                       PermutationPayload<ViewType> first,
+                       PermutationPayload<ViewTypes>... others)
+{
+  static_assert(ViewType::rank == 1 or ViewType::rank == 2,
+                "apply_permutation requires Views of rank 1 or 2");
+
+  int const n = first.view.extent(0);
+
+  using range_policy = Kokkos::RangePolicy<typename ViewType::execution_space>;
+
+  const auto views = permutation_views(first, others...);
+
+  Kokkos::parallel_for("Apply permutation (multi)", range_policy(0, n),
+    KOKKOS_LAMBDA(const int index)
+    {
+      views.copy(index, permutation(index));
+    });
+
+  std::swap(first.view, first.view_tmp);
+  (std::swap(others.view, others.view_tmp), ...);
+
+}
+
 
 
 } // namespace kboids
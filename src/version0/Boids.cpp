@@ -1,67 +1,196 @@
 #include "Boids.h"
 
 #include "io/lodepng.h"
+#include "utils/likwid-utils.h"
+#include "utils/morton-utils.h"
+#include "utils/simd-utils.h"
+#include "utils/sort-utils.h"
 
 #include <chrono>
 #include <iostream>
 #include <sstream>
+#include <type_traits>
 
 // ===================================================
 // ===================================================
-void initPositions(BoidsData& boidsData, MyRandomPool::RGPool_t& rand_pool)
+void initPositions(BoidsData& boidsData, MyRandom& myRand)
 {
 
-  Kokkos::fill_random(boidsData.x, rand_pool, -1.0, 1.0);
-  Kokkos::fill_random(boidsData.y, rand_pool, -1.0, 1.0);
+  using value_t = BoidsData::value_t;
 
-  // using rnd_t = MyRandomPool::rnd_t;
+  const auto rng    = myRand.rng;
+  const auto stream = myRand.nextStream();
 
-  // Kokkos::parallel_for(boidsData.nBoids, KOKKOS_LAMBDA(const int& index)
-  // {
-  //   rnd_t rand_gen = rand_pool.get_state();
-
-  //   // birds positions
-  //   boidsData.x(index) = Kokkos::rand<rnd_t,double>::draw(rand_gen, -1.0, 1.0);
-  //   boidsData.y(index) = Kokkos::rand<rnd_t,double>::draw(rand_gen, -1.0, 1.0);
-
-  //   // free random gen state, so that it can used by other threads later.
-  //   rand_pool.free_state(rand_gen);
+  Kokkos::parallel_for("initPositions", boidsData.nBoids, KOKKOS_LAMBDA(const int& index)
+  {
+    const auto r = rng(stream, index);
 
-  // });
+    // birds positions
+    boidsData.x(index) = kboids::uniform_real<value_t>(r[0], -1.0, 1.0);
+    boidsData.y(index) = kboids::uniform_real<value_t>(r[1], -1.0, 1.0);
+  });
 
 } // BoidsData::initPositions
 
 // ===================================================
 // ===================================================
-void shuffleFriendsAndEnnemies(BoidsData& boidsData, MyRandomPool::RGPool_t& rand_pool, float rate)
+void shuffleFriendsAndEnnemies(BoidsData& boidsData, MyRandom& myRand, float rate,
+                               int window, kboids::ShuffleMode mode)
 {
 
   // rate should be in range [0,1]
   rate = (rate < 0) ? 0 : rate;
   rate = (rate > 1) ? 1 : rate;
 
-  using rnd_t = MyRandomPool::rnd_t;
+  // window should be in range [0,nBoids-1]
+  window = (window < 0) ? 0 : window;
+  window = (window > boidsData.nBoids-1) ? boidsData.nBoids-1 : window;
+
+  const auto rng    = myRand.rng;
+  const auto stream = myRand.nextStream();
+
+  if (kboids::use_sparse_shuffle(mode, rate))
+  {
+    if (rate <= 0)
+      return;
+
+    const double log1m_rate = log1p(-rate);
+    const int nBlocks = (boidsData.nBoids + SPARSE_SHUFFLE_BLOCK_SIZE - 1) / SPARSE_SHUFFLE_BLOCK_SIZE;
+
+    Kokkos::parallel_for("shuffleFriendsAndEnnemiesSparse", nBlocks,
+      KOKKOS_LAMBDA(const int& iBlock)
+      {
+        shuffleFriendsAndEnnemiesBlock(boidsData, rng, stream, log1m_rate, window, iBlock);
+      });
+  }
+  else
+  {
+    Kokkos::parallel_for("shuffleFriendsAndEnnemies",boidsData.nBoids,
+      KOKKOS_LAMBDA(const int& index)
+      {
+        shuffleFriendAndEnnemy(boidsData, rng, stream, rate, window, index);
+      });
+  }
+
+} // BoidsData::shuffleFriendsAndEnnemies
+
+// ===================================================
+// ===================================================
+void sortAlongMortonCurve(BoidsData& boidsData)
+{
+
+  using value_t = BoidsData::value_t;
+
+  const int nBoids = boidsData.nBoids;
+
+  // flock bounding box
+  Kokkos::MinMaxScalar<value_t> xrange, yrange;
+
+  Kokkos::parallel_reduce("sortAlongMortonCurve x range", nBoids,
+    KOKKOS_LAMBDA(const int& index, Kokkos::MinMaxScalar<value_t>& range)
+    {
+      const value_t x = boidsData.x(index);
+      if (x < range.min_val) range.min_val = x;
+      if (x > range.max_val) range.max_val = x;
+    }, Kokkos::MinMax<value_t>(xrange));
 
-  Kokkos::parallel_for("shuffleFriendsAndEnnemies",boidsData.nBoids,
-    KOKKOS_LAMBDA(const int& index)
+  Kokkos::parallel_reduce("sortAlongMortonCurve y range", nBoids,
+    KOKKOS_LAMBDA(const int& index, Kokkos::MinMaxScalar<value_t>& range)
     {
-      rnd_t rand_gen = rand_pool.get_state();
+      const value_t y = boidsData.y(index);
+      if (y < range.min_val) range.min_val = y;
+      if (y > range.max_val) range.max_val = y;
+    }, Kokkos::MinMax<value_t>(yrange));
+
+  // compute morton keys
+  BoidsData::VecInt keys("morton keys", nBoids);
+
+  Kokkos::parallel_for("sortAlongMortonCurve keys", nBoids, KOKKOS_LAMBDA(const int& index)
+  {
+    keys(index) = kboids::morton_key(boidsData.x(index), boidsData.y(index),
+                                     xrange.min_val, xrange.max_val,
+                                     yrange.min_val, yrange.max_val);
+  });
+
+  auto permutation = kboids::sort(keys);
+
+  // re-order positions (pos_new is only used as temporary here)
+  kboids::apply_permutation(boidsData.pos, boidsData.pos_new, permutation);
+  boidsData.setCoordinates();
+
+  // remap friends and ennemies : old index permutation(i) is now i
+  auto inverse = keys;
+  Kokkos::parallel_for("sortAlongMortonCurve inverse", nBoids, KOKKOS_LAMBDA(const int& index)
+  {
+    inverse(permutation(index)) = index;
+  });
+
+  BoidsData::VecInt tmp("tmp", nBoids);
+
+  Kokkos::parallel_for("sortAlongMortonCurve friends", nBoids, KOKKOS_LAMBDA(const int& index)
+  {
+    tmp(index) = inverse(boidsData.friends(permutation(index)));
+  });
+  std::swap(boidsData.friends, tmp);
+
+  Kokkos::parallel_for("sortAlongMortonCurve ennemies", nBoids, KOKKOS_LAMBDA(const int& index)
+  {
+    tmp(index) = inverse(boidsData.ennemies(permutation(index)));
+  });
+  std::swap(boidsData.ennemies, tmp);
+
+} // sortAlongMortonCurve
+
+// ===================================================
+// ===================================================
+void reportGatherDistance(BoidsData& boidsData)
+{
+
+  // bin 0 is distance 0, bin k>0 is distance in [2^(k-1), 2^k)
+  constexpr int nBins = 33;
 
-      float r = Kokkos::rand<rnd_t,float>::draw(rand_gen, 0, 1);
+  Kokkos::View<int*, Kokkos::DefaultExecutionSpace> histo("gather distance histogram", nBins);
+  Kokkos::View<int*, Kokkos::DefaultExecutionSpace, Kokkos::MemoryTraits<Kokkos::Atomic>> histo_atomic = histo;
 
-      // shuffle friends and ennemies
-      if (r < rate)
+  Kokkos::parallel_for("reportGatherDistance", boidsData.nBoids, KOKKOS_LAMBDA(const int& index)
+  {
+    int partners[2] = {boidsData.friends(index), boidsData.ennemies(index)};
+
+    for (int k=0; k<2; ++k)
+    {
+      unsigned int d = (partners[k] > index) ? partners[k]-index : index-partners[k];
+      int bin = 0;
+      while (d > 0)
       {
-        boidsData.friends(index) = Kokkos::rand<rnd_t,int>::draw(rand_gen, boidsData.nBoids);
-        boidsData.ennemies(index) = Kokkos::rand<rnd_t,int>::draw(rand_gen, boidsData.nBoids);
+        d >>= 1;
+        ++bin;
       }
+      histo_atomic(bin) += 1;
+    }
+  });
 
-      // free random gen state, so that it can used by other threads later.
-      rand_pool.free_state(rand_gen);
+  auto histo_host = Kokkos::create_mirror_view(histo);
+  Kokkos::deep_copy(histo_host, histo);
 
-    });
+  const double nGathers = 2.0*boidsData.nBoids;
+  double cumul = 0;
 
-} // BoidsData::shuffleFriendsAndEnnemies
+  std::cout << "Gather distance |index - partner| (friends and ennemies) :\n";
+  for (int bin=0; bin<nBins; ++bin)
+  {
+    if (histo_host(bin) == 0)
+      continue;
+
+    long lo = (bin == 0) ? 0 : (1l << (bin-1));
+    long hi = (bin == 0) ? 1 : (1l << bin);
+    cumul += histo_host(bin);
+
+    std::cout << "  [" << lo << ", " << hi << ") : "
+              << 100.0*histo_host(bin)/nGathers << " % (cumulated "
+              << 100.0*cumul/nGathers << " %)\n";
+  }
+
+} // reportGatherDistance
 
 // ===================================================
 // ===================================================
@@ -70,46 +199,322 @@ void updatePositions(BoidsData& boidsData)
 
   Kokkos::parallel_for("updatePositions", boidsData.nBoids, KOKKOS_LAMBDA(const int& index)
   {
-    auto x = boidsData.x(index);
-    auto y = boidsData.y(index);
+    updatePosition(boidsData, index);
+  });
+
+  // swap old and new data
+  boidsData.swapPositions();
+
+}
+
+// ===================================================
+// ===================================================
+template<typename ExecutionSpace>
+void updatePositionsPrefetch_impl(BoidsData& boidsData, int distance)
+{
 
-    auto index_friend = boidsData.friends(index);
-    auto index_ennemy = boidsData.ennemies(index);
+  if constexpr (not kboids::prefetch_enabled<ExecutionSpace>)
+  {
+    updatePositions(boidsData);
+  }
+  else
+  {
+    constexpr int B = kboids::PREFETCH_BATCH_SIZE;
+
+    distance = (distance < 0) ? 0 : distance;
+    distance = (distance > B) ? B : distance;
+
+    const int nBoids   = boidsData.nBoids;
+    const int nBatches = (nBoids + B - 1) / B;
 
-    // rule #1, move towards box center
-    double dx = -0.01 * x;
-    double dy = -0.01 * y;
+    Kokkos::parallel_for("updatePositionsPrefetch",
+                         Kokkos::RangePolicy<ExecutionSpace>(0, nBatches),
+                         KOKKOS_LAMBDA(const int& iBatch)
+    {
+      const int first = iBatch * B;
+      const int last  = (first + B < nBoids) ? first + B : nBoids;
 
-    float dir_x, dir_y;
+      // pipeline prologue
+      for (int index=first; index<first+distance and index<last; ++index)
+        prefetchPartners(boidsData, index);
 
-    // rule #2, move towards friend
-    compute_direction(x,y,
-                      boidsData.x(index_friend),
-                      boidsData.y(index_friend),
-                      dir_x, dir_y);
-    dx += 0.05 * dir_x;
-    dy += 0.05 * dir_y;
+      // steady state : prefetch distance boids ahead, compute current boid
+      for (int index=first; index<last; ++index)
+      {
+        if (distance > 0 and index+distance < last)
+          prefetchPartners(boidsData, index+distance);
 
-    // rule #3, move away from ennemy
-    compute_direction(x,y,
-                      boidsData.x(index_ennemy),
-                      boidsData.y(index_ennemy),
-                      dir_x, dir_y);
-    dx -= 0.03 * dir_x;
-    dy -= 0.03 * dir_y;
+        updatePosition(boidsData, index);
+      }
+    });
 
-    // update positions
-    boidsData.x_new(index) = x + dx;
-    boidsData.y_new(index) = y + dy;
+    // swap old and new data
+    boidsData.swapPositions();
+  }
 
+} // updatePositionsPrefetch_impl
+
+// ===================================================
+// ===================================================
+void updatePositionsPrefetch(BoidsData& boidsData, int distance)
+{
+  updatePositionsPrefetch_impl<Kokkos::DefaultExecutionSpace>(boidsData, distance);
+}
+
+// ===================================================
+// ===================================================
+void updatePositionsAndShuffle(BoidsData& boidsData, MyRandom& myRand, float rate,
+                               int window, kboids::ShuffleMode mode)
+{
+
+  if (kboids::use_sparse_shuffle(mode, rate))
+  {
+    updatePositions(boidsData);
+    shuffleFriendsAndEnnemies(boidsData, myRand, rate, window, mode);
+    return;
+  }
+
+  // rate should be in range [0,1]
+  rate = (rate < 0) ? 0 : rate;
+  rate = (rate > 1) ? 1 : rate;
+
+  // window should be in range [0,nBoids-1]
+  window = (window < 0) ? 0 : window;
+  window = (window > boidsData.nBoids-1) ? boidsData.nBoids-1 : window;
+
+  const auto rng    = myRand.rng;
+  const auto stream = myRand.nextStream();
+
+  // boid index only reads and writes its own friend/ennemy index : no race
+  Kokkos::parallel_for("updatePositionsAndShuffle", boidsData.nBoids, KOKKOS_LAMBDA(const int& index)
+  {
+    updatePosition(boidsData, index);
+    shuffleFriendAndEnnemy(boidsData, rng, stream, rate, window, index);
   });
 
   // swap old and new data
-  std::swap(boidsData.x, boidsData.x_new);
-  std::swap(boidsData.y, boidsData.y_new);
+  boidsData.swapPositions();
+
+} // updatePositionsAndShuffle
+
+// ===================================================
+// ===================================================
+template<typename ExecutionSpace>
+void updatePositionsSimd_impl(BoidsData& boidsData)
+{
+
+  if constexpr (not kboids::simd_enabled<ExecutionSpace>)
+  {
+    updatePositions(boidsData);
+  }
+#ifdef KBOIDS_USE_SIMD_MATH
+  else
+  {
+    using compute_t = BoidsData::compute_t;
+    using simd_t    = kboids::simd_t<compute_t>;
+    using tag_t     = simd::element_aligned_tag;
+
+    constexpr int W = simd_t::size();
+
+    const int nBoids  = boidsData.nBoids;
+    const int nBlocks = (nBoids + W - 1) / W;
+
+    auto x        = boidsData.x;
+    auto y        = boidsData.y;
+    auto x_new    = boidsData.x_new;
+    auto y_new    = boidsData.y_new;
+    auto friends  = boidsData.friends;
+    auto ennemies = boidsData.ennemies;
+
+    // host only kernel : plain lambda
+    Kokkos::parallel_for("updatePositionsSimd",
+                         Kokkos::RangePolicy<ExecutionSpace>(0, nBlocks),
+                         [=](const int& iBlock)
+    {
+      const int first  = iBlock * W;
+      const int nLanes = (nBoids - first < W) ? nBoids - first : W;
+
+      // gather own, friend and ennemy positions into aligned buffers
+      // (last block is padded with its last boid)
+      alignas(64) compute_t buf[6][W];
+
+      for (int l=0; l<W; ++l)
+      {
+        const int index = first + ((l < nLanes) ? l : nLanes-1);
+        const int index_friend = friends(index);
+        const int index_ennemy = ennemies(index);
+
+        buf[0][l] = x(index);
+        buf[1][l] = y(index);
+        buf[2][l] = x(index_friend);
+        buf[3][l] = y(index_friend);
+        buf[4][l] = x(index_ennemy);
+        buf[5][l] = y(index_ennemy);
+      }
+
+      simd_t xs, ys, x_friend, y_friend, x_ennemy, y_ennemy;
+      xs.copy_from(buf[0], tag_t());
+      ys.copy_from(buf[1], tag_t());
+      x_friend.copy_from(buf[2], tag_t());
+      y_friend.copy_from(buf[3], tag_t());
+      x_ennemy.copy_from(buf[4], tag_t());
+      y_ennemy.copy_from(buf[5], tag_t());
+
+      // rule #1, move towards box center
+      simd_t dx = simd_t(compute_t(-0.01)) * xs;
+      simd_t dy = simd_t(compute_t(-0.01)) * ys;
+
+      simd_t dir_x, dir_y;
+
+      // rule #2, move towards friend
+      kboids::simd_direction<compute_t>(xs, ys, x_friend, y_friend, dir_x, dir_y);
+      dx += simd_t(compute_t(0.05)) * dir_x;
+      dy += simd_t(compute_t(0.05)) * dir_y;
+
+      // rule #3, move away from ennemy
+      kboids::simd_direction<compute_t>(xs, ys, x_ennemy, y_ennemy, dir_x, dir_y);
+      dx -= simd_t(compute_t(0.03)) * dir_x;
+      dy -= simd_t(compute_t(0.03)) * dir_y;
+
+      // update positions
+      (xs + dx).copy_to(buf[0], tag_t());
+      (ys + dy).copy_to(buf[1], tag_t());
 
+      for (int l=0; l<nLanes; ++l)
+      {
+        x_new(first+l) = buf[0][l];
+        y_new(first+l) = buf[1][l];
+      }
+    });
+
+    // swap old and new data
+    boidsData.swapPositions();
+  }
+#endif // KBOIDS_USE_SIMD_MATH
+
+} // updatePositionsSimd_impl
+
+// ===================================================
+// ===================================================
+void updatePositionsSimd(BoidsData& boidsData)
+{
+  updatePositionsSimd_impl<Kokkos::DefaultExecutionSpace>(boidsData);
 }
 
+// ===================================================
+// ===================================================
+void updatePositionsPersistent(BoidsData& boidsData,
+                               MyRandom& myRand,
+                               int iStart,
+                               int nSteps,
+                               int shufflePeriod,
+                               float rate,
+                               int window,
+                               kboids::ShuffleMode mode)
+{
+
+  // rate should be in range [0,1]
+  rate = (rate < 0) ? 0 : rate;
+  rate = (rate > 1) ? 1 : rate;
+
+  // window should be in range [0,nBoids-1]
+  window = (window < 0) ? 0 : window;
+  window = (window > boidsData.nBoids-1) ? boidsData.nBoids-1 : window;
+
+#if defined(KOKKOS_ENABLE_OPENMP) && defined(_OPENMP)
+
+  if (std::is_same<Kokkos::DefaultExecutionSpace, Kokkos::OpenMP>::value)
+  {
+
+    const int nBoids = boidsData.nBoids;
+
+    const kboids::CounterRNG rng = myRand.rng;
+    const uint64_t firstStream   = myRand.stream;
+
+    const bool sparse = kboids::use_sparse_shuffle(mode, rate);
+    const double log1m_rate = log1p(-rate);
+    const int nBlocks = (nBoids + SPARSE_SHUFFLE_BLOCK_SIZE - 1) / SPARSE_SHUFFLE_BLOCK_SIZE;
+
+#pragma omp parallel num_threads(Kokkos::OpenMP().concurrency())
+    {
+      // thread private shallow copy (views are not duplicated), each thread
+      // swaps its own copy of old/new data, no need for an extra barrier
+      BoidsData data = boidsData;
+
+      // one stream per shuffle, as in the per-step path
+      uint64_t stream = firstStream;
+
+      LIKWID_MARKER_START("updatePositions");
+
+      for (int iTime=iStart; iTime<iStart+nSteps; ++iTime)
+      {
+
+        const bool shuffleStep = (iTime % shufflePeriod == 0);
+
+        if (shuffleStep and not sparse)
+        {
+          // fused update and dense shuffle (see updatePositionsAndShuffle)
+#pragma omp for schedule(static)
+          for (int index=0; index<nBoids; ++index)
+          {
+            updatePosition(data, index);
+            shuffleFriendAndEnnemy(data, rng, stream, rate, window, index);
+          }
+          ++stream;
+
+          // implicit barrier above: every thread is done reading old data
+          data.swapPositions();
+        }
+        else
+        {
+#pragma omp for schedule(static)
+          for (int index=0; index<nBoids; ++index)
+            updatePosition(data, index);
+
+          // implicit barrier above: every thread is done reading old data
+          data.swapPositions();
+
+          if (shuffleStep and rate > 0)
+          {
+#pragma omp for schedule(static)
+            for (int iBlock=0; iBlock<nBlocks; ++iBlock)
+              shuffleFriendsAndEnnemiesBlock(data, rng, stream, log1m_rate, window, iBlock);
+          }
+          if (shuffleStep)
+            ++stream;
+        }
+
+      } // end for iTime
+
+      LIKWID_MARKER_STOP("updatePositions");
+
+    } // end omp parallel
+
+    // keep the master copy in sync with the swaps done inside the region
+    if (nSteps % 2 == 1)
+      boidsData.swapPositions();
+
+    // skip streams used inside the region
+    for (int iTime=iStart; iTime<iStart+nSteps; ++iTime)
+      if (iTime % shufflePeriod == 0)
+        myRand.nextStream();
+
+    return;
+  }
+
+#endif // KOKKOS_ENABLE_OPENMP
+
+  // fallback : one kernel launch per time step
+  for (int iTime=iStart; iTime<iStart+nSteps; ++iTime)
+  {
+    if (iTime % shufflePeriod == 0)
+      updatePositionsAndShuffle(boidsData, myRand, rate, window, mode);
+    else
+      updatePositions(boidsData);
+  }
+
+} // updatePositionsPersistent
+
 // ===================================================
 // ===================================================
 void copyPositionsForRendering(BoidsData& boidsData)
@@ -117,6 +522,10 @@ void copyPositionsForRendering(BoidsData& boidsData)
 
 #ifdef FORGE_ENABLED
 
+  // interleaved float storage can be used directly for rendering
+  if (BoidsData::direct_rendering)
+    return;
+
   Kokkos::parallel_for("copyPositionsForRendering",boidsData.nBoids, KOKKOS_LAMBDA(const int& index)
   {
     auto x = boidsData.x(index);
@@ -138,8 +547,7 @@ void renderPositions(PngData data, BoidsData& boidsData)
   auto scale = (data.extent(0)-1)/2.0;
 
   // 1. copy back on host boids positions
-  Kokkos::deep_copy(boidsData.x_host, boidsData.x);
-  Kokkos::deep_copy(boidsData.y_host, boidsData.y);
+  Kokkos::deep_copy(boidsData.pos_host, boidsData.pos);
 
   // 2. create image
   //auto pol = Kokkos::RangePolicy<>(Kokkos::OpenMP(), 0, boidsData.nBoids);
@@ -4,7 +4,15 @@
 
 // Include Kokkos Headers
 #include<Kokkos_Core.hpp>
-#include <Kokkos_Random.hpp>
+
+#include <type_traits>
+#include <utility>
+
+#include "utils/kernel-type.h"
+#include "utils/position-layout.h"
+#include "utils/precision-policy.h"
+#include "utils/prefetch-utils.h"
+#include "utils/random-utils.h"
 
 
 // ===================================================
@@ -26,35 +34,70 @@ using PngData = Kokkos::View<unsigned char***, Kokkos::LayoutRight, Kokkos::Seri
 // ===================================================
 struct BoidsData
 {
+  //! precision policy (chosen at compile time, see utils/precision-policy.h)
+  using Precision = kboids::DefaultPrecision;
+  using real_t    = Precision::storage_t;
+  using value_t   = Precision::value_t;
+  using compute_t = Precision::compute_t;
+
   using VecInt   = Kokkos::View<int*,   Kokkos::DefaultExecutionSpace>;
   using VecFloat = Kokkos::View<float*, Kokkos::DefaultExecutionSpace>;
 
+  //! positions storage (layout chosen at compile time, see utils/position-layout.h)
+  using VecPos   = kboids::PositionView<Kokkos::DefaultExecutionSpace::memory_space, real_t>;
+  using VecCoord = kboids::CoordView<VecPos>;
+
+  using VecPosHost   = VecPos::HostMirror;
+  using VecCoordHost = kboids::CoordView<VecPosHost>;
+
   BoidsData(int nBoids)
     : nBoids(nBoids),
-      x("x",nBoids),
-      y("y",nBoids),
-      x_new("x_new",nBoids),
-      y_new("y_new",nBoids),
+      pos("pos",nBoids),
+      pos_new("pos_new",nBoids),
       friends("friends",nBoids),
       ennemies("ennemies",nBoids),
-      x_host(),
-      y_host()
+      pos_host()
 #ifdef FORGE_ENABLED
-      ,xy("xy",2*nBoids)
+      ,xy("xy",direct_rendering ? 0 : 2*nBoids)
 #endif
   {
-    x_host = Kokkos::create_mirror(x);
-    y_host = Kokkos::create_mirror(y);
+    setCoordinates();
+
+    pos_host = Kokkos::create_mirror(pos);
+    x_host = kboids::coordinate(pos_host, 0);
+    y_host = kboids::coordinate(pos_host, 1);
+  }
+
+  //! (re)build x,y views (and x_new,y_new) on top of positions storage
+  void setCoordinates()
+  {
+    x     = kboids::coordinate(pos, 0);
+    y     = kboids::coordinate(pos, 1);
+    x_new = kboids::coordinate(pos_new, 0);
+    y_new = kboids::coordinate(pos_new, 1);
+  }
+
+  //! swap old and new positions
+  void swapPositions()
+  {
+    std::swap(pos, pos_new);
+    setCoordinates();
   }
 
   //! number of boids
   int nBoids;
 
+  //! positions storage
+  VecPos pos;
+
+  //! temp positions storage used to compute postion update (one time step)
+  VecPos pos_new;
+
   //! set of boids coordinates
-  VecFloat x, y;
+  VecCoord x, y;
 
   //! temp array of boids used to compute postion update (one time step)
-  VecFloat x_new, y_new;
+  VecCoord x_new, y_new;
 
   //! vector of friend index
   VecInt friends;
@@ -62,12 +105,26 @@ struct BoidsData
   //! vector of enemy index
   VecInt ennemies;
 
+  //! mirror of positions on host (for image rendering only)
+  VecPosHost pos_host;
+
   //! mirror of x,y data on host (for image rendering only)
-  VecFloat::HostMirror x_host;
-  VecFloat::HostMirror y_host;
+  VecCoordHost x_host;
+  VecCoordHost y_host;
 
 #ifdef FORGE_ENABLED
+  //! can positions storage be directly used as an OpenGL vertex buffer ?
+  static constexpr bool direct_rendering =
+    kboids::interleaved_positions and std::is_same<real_t, float>::value;
+
+  //! interleaved positions for OpenGL rendering (not allocated when direct_rendering)
   VecFloat xy;
+
+  //! pointer to interleaved {x,y} float data for OpenGL rendering
+  float* renderData()
+  {
+    return direct_rendering ? reinterpret_cast<float*>(pos.data()) : xy.data();
+  }
 #endif
 
 }; // struct BoidsData
@@ -75,40 +132,71 @@ struct BoidsData
 
 // ===================================================
 // ===================================================
-class MyRandomPool
+/**
+ * Counter-based random number generator (see utils/random-utils.h).
+ *
+ * Each kernel drawing random numbers uses its own stream; random numbers of boid
+ * index are rng(stream, index), so there is no generator state to check out and
+ * results do not depend on the number of threads.
+ */
+class MyRandom
 {
 
 public:
 
-  // define an alias to the random generator pool
-  using RGPool_t = Kokkos::Random_XorShift64_Pool<Kokkos::DefaultExecutionSpace>;
-
-  // type for hold the random generator state
-  using rnd_t = RGPool_t::generator_type;
-
-  // which execution space ? OpenMP, Cuda, ...
-  using device_t = RGPool_t::device_type;
-
-  MyRandomPool(uint64_t seed)
-    : pool(seed)
+  MyRandom(uint64_t seed)
+    : rng(seed),
+      stream(0)
   {
 
   }
 
-  RGPool_t pool;
+  //! stream to be used by the next kernel
+  uint64_t nextStream() { return stream++; }
 
-}; // MyRandomPool
+  kboids::CounterRNG rng;
+
+  //! index of the next unused stream
+  uint64_t stream;
+
+}; // MyRandom
 
 // ===================================================
 // ===================================================
-void initPositions(BoidsData& boidsData, MyRandomPool::RGPool_t& rand_pool);
+void initPositions(BoidsData& boidsData, MyRandom& myRand);
 
 // ===================================================
 // ===================================================
 /**
  * Randomly change friends and ennemies.
+ *
+ * \param[in] rate is ratio (in [0,1]) of boids which get new friend and ennemy
+ * \param[in] window if > 0, new friend and ennemy index are drawn in
+ *            [index-window,index+window] instead of the whole flock
+ * \param[in] mode selects the dense (draw for every boid) or sparse (only visit
+ *            selected boids, O(rate.nBoids)) algorithm
+ */
+void shuffleFriendsAndEnnemies(BoidsData& boidsData, MyRandom& myRand, float rate,
+                               int window = 0,
+                               kboids::ShuffleMode mode = kboids::ShuffleMode::AUTO);
+
+// ===================================================
+// ===================================================
+/**
+ * Re-order boids along a Morton curve (computed over flock bounding box),
+ * friends and ennemies index are remapped accordingly.
+ *
+ * Combined with a bounded friend/ennemy window, this makes the friend/ennemy
+ * gathers in updatePositions mostly cache local.
+ */
+void sortAlongMortonCurve(BoidsData& boidsData);
+
+// ===================================================
+// ===================================================
+/**
+ * Print the distribution of |index - friend| and |index - ennemy| (log2 bins).
  */
-void shuffleFriendsAndEnnemies(BoidsData& boidsData, MyRandomPool::RGPool_t& rand_pool, float rate);
+void reportGatherDistance(BoidsData& boidsData);
 
 // ===================================================
 // ===================================================
@@ -117,29 +205,276 @@ double SQR(const double& v) {return v*v;}
 
 // ===================================================
 // ===================================================
+/**
+ * Unit vector from (x1,y1) to (x2,y2), or (0,0) when both points are closer than 1e-6.
+ *
+ * Branch free : a single reciprocal square root, and a select instead of a test
+ * around the divisions, so that the loop calling it can be vectorized.
+ */
+template <typename T>
+KOKKOS_INLINE_FUNCTION
+void compute_direction(T x1, T y1,
+                       T x2, T y2,
+                       T& x, T& y)
+{
+  const T ddx = x2-x1;
+  const T ddy = y2-y1;
+  const T norm2 = ddx*ddx + ddy*ddy;
+
+  // norm < 1e-6 <=> norm2 < 1e-12
+  const T inv_norm = (norm2 < T(1e-12)) ? T(0) : kboids::rsqrt(norm2);
+
+  x = ddx*inv_norm;
+  y = ddy*inv_norm;
+}
+
+// ===================================================
+// ===================================================
+/**
+ * Reflect index i inside [0,n-1] (assuming -n < i < 2n-1).
+ */
+KOKKOS_INLINE_FUNCTION
+int reflect_index(int i, int n)
+{
+  if (i < 0)
+    i = -i;
+  if (i >= n)
+    i = 2*(n-1) - i;
+  return i;
+}
+
+// ===================================================
+// ===================================================
+/**
+ * Draw new friend and ennemy of boid index from random words r[1] and r[2].
+ */
 KOKKOS_INLINE_FUNCTION
-void compute_direction(const float& x1, const float& y1,
-                       const float& x2, const float& y2,
-                       float& x, float& y)
+void drawFriendAndEnnemy(const BoidsData& boidsData,
+                         const kboids::RandomWords& r,
+                         int window,
+                         int index)
 {
-  double norm = sqrt( (x2-x1)*(x2-x1) +
-                      (y2-y1)*(y2-y1) );
-  if (norm < 1e-6)
+  if (window > 0)
   {
-    x = 0;
-    y = 0;
+    // spatially local mode : draw in a bounded index window
+    int offset_friend = kboids::uniform_int(r[1], -window, window+1);
+    int offset_ennemy = kboids::uniform_int(r[2], -window, window+1);
+    boidsData.friends(index)  = reflect_index(index + offset_friend, boidsData.nBoids);
+    boidsData.ennemies(index) = reflect_index(index + offset_ennemy, boidsData.nBoids);
   }
   else
   {
-    x = (x2-x1)/norm;
-    y = (y2-y1)/norm;
+    boidsData.friends(index)  = kboids::uniform_int(r[1], boidsData.nBoids);
+    boidsData.ennemies(index) = kboids::uniform_int(r[2], boidsData.nBoids);
   }
-}
+
+} // drawFriendAndEnnemy
+
+// ===================================================
+// ===================================================
+/**
+ * Randomly change friend and ennemy of a single boid, using random numbers
+ * of the given stream.
+ *
+ * This is the body of the dense shuffleFriendsAndEnnemies, shared with the
+ * persistent driver so that both paths draw exactly the same random numbers.
+ */
+KOKKOS_INLINE_FUNCTION
+void shuffleFriendAndEnnemy(const BoidsData& boidsData,
+                            const kboids::CounterRNG& rng,
+                            uint64_t stream,
+                            float rate,
+                            int window,
+                            int index)
+{
+  const auto r = rng(stream, index);
+
+  // shuffle friends and ennemies
+  if (kboids::uniform_real<float>(r[0], 0, 1) < rate)
+    drawFriendAndEnnemy(boidsData, r, window, index);
+
+} // shuffleFriendAndEnnemy
+
+// ===================================================
+// ===================================================
+//! number of boids per block in the sparse shuffle
+constexpr int SPARSE_SHUFFLE_BLOCK_SIZE = 1024;
+
+// ===================================================
+// ===================================================
+/**
+ * Randomly change friend and ennemy of boids in block iBlock (sparse algorithm).
+ *
+ * Instead of testing every boid, we jump from one selected boid to the next one
+ * with geometric skips : each boid is still selected with probability rate, but
+ * only selected boids are visited.
+ *
+ * Random words of selected boid index are rng(stream, index) : r[1], r[2] give
+ * friend and ennemy, r[3] the skip to the next selected boid. The first skip of
+ * a block uses rng(stream, nBoids+iBlock).
+ *
+ * \param[in] log1m_rate is log(1-rate)
+ */
+KOKKOS_INLINE_FUNCTION
+void shuffleFriendsAndEnnemiesBlock(const BoidsData& boidsData,
+                                    const kboids::CounterRNG& rng,
+                                    uint64_t stream,
+                                    double log1m_rate,
+                                    int window,
+                                    int iBlock)
+{
+  const int nBoids = boidsData.nBoids;
+  const int first  = iBlock * SPARSE_SHUFFLE_BLOCK_SIZE;
+  const int last   = (first + SPARSE_SHUFFLE_BLOCK_SIZE < nBoids) ?
+    first + SPARSE_SHUFFLE_BLOCK_SIZE : nBoids;
+
+  int index = first +
+    kboids::geometric_skip(rng(stream, nBoids + iBlock)[0], log1m_rate, SPARSE_SHUFFLE_BLOCK_SIZE);
+
+  while (index < last)
+  {
+    const auto r = rng(stream, index);
+
+    drawFriendAndEnnemy(boidsData, r, window, index);
+
+    index += 1 + kboids::geometric_skip(r[3], log1m_rate, SPARSE_SHUFFLE_BLOCK_SIZE);
+  }
+
+} // shuffleFriendsAndEnnemiesBlock
+
+// ===================================================
+// ===================================================
+/**
+ * Compute new position of a single boid (read x,y, write x_new,y_new).
+ *
+ * This is the body of updatePositions, shared with the persistent driver
+ * so that both paths are bit-identical.
+ */
+KOKKOS_INLINE_FUNCTION
+void updatePosition(const BoidsData& boidsData, int index)
+{
+  using compute_t = BoidsData::compute_t;
+
+  const compute_t x = boidsData.x(index);
+  const compute_t y = boidsData.y(index);
+
+  auto index_friend = boidsData.friends(index);
+  auto index_ennemy = boidsData.ennemies(index);
+
+  // rule #1, move towards box center
+  compute_t dx = compute_t(-0.01) * x;
+  compute_t dy = compute_t(-0.01) * y;
+
+  compute_t dir_x, dir_y;
+
+  // rule #2, move towards friend
+  compute_direction<compute_t>(x,y,
+                               boidsData.x(index_friend),
+                               boidsData.y(index_friend),
+                               dir_x, dir_y);
+  dx += compute_t(0.05) * dir_x;
+  dy += compute_t(0.05) * dir_y;
+
+  // rule #3, move away from ennemy
+  compute_direction<compute_t>(x,y,
+                               boidsData.x(index_ennemy),
+                               boidsData.y(index_ennemy),
+                               dir_x, dir_y);
+  dx -= compute_t(0.03) * dir_x;
+  dy -= compute_t(0.03) * dir_y;
+
+  // update positions
+  boidsData.x_new(index) = x + dx;
+  boidsData.y_new(index) = y + dy;
+
+} // updatePosition
+
+// ===================================================
+// ===================================================
+/**
+ * Prefetch friend and ennemy positions of boid index (host only, no-op on device).
+ */
+KOKKOS_INLINE_FUNCTION
+void prefetchPartners(const BoidsData& boidsData, int index)
+{
+  const int index_friend = boidsData.friends(index);
+  const int index_ennemy = boidsData.ennemies(index);
+
+  KBOIDS_PREFETCH(&boidsData.x(index_friend));
+  KBOIDS_PREFETCH(&boidsData.y(index_friend));
+  KBOIDS_PREFETCH(&boidsData.x(index_ennemy));
+  KBOIDS_PREFETCH(&boidsData.y(index_ennemy));
+
+} // prefetchPartners
 
 // ===================================================
 // ===================================================
 void updatePositions(BoidsData& boidsData);
 
+// ===================================================
+// ===================================================
+/**
+ * Same as updatePositions, gather pipelined : boids are processed by batches,
+ * and partner positions of boid index+distance are prefetched while boid index
+ * is computed, so that up to distance random reads are in flight per thread.
+ *
+ * Results are bit-identical to updatePositions (distance 0 is updatePositions
+ * by batches). On device backends, this is just updatePositions.
+ */
+void updatePositionsPrefetch(BoidsData& boidsData,
+                             int distance = kboids::PREFETCH_DEFAULT_DISTANCE);
+
+// ===================================================
+// ===================================================
+/**
+ * Update positions (one time step), then shuffle friends and ennemies.
+ *
+ * Same result as updatePositions followed by shuffleFriendsAndEnnemies, but when
+ * the shuffle is dense, both are fused into a single sweep : each boid reads its
+ * friend/ennemy index once, moves, then gets its new friend/ennemy (same random
+ * stream as the separate shuffle).
+ *
+ * A sparse shuffle only touches O(rate.nBoids) entries, it is not fused.
+ */
+void updatePositionsAndShuffle(BoidsData& boidsData, MyRandom& myRand, float rate,
+                               int window = 0,
+                               kboids::ShuffleMode mode = kboids::ShuffleMode::AUTO);
+
+// ===================================================
+// ===================================================
+/**
+ * Same as updatePositions, explicitly vectorized : each iteration updates a
+ * SIMD vector of boids (friend/ennemy positions are gathered into aligned buffers).
+ *
+ * Requires simd-math (cmake option USE_SIMD_MATH) and a host backend, otherwise
+ * this is just updatePositions.
+ */
+void updatePositionsSimd(BoidsData& boidsData);
+
+// ===================================================
+// ===================================================
+/**
+ * Persistent driver : perform nSteps time steps (starting at iStart)
+ * inside a single parallel region.
+ *
+ * Time steps are separated by in-region barriers instead of kernel launches;
+ * friends and ennemies are shuffled every shufflePeriod steps (with given rate),
+ * exactly as in the per-step loop.
+ *
+ * Random numbers only depend on (stream, boid index), so that results are
+ * bit-identical to the per-step path (using the same shuffle mode).
+ *
+ * On other backends, this falls back to the per-step kernel launches.
+ */
+void updatePositionsPersistent(BoidsData& boidsData,
+                               MyRandom& myRand,
+                               int iStart,
+                               int nSteps,
+                               int shufflePeriod,
+                               float rate,
+                               int window = 0,
+                               kboids::ShuffleMode mode = kboids::ShuffleMode::AUTO);
+
 // ===================================================
 // ===================================================
 void renderPositions(PngData data, BoidsData& boidsData);
@@ -24,6 +24,15 @@ void usage(const std::string &app_name)
       "  -n, --nboids arg        Number of boids (default: 1000)\n"
       "  -i, --iter arg          Number of time steps (default: 100)\n"
       "  -s, --seed arg          Random seed (default: 42)\n"
+      "  -p, --persistent arg    Number of time steps per persistent parallel region (default: 1, i.e. disabled)\n"
+      "  -w, --window arg        Draw friends/ennemies within this index distance (default: 0, i.e. whole flock)\n"
+      "  -r, --resort arg        Re-sort flock along a Morton curve every arg time steps (default: 0, i.e. never)\n"
+      "  -k, --kernel arg        updatePositions kernel : scalar, simd or prefetch (default: scalar)\n"
+      "  --prefetch-distance arg Prefetch distance (in boids) of the prefetch kernel (default: 16)\n"
+      "  --prefetch-bench        Time scalar and prefetch kernels for distances from 0 to 128 (arg -i time steps per distance)\n"
+      "  --shuffle arg           Friends/ennemies shuffle algorithm : dense, sparse or auto (default: auto)\n"
+      "  --shuffle-bench         Time dense and sparse shuffles for rates from 0.001 to 1 (arg -i shuffles per rate)\n"
+      "  --no-fuse               Do not fuse position update and shuffle on shuffle steps\n"
       "  -d, --dump              Dump data to PNG files\n"
       "  -g, --gui               Add a simple visualization gui (require FORGE library)\n"
       "  -h, --help              Show this help";
@@ -64,23 +73,61 @@ int main(int argc, char* argv[])
       "-n", "--nboids",
       "-i", "--iter",
       "-s", "--seed",
+      "-p", "--persistent",
+      "-w", "--window",
+      "-r", "--resort",
+      "-k", "--kernel",
+      "--shuffle",
+      "--prefetch-distance",
       "-d", "--dump",
       "-g", "--gui"});
     cmdl.parse(argc, argv);
 
 
-  int nBoids;
-  cmdl({"n", "nboids"}, 1000) >> nBoids;
+  RunParams params;
 
-  uint32_t nIter;
-  cmdl({"i", "iter"}, 100) >> nIter;
+  cmdl({"n", "nboids"}, 1000) >> params.nBoids;
+
+  cmdl({"i", "iter"}, 100) >> params.nIter;
 
   // initialize the random generator pool
   //uint64_t seed = std::chrono::high_resolution_clock::now().time_since_epoch().count();
-  uint64_t seed;
-  cmdl({"s", "seed"}, 42) >> seed;
+  cmdl({"s", "seed"}, 42) >> params.seed;
+
+  // number of time steps performed inside a single parallel region
+  cmdl({"p", "persistent"}, 1) >> params.nPersistentSteps;
+
+  // spatially local friends/ennemies selection
+  cmdl({"w", "window"}, 0) >> params.window;
+  cmdl({"r", "resort"}, 0) >> params.resortPeriod;
+
+  // kernel variant
+  std::string kernel_name;
+  cmdl({"k", "kernel"}, "scalar") >> kernel_name;
+  if (not kboids::kernel_from_string(kernel_name, params.kernel))
+  {
+    std::cerr << "Unknown kernel : " << kernel_name << "\n";
+    return EXIT_FAILURE;
+  }
+
+  // shuffle algorithm
+  std::string shuffle_name;
+  cmdl({"shuffle"}, "auto") >> shuffle_name;
+  if (not kboids::shuffle_mode_from_string(shuffle_name, params.shuffleMode))
+  {
+    std::cerr << "Unknown shuffle mode : " << shuffle_name << "\n";
+    return EXIT_FAILURE;
+  }
+
+  params.shuffle_benchmark = cmdl[{"shuffle-bench"}];
+
+  params.fuseShuffle = not cmdl[{"no-fuse"}];
+
+  // gather pipelined kernel
+  cmdl({"prefetch-distance"}, kboids::PREFETCH_DEFAULT_DISTANCE) >> params.prefetchDistance;
+  params.prefetch_benchmark = cmdl[{"prefetch-bench"}];
 
-  bool dump_data = cmdl[{"d","--dump"}];
+  params.dump_data = cmdl[{"d","--dump"}];
 
   bool guiEnabled = cmdl[{"g","--gui"}];
 
@@ -100,7 +147,7 @@ int main(int argc, char* argv[])
     if (guiEnabled)
     {
 #ifdef FORGE_ENABLED
-      run_boids_flight_gui(nBoids, nIter, seed, dump_data);
+      run_boids_flight_gui(params.nBoids, params.nIter, params.seed, params.dump_data);
 #else
       std::cerr << "Rerun cmake and enable Forge library.\n";
 #endif
@@ -121,7 +168,12 @@ int main(int argc, char* argv[])
       // std::cout << "GUI enabled, we limit the number of boids to 1000\n";
       // nBoids = (nBoids > 1000) ? 1000 : nBoids;
 
-      run_boids_flight(nBoids, nIter, seed, dump_data);
+      if (params.shuffle_benchmark)
+        run_shuffle_benchmark(params);
+      else if (params.prefetch_benchmark)
+        run_prefetch_benchmark(params);
+      else
+        run_boids_flight(params);
 
       LIKWID_MARKER_CLOSE;
 
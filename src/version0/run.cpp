@@ -1,9 +1,14 @@
 #include "Boids.h"
+#include "run.h"
 
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
 #include <cstdint>
+#include <string>
 
 #include "utils/likwid-utils.h"
+#include "utils/simd-utils.h"
 #include "time/Timer.h"
 
 #ifdef FORGE_ENABLED
@@ -19,65 +24,282 @@
 
 // =====================================================================================
 // =====================================================================================
-void run_boids_flight(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool dump_data)
+void run_boids_flight(const RunParams& params)
 {
 
+  const auto nBoids           = params.nBoids;
+  const auto nIter            = params.nIter;
+  const auto dump_data        = params.dump_data;
+  const auto nPersistentSteps = params.nPersistentSteps;
+  const auto window           = params.window;
+  const auto resortPeriod     = params.resortPeriod;
+
+  auto kernel = params.kernel;
+
+  if (kernel == kboids::UpdateKernel::SIMD and
+      not kboids::simd_enabled<Kokkos::DefaultExecutionSpace>)
+  {
+    std::cout << "SIMD kernel not available (requires cmake option USE_SIMD_MATH and a host backend)\n";
+    kernel = kboids::UpdateKernel::SCALAR;
+  }
+
+  if (kernel == kboids::UpdateKernel::PREFETCH and
+      not kboids::prefetch_enabled<Kokkos::DefaultExecutionSpace>)
+  {
+    std::cout << "Prefetch kernel not available (requires a host backend)\n";
+    kernel = kboids::UpdateKernel::SCALAR;
+  }
+
+  if (kernel != kboids::UpdateKernel::SCALAR and nPersistentSteps > 1)
+  {
+    std::cout << "Persistent mode only supports the scalar kernel\n";
+    kernel = kboids::UpdateKernel::SCALAR;
+  }
+
+  std::cout << "Update kernel : " << kboids::kernel_name(kernel) << "\n";
+  if (kernel == kboids::UpdateKernel::PREFETCH)
+    std::cout << "Prefetch distance : " << params.prefetchDistance << " boids\n";
+  std::cout << "Shuffle mode  : " << kboids::shuffle_mode_name(params.shuffleMode) << "\n";
+
+  std::cout << "Precision policy : " << BoidsData::Precision::name << "\n";
+
   // create a BoidsData object
   BoidsData boidsData(nBoids);
 
   // init friends and ennemies
-  MyRandomPool myRandPool(seed);
+  MyRandom myRand(params.seed);
+
+  initPositions(boidsData, myRand);
 
-  initPositions(boidsData, myRandPool.pool);
-  shuffleFriendsAndEnnemies(boidsData, myRandPool.pool, 1.0);
+  // sort before drawing initial friends/ennemies, so that a bounded window is
+  // also spatially local
+  if (resortPeriod > 0)
+    sortAlongMortonCurve(boidsData);
+
+  shuffleFriendsAndEnnemies(boidsData, myRand, 1.0, window, params.shuffleMode);
 
   // 2d array for display
   PngData data("render_image", 768, 768, 4);
 
   Timer timer;
 
-  for(int iTime=0; iTime<nIter; ++iTime)
+  if (nPersistentSteps > 1)
+  {
+    std::cout << "Persistent mode : " << nPersistentSteps << " time steps per parallel region\n";
+
+    uint32_t nSteps = 0;
+
+    for(uint32_t iTime=0; iTime<nIter; iTime+=nSteps)
+    {
+      nSteps = std::min(nPersistentSteps, nIter-iTime);
+
+      // a parallel region never spans a re-sort
+      if (resortPeriod > 0)
+        nSteps = std::min(nSteps, resortPeriod - iTime % resortPeriod);
+
+      timer.start();
+      if (resortPeriod > 0 and iTime % resortPeriod == 0)
+        sortAlongMortonCurve(boidsData);
+      updatePositionsPersistent(boidsData, myRand, iTime, nSteps, 20, 0.1, window,
+                                params.shuffleMode);
+      timer.stop();
+
+      // should we dump data to file ?
+      if (dump_data)
+      {
+        std::cout << "Save data at time step : " << iTime+nSteps-1 << "\n";
+        renderPositions(data, boidsData);
+        savePositions("boids",iTime+nSteps-1,data);
+      }
+
+    } // end for iTime
+  }
+  else
   {
+    for(int iTime=0; iTime<nIter; ++iTime)
+    {
 
-    timer.start();
+      timer.start();
+
+      if (resortPeriod > 0 and iTime % resortPeriod == 0)
+        sortAlongMortonCurve(boidsData);
 
 #ifdef _OPENMP
 #pragma omp parallel
 #endif
-    {
-      LIKWID_MARKER_START("updatePositions");
-    }
-
-    updatePositions(boidsData);
+      {
+        LIKWID_MARKER_START("updatePositions");
+      }
+
+      // on shuffle steps, fuse update and shuffle in a single sweep
+      const bool shuffleStep = (iTime % 20 == 0);
+      const bool fused = shuffleStep and params.fuseShuffle and
+        kernel == kboids::UpdateKernel::SCALAR;
+
+      if (fused)
+        updatePositionsAndShuffle(boidsData, myRand, 0.1, window, params.shuffleMode);
+      else if (kernel == kboids::UpdateKernel::SIMD)
+        updatePositionsSimd(boidsData);
+      else if (kernel == kboids::UpdateKernel::PREFETCH)
+        updatePositionsPrefetch(boidsData, params.prefetchDistance);
+      else
+        updatePositions(boidsData);
 
 #ifdef _OPENMP
 #pragma omp parallel
 #endif
-    {
-      LIKWID_MARKER_STOP("updatePositions");
-    }
+      {
+        LIKWID_MARKER_STOP("updatePositions");
+      }
 
-    if (iTime % 20 == 0)
-      shuffleFriendsAndEnnemies(boidsData, myRandPool.pool, 0.1);
-    timer.stop();
+      if (shuffleStep and not fused)
+        shuffleFriendsAndEnnemies(boidsData, myRand, 0.1, window, params.shuffleMode);
+      timer.stop();
 
-    // should we dump data to file ?
-    if (dump_data and (iTime % 1 == 0))
-    {
-      std::cout << "Save data at time step : " << iTime << "\n";
-      renderPositions(data, boidsData);
-      savePositions("boids",iTime,data);
-    }
+      // should we dump data to file ?
+      if (dump_data and (iTime % 1 == 0))
+      {
+        std::cout << "Save data at time step : " << iTime << "\n";
+        renderPositions(data, boidsData);
+        savePositions("boids",iTime,data);
+      }
 
-  } // end for iTimer
+    } // end for iTimer
+  }
 
   // report time spent in computations
   auto time_seconds = timer.elapsed();
   std::cout << "Total time : " << time_seconds << " seconds\n";
-  std::cout << "Throughput : " << (nBoids*nIter)/time_seconds/1e6 << " MBoids-updates/s \n";
+  std::cout << "Throughput (" << kboids::kernel_name(kernel) << " kernel) : "
+            << (nBoids*nIter)/time_seconds/1e6 << " MBoids-updates/s \n";
+
+  reportGatherDistance(boidsData);
 
 } // run_boids_flight
 
+// =====================================================================================
+// =====================================================================================
+void run_shuffle_benchmark(const RunParams& params)
+{
+
+  const auto nBoids = params.nBoids;
+  const auto nIter  = params.nIter;
+
+  BoidsData boidsData(nBoids);
+
+  MyRandom myRand(params.seed);
+
+  initPositions(boidsData, myRand);
+  shuffleFriendsAndEnnemies(boidsData, myRand, 1.0, params.window);
+
+  BoidsData::VecInt friends_old("friends_old", nBoids);
+
+  const float rates[] = {0.001, 0.003, 0.01, 0.03, 0.1, 0.3, 1.0};
+
+  const kboids::ShuffleMode modes[] = {kboids::ShuffleMode::DENSE, kboids::ShuffleMode::SPARSE};
+
+  std::cout << "Shuffle benchmark (" << nBoids << " boids, " << nIter << " shuffles per rate) :\n";
+  std::cout << "    rate    mode   time per shuffle (ms)   MBoids/s   refreshed (%)\n";
+
+  for (auto rate : rates)
+  {
+    for (auto mode : modes)
+    {
+      Timer timer;
+
+      for (uint32_t iTime=0; iTime<nIter; ++iTime)
+      {
+        timer.start();
+        shuffleFriendsAndEnnemies(boidsData, myRand, rate, params.window, mode);
+        Kokkos::fence();
+        timer.stop();
+      }
+
+      // fraction of refreshed boids (friend index actually changed) in one more shuffle
+      Kokkos::deep_copy(friends_old, boidsData.friends);
+      shuffleFriendsAndEnnemies(boidsData, myRand, rate, params.window, mode);
+
+      int nChanged = 0;
+      Kokkos::parallel_reduce("count refreshed", nBoids,
+        KOKKOS_LAMBDA(const int& index, int& count)
+        {
+          if (boidsData.friends(index) != friends_old(index))
+            ++count;
+        }, nChanged);
+
+      const double time_seconds = timer.elapsed();
+
+      std::cout << std::setw(8) << rate
+                << std::setw(8) << kboids::shuffle_mode_name(mode)
+                << std::setw(24) << 1000*time_seconds/nIter
+                << std::setw(11) << (double(nBoids)*nIter)/time_seconds/1e6
+                << std::setw(16) << 100.0*nChanged/nBoids << "\n";
+    }
+  }
+
+} // run_shuffle_benchmark
+
+// =====================================================================================
+// =====================================================================================
+void run_prefetch_benchmark(const RunParams& params)
+{
+
+  const auto nBoids = params.nBoids;
+  const auto nIter  = params.nIter;
+
+  BoidsData boidsData(nBoids);
+
+  MyRandom myRand(params.seed);
+
+  initPositions(boidsData, myRand);
+  shuffleFriendsAndEnnemies(boidsData, myRand, 1.0, params.window);
+
+  const int nThreads = Kokkos::DefaultExecutionSpace().concurrency();
+
+  // latency of a random load in a buffer as large as positions
+  const size_t bytes = 2 * sizeof(BoidsData::real_t) * size_t(nBoids);
+  const double latency_ns = kboids::measure_load_latency(bytes, params.seed);
+
+  std::cout << "Prefetch benchmark (" << nBoids << " boids, " << nIter << " time steps per distance, "
+            << nThreads << " threads) :\n";
+  std::cout << "Dependent load latency (" << bytes/1e6 << " MB buffer) : " << latency_ns << " ns\n";
+  std::cout << "    kernel  distance   time per step (ms)   MBoids/s   Mgathers/s   loads in flight per thread\n";
+
+  // distance < 0 is the scalar kernel
+  const int distances[] = {-1, 0, 1, 2, 4, 8, 16, 32, 64, 128};
+
+  for (auto distance : distances)
+  {
+    Timer timer;
+
+    for (uint32_t iTime=0; iTime<nIter; ++iTime)
+    {
+      timer.start();
+      if (distance < 0)
+        updatePositions(boidsData);
+      else
+        updatePositionsPrefetch(boidsData, distance);
+      Kokkos::fence();
+      timer.stop();
+    }
+
+    const double time_seconds = timer.elapsed();
+
+    // 2 random gathers (friend and ennemy) per boid update; memory-level
+    // parallelism from Little's law (upper bound : some gathers hit in cache)
+    const double gathers_per_second = 2.0*nBoids*nIter/time_seconds;
+    const double mlp = gathers_per_second * latency_ns * 1e-9 / nThreads;
+
+    std::cout << std::setw(10) << ((distance < 0) ? "scalar" : "prefetch")
+              << std::setw(10) << ((distance < 0) ? std::string("-") : std::to_string(distance))
+              << std::setw(21) << 1000*time_seconds/nIter
+              << std::setw(11) << (double(nBoids)*nIter)/time_seconds/1e6
+              << std::setw(13) << gathers_per_second/1e6
+              << std::setw(29) << mlp << "\n";
+  }
+
+} // run_prefetch_benchmark
+
 #ifdef FORGE_ENABLED
 // =====================================================================================
 // =====================================================================================
@@ -88,10 +310,10 @@ void run_boids_flight_gui(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool d
   BoidsData boidsData(nBoids);
 
   // init friends and ennemies
-  MyRandomPool myRandPool(seed);
+  MyRandom myRand(seed);
 
-  initPositions(boidsData, myRandPool.pool);
-  shuffleFriendsAndEnnemies(boidsData, myRandPool.pool, 1.0);
+  initPositions(boidsData, myRand);
+  shuffleFriendsAndEnnemies(boidsData, myRand, 1.0);
 
   // Forge init
   const int DIMX=800;
@@ -118,9 +340,9 @@ void run_boids_flight_gui(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool d
     copyPositionsForRendering(boidsData);
 
     if (iTime % 20 == 0)
-      shuffleFriendsAndEnnemies(boidsData, myRandPool.pool, 0.1);
+      shuffleFriendsAndEnnemies(boidsData, myRand, 0.1);
 
-    copyToGLBuffer(handles, (ComputeResourceHandle)boidsData.xy.data(),
+    copyToGLBuffer(handles, (ComputeResourceHandle)boidsData.renderData(),
                    boidsXY.verticesSize());
     wnd.draw(chart);
 
@@ -1,6 +1,63 @@
 #pragma once
 
-void run_boids_flight(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool dump_data);
+#include <cstdint>
+
+#include "utils/kernel-type.h"
+#include "utils/prefetch-utils.h"
+
+// ===================================================
+// ===================================================
+//! run parameters (as read from the command line)
+struct RunParams
+{
+  //! number of boids
+  uint32_t nBoids = 1000;
+
+  //! number of time steps
+  uint32_t nIter = 100;
+
+  //! random seed
+  uint64_t seed = 42;
+
+  //! dump data to PNG files
+  bool dump_data = false;
+
+  //! number of time steps performed inside a single parallel region
+  uint32_t nPersistentSteps = 1;
+
+  //! if > 0, friends and ennemies are drawn within this index distance
+  int window = 0;
+
+  //! if > 0, re-sort the flock along a Morton curve every resortPeriod time steps
+  uint32_t resortPeriod = 0;
+
+  //! updatePositions kernel variant
+  kboids::UpdateKernel kernel = kboids::UpdateKernel::SCALAR;
+
+  //! friends/ennemies shuffle algorithm
+  kboids::ShuffleMode shuffleMode = kboids::ShuffleMode::AUTO;
+
+  //! run the shuffle benchmark instead of a regular run
+  bool shuffle_benchmark = false;
+
+  //! fuse position update and shuffle on shuffle steps (scalar kernel only)
+  bool fuseShuffle = true;
+
+  //! prefetch distance (in boids) of the prefetch kernel
+  int prefetchDistance = kboids::PREFETCH_DEFAULT_DISTANCE;
+
+  //! run the prefetch benchmark instead of a regular run
+  bool prefetch_benchmark = false;
+
+}; // struct RunParams
+
+void run_boids_flight(const RunParams& params);
+
+//! time dense and sparse shuffles over a range of rates
+void run_shuffle_benchmark(const RunParams& params);
+
+//! time scalar and prefetch kernels over a range of prefetch distances
+void run_prefetch_benchmark(const RunParams& params);
 
 #ifdef FORGE_ENABLED
 void run_boids_flight_gui(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool dump_data);
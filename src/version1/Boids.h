@@ -4,7 +4,18 @@
 
 // Include Kokkos Headers
 #include<Kokkos_Core.hpp>
-#include<Kokkos_Random.hpp>
+
+#include <iostream>
+#include <type_traits>
+
+#include "utils/kernel-type.h"
+#include "utils/morton-utils.h"
+#include "utils/position-layout.h"
+#include "utils/precision-policy.h"
+#include "utils/prefetch-utils.h"
+#include "utils/random-utils.h"
+#include "utils/simd-utils.h"
+#include "utils/sort-utils.h"
 
 // ===================================================
 // ===================================================
@@ -13,48 +24,42 @@ double SQR(const double& v) {return v*v;}
 
 // ===================================================
 // ===================================================
+/**
+ * Unit vector from (x1,y1) to (x2,y2), or (0,0) when both points are closer than 1e-6.
+ *
+ * Branch free : one reciprocal square root and a select (no test around divisions).
+ */
+template <typename T>
 KOKKOS_INLINE_FUNCTION
-void compute_direction(const float& x1, const float& y1,
-                       const float& x2, const float& y2,
-                       float& x, float& y)
+void compute_direction(T x1, T y1,
+                       T x2, T y2,
+                       T& x, T& y)
 {
-  double norm = sqrt( (x2-x1)*(x2-x1) +
-                      (y2-y1)*(y2-y1) );
-  if (norm < 1e-6)
-  {
-    x = 0;
-    y = 0;
-  }
-  else
-  {
-    x = (x2-x1)/norm;
-    y = (y2-y1)/norm;
-  }
+  const T ddx = x2-x1;
+  const T ddy = y2-y1;
+  const T norm2 = ddx*ddx + ddy*ddy;
+
+  // norm < 1e-6 <=> norm2 < 1e-12
+  const T inv_norm = (norm2 < T(1e-12)) ? T(0) : kboids::rsqrt(norm2);
+
+  x = ddx*inv_norm;
+  y = ddy*inv_norm;
 }
 
 // ===================================================
 // ===================================================
-template<typename ExecutionSpace>
-class MyRandomPool
+/**
+ * Reflect index i inside [0,n-1] (assuming -n < i < 2n-1).
+ */
+KOKKOS_INLINE_FUNCTION
+int reflect_index(int i, int n)
 {
-
-public:
-
-  // define an alias to the random generator pool
-  using RGPool_t = Kokkos::Random_XorShift64_Pool<ExecutionSpace>;
-
-  // type for hold the random generator state
-  using rnd_t = typename RGPool_t::generator_type;
-
-  MyRandomPool(uint64_t seed)
-    : pool(seed)
-  {
-
-  }
-
-  RGPool_t pool;
-
-}; // MyRandomPool
+  if (i < 0)
+    i = -i;
+  if (i >= n)
+    i = 2*(n-1) - i;
+  return i;
+}
 
 
 //! type alias for creating image on host
@@ -62,42 +67,60 @@ using PngData = Kokkos::View<unsigned char***, Kokkos::LayoutRight, Kokkos::Seri
 
 // ===================================================
 // ===================================================
-template <typename DeviceType>
+/**
+ * Boids data and kernels.
+ *
+ * \tparam DeviceType is a Kokkos device (execution space + memory space)
+ * \tparam Precision is a precision policy (see utils/precision-policy.h)
+ */
+template <typename DeviceType, typename Precision = kboids::DefaultPrecision>
 class BoidsData
 {
 
+  //! BoidsData with another precision policy can access our data (see copyStateFrom)
+  template <typename, typename> friend class BoidsData;
+
 public:
 
+  using precision = Precision;
+  using real_t    = typename Precision::storage_t;
+  using value_t   = typename Precision::value_t;
+  using compute_t = typename Precision::compute_t;
+
   using device            = DeviceType;
   using execution_space   = typename DeviceType::execution_space;
   using memory_space      = typename DeviceType::memory_space;
 
-  using myrandom_pool = MyRandomPool<execution_space>;
-  using RGPool_t      = typename myrandom_pool::RGPool_t;
-
   using VecInt   = Kokkos::View<int*,   memory_space>;
   using VecFloat = Kokkos::View<float*, memory_space>;
-  using VecFloatMirror = typename VecFloat::HostMirror;
+
+  //! positions storage (layout chosen at compile time, see utils/position-layout.h)
+  using VecPos   = kboids::PositionView<memory_space, real_t>;
+  using VecCoord = kboids::CoordView<VecPos>;
+
+  using VecPosMirror   = typename VecPos::HostMirror;
+  using VecCoordMirror = kboids::CoordView<VecPosMirror>;
 
   //! \param[in] nBoids is the number of boids
   //! \param[in] seed is the random number generator seed
   BoidsData(int nBoids, uint64_t seed)
     : m_nBoids(nBoids),
-      m_rand_pool(seed),
-      m_x("x",nBoids),
-      m_y("y",nBoids),
-      m_x_new("x_new",nBoids),
-      m_y_new("y_new",nBoids),
+      m_rng(seed),
+      m_stream(0),
+      m_pos("pos",nBoids),
+      m_pos_new("pos_new",nBoids),
       m_friends("friends",nBoids),
       m_ennemies("ennemies",nBoids),
-      m_x_host(),
-      m_y_host()
+      m_pos_host()
 #ifdef FORGE_ENABLED
-      ,m_xy("xy",2*nBoids)
+      ,m_xy("xy",direct_rendering ? 0 : 2*nBoids)
 #endif
   {
-    m_x_host = Kokkos::create_mirror(m_x);
-    m_y_host = Kokkos::create_mirror(m_y);
+    setCoordinates();
+
+    m_pos_host = Kokkos::create_mirror(m_pos);
+    m_x_host = kboids::coordinate(m_pos_host, 0);
+    m_y_host = kboids::coordinate(m_pos_host, 1);
   }
 
   /**
@@ -114,32 +137,218 @@ public:
    * from it.
    *
    * \param[in] rate is ratio (in [0,1]) : we randomly chose particles and refresh their friend and ennemy mate index.
+   *
+   * \param[in] window if > 0, new friend and ennemy index are drawn in [index-window,index+window]
+   * instead of the whole flock.
+   *
+   * \param[in] mode selects the dense (draw for every boid) or sparse (only visit selected
+   * boids, O(rate.nBoids)) algorithm.
    */
-  void shuffleFriendsAndEnnemies(execution_space const &exec_space, float rate);
+  void shuffleFriendsAndEnnemies(execution_space const &exec_space, float rate, int window = 0,
+                                 kboids::ShuffleMode mode = kboids::ShuffleMode::AUTO);
+
+  /**
+   * Re-order boids along a Morton curve (computed over flock bounding box),
+   * friends and ennemies index are remapped accordingly.
+   *
+   * Combined with a bounded friend/ennemy window, this makes the friend/ennemy
+   * gathers in updatePositions mostly cache local.
+   */
+  void sortAlongMortonCurve(execution_space const &exec_space);
+
+  //! print the distribution of |index - friend| and |index - ennemy| (log2 bins)
+  void reportGatherDistance(execution_space const &exec_space);
+
+  //! copy positions (converted to our storage type), friends and ennemies from other
+  template <typename OtherPrecision>
+  void copyStateFrom(execution_space const &exec_space,
+                     const BoidsData<DeviceType, OtherPrecision>& other);
+
+  //! copy friends and ennemies from other
+  template <typename OtherPrecision>
+  void copyFriendsAndEnnemiesFrom(const BoidsData<DeviceType, OtherPrecision>& other);
+
+  /**
+   * Distance between our positions and positions of other (usually a reference
+   * computed in double precision).
+   *
+   * \return maximum and root mean square of distances
+   */
+  template <typename OtherPrecision>
+  Kokkos::pair<double,double> positionDeviation(execution_space const &exec_space,
+                                                const BoidsData<DeviceType, OtherPrecision>& other);
 
   /**
    * update boids positions (one time step).
    */
   void updatePositions(execution_space const &exec_space);
 
+  /**
+   * Update positions (one time step), then shuffle friends and ennemies.
+   *
+   * Same result as updatePositions followed by shuffleFriendsAndEnnemies, but when
+   * the shuffle is dense, both are fused into a single sweep : each boid reads its
+   * friend/ennemy index once, moves, then gets its new friend/ennemy (same random
+   * stream as the separate shuffle).
+   *
+   * A sparse shuffle only touches O(rate.nBoids) entries, it is not fused.
+   */
+  void updatePositionsAndShuffle(execution_space const &exec_space, float rate, int window = 0,
+                                 kboids::ShuffleMode mode = kboids::ShuffleMode::AUTO);
+
+  /**
+   * Same as updatePositions, explicitly vectorized : each iteration updates a SIMD
+   * vector of boids (friend/ennemy positions are gathered into aligned buffers).
+   *
+   * Requires simd-math (cmake option USE_SIMD_MATH) and a host execution space,
+   * otherwise this is just updatePositions.
+   */
+  void updatePositionsSimd(execution_space const &exec_space);
+
+  /**
+   * Same as updatePositions, gather pipelined : boids are processed by batches, and
+   * partner positions of boid index+distance are prefetched while boid index is
+   * computed, so that up to distance random reads are in flight per thread.
+   *
+   * Results are bit-identical to updatePositions. On device execution spaces,
+   * this is just updatePositions.
+   */
+  void updatePositionsPrefetch(execution_space const &exec_space,
+                               int distance = kboids::PREFETCH_DEFAULT_DISTANCE);
+
   //! render positions to PNG image
   void renderPositions(PngData data);
 
   //! copy data for OpenGL rendering
   void copyPositionsForOpenGLRendering(execution_space const &exec_space);
 
+#ifdef FORGE_ENABLED
+  //! can positions storage be directly used as an OpenGL vertex buffer ?
+  static constexpr bool direct_rendering =
+    kboids::interleaved_positions and std::is_same<real_t, float>::value;
+
+  //! pointer to interleaved {x,y} float data for OpenGL rendering
+  float* renderData()
+  {
+    return direct_rendering ? reinterpret_cast<float*>(m_pos.data()) : m_xy.data();
+  }
+#endif
+
+  //! vector of friend index
+  const VecInt& friends() const { return m_friends; }
+
 private:
+  //! number of boids per block in the sparse shuffle
+  static constexpr int SPARSE_SHUFFLE_BLOCK_SIZE = 1024;
+
+  //! draw new friend and ennemy of boid index from random words r[1] and r[2]
+  KOKKOS_INLINE_FUNCTION
+  void drawFriendAndEnnemy(const kboids::RandomWords& r, int window, int index) const
+  {
+    if (window > 0)
+    {
+      // spatially local mode : draw in a bounded index window
+      int offset_friend = kboids::uniform_int(r[1], -window, window+1);
+      int offset_ennemy = kboids::uniform_int(r[2], -window, window+1);
+      m_friends(index)  = reflect_index(index + offset_friend, m_nBoids);
+      m_ennemies(index) = reflect_index(index + offset_ennemy, m_nBoids);
+    }
+    else
+    {
+      m_friends(index)  = kboids::uniform_int(r[1], m_nBoids);
+      m_ennemies(index) = kboids::uniform_int(r[2], m_nBoids);
+    }
+  }
+
+  //! dense shuffle of boid index : new friend and ennemy with probability rate
+  KOKKOS_INLINE_FUNCTION
+  void shuffleFriendAndEnnemy(uint64_t stream, float rate, int window, int index) const
+  {
+    const auto r = m_rng(stream, index);
+
+    if (kboids::uniform_real<float>(r[0], 0, 1) < rate)
+      drawFriendAndEnnemy(r, window, index);
+  }
+
+  //! prefetch friend and ennemy positions of boid index (host only, no-op on device)
+  KOKKOS_INLINE_FUNCTION
+  void prefetchPartners(int index) const
+  {
+    const int index_friend = m_friends(index);
+    const int index_ennemy = m_ennemies(index);
+
+    KBOIDS_PREFETCH(&m_x(index_friend));
+    KBOIDS_PREFETCH(&m_y(index_friend));
+    KBOIDS_PREFETCH(&m_x(index_ennemy));
+    KBOIDS_PREFETCH(&m_y(index_ennemy));
+  }
+
+  //! compute new position of boid index (read x,y, write x_new,y_new)
+  KOKKOS_INLINE_FUNCTION
+  void updatePosition(int index) const
+  {
+    const compute_t x = m_x(index);
+    const compute_t y = m_y(index);
+
+    auto index_friend = m_friends(index);
+    auto index_ennemy = m_ennemies(index);
+
+    // rule #1, move towards box center
+    compute_t dx = compute_t(-0.01) * x;
+    compute_t dy = compute_t(-0.01) * y;
+
+    compute_t dir_x, dir_y;
+
+    // rule #2, move towards friend
+    compute_direction<compute_t>(x,y,
+                                 m_x(index_friend),
+                                 m_y(index_friend),
+                                 dir_x, dir_y);
+    dx += compute_t(0.05) * dir_x;
+    dy += compute_t(0.05) * dir_y;
+
+    // rule #3, move away from ennemy
+    compute_direction<compute_t>(x,y,
+                                 m_x(index_ennemy),
+                                 m_y(index_ennemy),
+                                 dir_x, dir_y);
+    dx -= compute_t(0.03) * dir_x;
+    dy -= compute_t(0.03) * dir_y;
+
+    // update positions
+    m_x_new(index) = x + dx;
+    m_y_new(index) = y + dy;
+  }
+
+  //! (re)build x,y views (and x_new,y_new) on top of positions storage
+  void setCoordinates()
+  {
+    m_x     = kboids::coordinate(m_pos, 0);
+    m_y     = kboids::coordinate(m_pos, 1);
+    m_x_new = kboids::coordinate(m_pos_new, 0);
+    m_y_new = kboids::coordinate(m_pos_new, 1);
+  }
+
   //! number of boids
   int m_nBoids;
 
-  //! random number generator
-  RGPool_t m_rand_pool;
+  //! counter-based random number generator (see utils/random-utils.h)
+  kboids::CounterRNG m_rng;
+
+  //! index of the next unused random stream (one per kernel drawing random numbers)
+  uint64_t m_stream;
+
+  //! positions storage
+  VecPos m_pos;
+
+  //! temp positions storage used to compute postion update (one time step)
+  VecPos m_pos_new;
 
   //! set of boids coordinates
-  VecFloat m_x, m_y;
+  VecCoord m_x, m_y;
 
   //! temp array of boids used to compute postion update (one time step)
-  VecFloat m_x_new, m_y_new;
+  VecCoord m_x_new, m_y_new;
 
   //! vector of friend index
   VecInt m_friends;
@@ -148,11 +357,15 @@ private:
   VecInt m_ennemies;
 
 public:
+  //! mirror of positions on host (for image rendering only)
+  VecPosMirror m_pos_host;
+
   //! mirror of x,y data on host (for image rendering only)
-  VecFloatMirror m_x_host;
-  VecFloatMirror m_y_host;
+  VecCoordMirror m_x_host;
+  VecCoordMirror m_y_host;
 
 #ifdef FORGE_ENABLED
+  //! interleaved positions for OpenGL rendering (not allocated when direct_rendering)
   VecFloat m_xy;
 #endif
 
@@ -160,110 +373,495 @@ public:
 
 // ===================================================
 // ===================================================
-template<typename DeviceType>
-void BoidsData<DeviceType>::initPositions()
+template<typename DeviceType, typename Precision>
+void BoidsData<DeviceType, Precision>::initPositions()
 {
 
-  Kokkos::fill_random(m_x, m_rand_pool, -1.0, 1.0);
-  Kokkos::fill_random(m_y, m_rand_pool, -1.0, 1.0);
+  auto policy = Kokkos::RangePolicy<execution_space>(0, m_nBoids);
+
+  const uint64_t stream = m_stream++;
+
+  Kokkos::parallel_for("initPositions", policy, KOKKOS_CLASS_LAMBDA(const int& index)
+  {
+    const auto r = m_rng(stream, index);
+
+    m_x(index) = kboids::uniform_real<value_t>(r[0], -1.0, 1.0);
+    m_y(index) = kboids::uniform_real<value_t>(r[1], -1.0, 1.0);
+  });
 
 }
 
 // ===================================================
 // ===================================================
-template<typename DeviceType>
-void BoidsData<DeviceType>::shuffleFriendsAndEnnemies(execution_space const &exec_space, float rate)
+template<typename DeviceType, typename Precision>
+void BoidsData<DeviceType, Precision>::shuffleFriendsAndEnnemies(execution_space const &exec_space, float rate, int window,
+                                                                 kboids::ShuffleMode mode)
 {
 
   // rate should be in range [0,1]
   rate = (rate < 0) ? 0 : rate;
   rate = (rate > 1) ? 1 : rate;
 
-  using rnd_t = typename myrandom_pool::rnd_t;
+  // window should be in range [0,nBoids-1]
+  window = (window < 0) ? 0 : window;
+  window = (window > m_nBoids-1) ? m_nBoids-1 : window;
+
+  const uint64_t stream = m_stream++;
+
+  if (kboids::use_sparse_shuffle(mode, rate))
+  {
+    if (rate <= 0)
+      return;
+
+    // sparse algorithm : jump from one selected boid to the next one with
+    // geometric skips, each boid is still selected with probability rate.
+    // Random words of selected boid index are rng(stream,index) : r[1], r[2] give
+    // friend and ennemy, r[3] the skip to the next selected boid. The first skip
+    // of a block uses rng(stream, nBoids+iBlock).
+    const double log1m_rate = log1p(-rate);
+    const int nBlocks = (m_nBoids + SPARSE_SHUFFLE_BLOCK_SIZE - 1) / SPARSE_SHUFFLE_BLOCK_SIZE;
+
+    auto policy = Kokkos::RangePolicy<execution_space>(exec_space, 0, nBlocks);
+
+    Kokkos::parallel_for("shuffleFriendsAndEnnemiesSparse", policy, KOKKOS_CLASS_LAMBDA(const int& iBlock)
+    {
+      const int first = iBlock * SPARSE_SHUFFLE_BLOCK_SIZE;
+      const int last  = (first + SPARSE_SHUFFLE_BLOCK_SIZE < m_nBoids) ?
+        first + SPARSE_SHUFFLE_BLOCK_SIZE : m_nBoids;
+
+      int index = first +
+        kboids::geometric_skip(m_rng(stream, m_nBoids + iBlock)[0], log1m_rate, SPARSE_SHUFFLE_BLOCK_SIZE);
+
+      while (index < last)
+      {
+        const auto r = m_rng(stream, index);
+
+        drawFriendAndEnnemy(r, window, index);
+
+        index += 1 + kboids::geometric_skip(r[3], log1m_rate, SPARSE_SHUFFLE_BLOCK_SIZE);
+      }
+    });
+  }
+  else
+  {
+    auto policy = Kokkos::RangePolicy<execution_space>(exec_space, 0, m_nBoids);
+
+    Kokkos::parallel_for("shuffleFriendsAndEnnemies", policy, KOKKOS_CLASS_LAMBDA(const int& index)
+    {
+      shuffleFriendAndEnnemy(stream, rate, window, index);
+    });
+  }
+
+} // BoidsData<DeviceType, Precision>::shuffleFriendsAndEnnemies
+
+// ===================================================
+// ===================================================
+template<typename DeviceType, typename Precision>
+void BoidsData<DeviceType, Precision>::sortAlongMortonCurve(execution_space const &exec_space)
+{
 
   auto policy = Kokkos::RangePolicy<execution_space>(exec_space, 0, m_nBoids);
 
-  Kokkos::parallel_for("shuffleFriendsAndEnnemies", policy, KOKKOS_CLASS_LAMBDA(const int& index)
+  // flock bounding box
+  Kokkos::MinMaxScalar<value_t> xrange, yrange;
+
+  Kokkos::parallel_reduce("sortAlongMortonCurve x range", policy,
+    KOKKOS_CLASS_LAMBDA(const int& index, Kokkos::MinMaxScalar<value_t>& range)
+    {
+      const value_t x = m_x(index);
+      if (x < range.min_val) range.min_val = x;
+      if (x > range.max_val) range.max_val = x;
+    }, Kokkos::MinMax<value_t>(xrange));
+
+  Kokkos::parallel_reduce("sortAlongMortonCurve y range", policy,
+    KOKKOS_CLASS_LAMBDA(const int& index, Kokkos::MinMaxScalar<value_t>& range)
+    {
+      const value_t y = m_y(index);
+      if (y < range.min_val) range.min_val = y;
+      if (y > range.max_val) range.max_val = y;
+    }, Kokkos::MinMax<value_t>(yrange));
+
+  // compute morton keys
+  VecInt keys("morton keys", m_nBoids);
+
+  Kokkos::parallel_for("sortAlongMortonCurve keys", policy, KOKKOS_CLASS_LAMBDA(const int& index)
+  {
+    keys(index) = kboids::morton_key(m_x(index), m_y(index),
+                                     xrange.min_val, xrange.max_val,
+                                     yrange.min_val, yrange.max_val);
+  });
+
+  auto permutation = kboids::sort(keys);
+
+  // re-order positions (m_pos_new is only used as temporary here)
+  kboids::apply_permutation(m_pos, m_pos_new, permutation);
+  setCoordinates();
+
+  // remap friends and ennemies : old index permutation(i) is now i
+  auto inverse = keys;
+  Kokkos::parallel_for("sortAlongMortonCurve inverse", policy, KOKKOS_LAMBDA(const int& index)
+  {
+    inverse(permutation(index)) = index;
+  });
+
+  VecInt tmp("tmp", m_nBoids);
+
+  Kokkos::parallel_for("sortAlongMortonCurve friends", policy, KOKKOS_CLASS_LAMBDA(const int& index)
+  {
+    tmp(index) = inverse(m_friends(permutation(index)));
+  });
+  std::swap(m_friends, tmp);
+
+  Kokkos::parallel_for("sortAlongMortonCurve ennemies", policy, KOKKOS_CLASS_LAMBDA(const int& index)
   {
-    rnd_t rand_gen = m_rand_pool.get_state();
+    tmp(index) = inverse(m_ennemies(permutation(index)));
+  });
+  std::swap(m_ennemies, tmp);
+
+} // BoidsData<DeviceType, Precision>::sortAlongMortonCurve
+
+// ===================================================
+// ===================================================
+template<typename DeviceType, typename Precision>
+void BoidsData<DeviceType, Precision>::reportGatherDistance(execution_space const &exec_space)
+{
+
+  // bin 0 is distance 0, bin k>0 is distance in [2^(k-1), 2^k)
+  constexpr int nBins = 33;
+
+  VecInt histo("gather distance histogram", nBins);
+  Kokkos::View<int*, memory_space, Kokkos::MemoryTraits<Kokkos::Atomic>> histo_atomic = histo;
 
-    float r = Kokkos::rand<rnd_t,float>::draw(rand_gen, 0, 1);
+  auto policy = Kokkos::RangePolicy<execution_space>(exec_space, 0, m_nBoids);
+
+  Kokkos::parallel_for("reportGatherDistance", policy, KOKKOS_CLASS_LAMBDA(const int& index)
+  {
+    int partners[2] = {m_friends(index), m_ennemies(index)};
 
-    // shuffle friends and ennemies
-    if (r < rate)
+    for (int k=0; k<2; ++k)
     {
-      m_friends(index)  = Kokkos::rand<rnd_t,int>::draw(rand_gen, m_nBoids);
-      m_ennemies(index) = Kokkos::rand<rnd_t,int>::draw(rand_gen, m_nBoids);
+      unsigned int d = (partners[k] > index) ? partners[k]-index : index-partners[k];
+      int bin = 0;
+      while (d > 0)
+      {
+        d >>= 1;
+        ++bin;
+      }
+      histo_atomic(bin) += 1;
     }
+  });
 
-    // free random gen state, so that it can used by other threads later.
-    m_rand_pool.free_state(rand_gen);
+  auto histo_host = Kokkos::create_mirror_view(histo);
+  Kokkos::deep_copy(histo_host, histo);
 
+  const double nGathers = 2.0*m_nBoids;
+  double cumul = 0;
+
+  std::cout << "Gather distance |index - partner| (friends and ennemies) :\n";
+  for (int bin=0; bin<nBins; ++bin)
+  {
+    if (histo_host(bin) == 0)
+      continue;
+
+    long lo = (bin == 0) ? 0 : (1l << (bin-1));
+    long hi = (bin == 0) ? 1 : (1l << bin);
+    cumul += histo_host(bin);
+
+    std::cout << "  [" << lo << ", " << hi << ") : "
+              << 100.0*histo_host(bin)/nGathers << " % (cumulated "
+              << 100.0*cumul/nGathers << " %)\n";
+  }
+
+} // BoidsData<DeviceType, Precision>::reportGatherDistance
+
+// ===================================================
+// ===================================================
+template<typename DeviceType, typename Precision>
+template<typename OtherPrecision>
+void BoidsData<DeviceType, Precision>::copyStateFrom(execution_space const &exec_space,
+                                                     const BoidsData<DeviceType, OtherPrecision>& other)
+{
+
+  auto policy = Kokkos::RangePolicy<execution_space>(exec_space, 0, m_nBoids);
+
+  auto other_x = other.m_x;
+  auto other_y = other.m_y;
+
+  Kokkos::parallel_for("copyStateFrom", policy, KOKKOS_CLASS_LAMBDA(const int& index)
+  {
+    // go through double : 16-bit storage types only convert from/to float
+    m_x(index) = static_cast<real_t>(static_cast<double>(other_x(index)));
+    m_y(index) = static_cast<real_t>(static_cast<double>(other_y(index)));
   });
 
-} // BoidsData<DeviceType>::shuffleFriendsAndEnnemies
+  copyFriendsAndEnnemiesFrom(other);
+
+} // BoidsData<DeviceType, Precision>::copyStateFrom
 
 // ===================================================
 // ===================================================
-template<typename DeviceType>
-void BoidsData<DeviceType>::updatePositions(execution_space const &exec_space)
+template<typename DeviceType, typename Precision>
+template<typename OtherPrecision>
+void BoidsData<DeviceType, Precision>::copyFriendsAndEnnemiesFrom(const BoidsData<DeviceType, OtherPrecision>& other)
+{
+
+  Kokkos::deep_copy(m_friends, other.m_friends);
+  Kokkos::deep_copy(m_ennemies, other.m_ennemies);
+
+} // BoidsData<DeviceType, Precision>::copyFriendsAndEnnemiesFrom
+
+// ===================================================
+// ===================================================
+template<typename DeviceType, typename Precision>
+template<typename OtherPrecision>
+Kokkos::pair<double,double>
+BoidsData<DeviceType, Precision>::positionDeviation(execution_space const &exec_space,
+                                                    const BoidsData<DeviceType, OtherPrecision>& other)
+{
+
+  auto policy = Kokkos::RangePolicy<execution_space>(exec_space, 0, m_nBoids);
+
+  auto other_x = other.m_x;
+  auto other_y = other.m_y;
+
+  double max_dist2 = 0;
+  double sum_dist2 = 0;
+
+  Kokkos::parallel_reduce("positionDeviation max", policy,
+    KOKKOS_CLASS_LAMBDA(const int& index, double& local_max)
+    {
+      const double ddx = static_cast<double>(m_x(index)) - static_cast<double>(other_x(index));
+      const double ddy = static_cast<double>(m_y(index)) - static_cast<double>(other_y(index));
+      const double dist2 = ddx*ddx + ddy*ddy;
+      if (dist2 > local_max) local_max = dist2;
+    }, Kokkos::Max<double>(max_dist2));
+
+  Kokkos::parallel_reduce("positionDeviation sum", policy,
+    KOKKOS_CLASS_LAMBDA(const int& index, double& local_sum)
+    {
+      const double ddx = static_cast<double>(m_x(index)) - static_cast<double>(other_x(index));
+      const double ddy = static_cast<double>(m_y(index)) - static_cast<double>(other_y(index));
+      local_sum += ddx*ddx + ddy*ddy;
+    }, sum_dist2);
+
+  return Kokkos::pair<double,double>(sqrt(max_dist2), sqrt(sum_dist2/m_nBoids));
+
+} // BoidsData<DeviceType, Precision>::positionDeviation
+
+// ===================================================
+// ===================================================
+template<typename DeviceType, typename Precision>
+void BoidsData<DeviceType, Precision>::updatePositions(execution_space const &exec_space)
 {
 
   auto policy = Kokkos::RangePolicy<execution_space>(exec_space, 0, m_nBoids);
 
   Kokkos::parallel_for("updatePositions", policy, KOKKOS_CLASS_LAMBDA(const int& index)
   {
-    auto x = m_x(index);
-    auto y = m_y(index);
+    updatePosition(index);
+  });
 
-    auto index_friend = m_friends(index);
-    auto index_ennemy = m_ennemies(index);
+  // swap old and new data
+  std::swap(m_pos, m_pos_new);
+  setCoordinates();
 
-    // rule #1, move towards box center
-    double dx = -0.01 * x;
-    double dy = -0.01 * y;
+} // BoidsData<DeviceType, Precision>::updatePositions
 
-    float dir_x, dir_y;
+// ===================================================
+// ===================================================
+template<typename DeviceType, typename Precision>
+void BoidsData<DeviceType, Precision>::updatePositionsAndShuffle(execution_space const &exec_space,
+                                                                 float rate, int window,
+                                                                 kboids::ShuffleMode mode)
+{
 
-    // rule #2, move towards friend
-    compute_direction(x,y,
-                      m_x(index_friend),
-                      m_y(index_friend),
-                      dir_x, dir_y);
-    dx += 0.05 * dir_x;
-    dy += 0.05 * dir_y;
+  if (kboids::use_sparse_shuffle(mode, rate))
+  {
+    updatePositions(exec_space);
+    shuffleFriendsAndEnnemies(exec_space, rate, window, mode);
+    return;
+  }
 
-    // rule #3, move away from ennemy
-    compute_direction(x,y,
-                      m_x(index_ennemy),
-                      m_y(index_ennemy),
-                      dir_x, dir_y);
-    dx -= 0.03 * dir_x;
-    dy -= 0.03 * dir_y;
+  // rate should be in range [0,1]
+  rate = (rate < 0) ? 0 : rate;
+  rate = (rate > 1) ? 1 : rate;
 
-    // update positions
-    m_x_new(index) = x + dx;
-    m_y_new(index) = y + dy;
+  // window should be in range [0,nBoids-1]
+  window = (window < 0) ? 0 : window;
+  window = (window > m_nBoids-1) ? m_nBoids-1 : window;
 
+  auto policy = Kokkos::RangePolicy<execution_space>(exec_space, 0, m_nBoids);
+
+  const uint64_t stream = m_stream++;
+
+  // boid index only reads and writes its own friend/ennemy index : no race
+  Kokkos::parallel_for("updatePositionsAndShuffle", policy, KOKKOS_CLASS_LAMBDA(const int& index)
+  {
+    updatePosition(index);
+    shuffleFriendAndEnnemy(stream, rate, window, index);
   });
 
   // swap old and new data
-  std::swap(m_x, m_x_new);
-  std::swap(m_y, m_y_new);
+  std::swap(m_pos, m_pos_new);
+  setCoordinates();
+
+} // BoidsData<DeviceType, Precision>::updatePositionsAndShuffle
+
+// ===================================================
+// ===================================================
+template<typename DeviceType, typename Precision>
+void BoidsData<DeviceType, Precision>::updatePositionsSimd(execution_space const &exec_space)
+{
+
+  if constexpr (not kboids::simd_enabled<execution_space>)
+  {
+    updatePositions(exec_space);
+  }
+#ifdef KBOIDS_USE_SIMD_MATH
+  else
+  {
+    using simd_t = kboids::simd_t<compute_t>;
+    using tag_t  = simd::element_aligned_tag;
+
+    constexpr int W = simd_t::size();
 
-} // BoidsData<DeviceType>::updatePositions
+    const int nBoids  = m_nBoids;
+    const int nBlocks = (nBoids + W - 1) / W;
+
+    auto policy = Kokkos::RangePolicy<execution_space>(exec_space, 0, nBlocks);
+
+    auto x        = m_x;
+    auto y        = m_y;
+    auto x_new    = m_x_new;
+    auto y_new    = m_y_new;
+    auto friends  = m_friends;
+    auto ennemies = m_ennemies;
+
+    // host only kernel : plain lambda
+    Kokkos::parallel_for("updatePositionsSimd", policy, [=](const int& iBlock)
+    {
+      const int first  = iBlock * W;
+      const int nLanes = (nBoids - first < W) ? nBoids - first : W;
+
+      // gather own, friend and ennemy positions into aligned buffers
+      // (last block is padded with its last boid)
+      alignas(64) compute_t buf[6][W];
+
+      for (int l=0; l<W; ++l)
+      {
+        const int index = first + ((l < nLanes) ? l : nLanes-1);
+        const int index_friend = friends(index);
+        const int index_ennemy = ennemies(index);
+
+        buf[0][l] = x(index);
+        buf[1][l] = y(index);
+        buf[2][l] = x(index_friend);
+        buf[3][l] = y(index_friend);
+        buf[4][l] = x(index_ennemy);
+        buf[5][l] = y(index_ennemy);
+      }
+
+      simd_t xs, ys, x_friend, y_friend, x_ennemy, y_ennemy;
+      xs.copy_from(buf[0], tag_t());
+      ys.copy_from(buf[1], tag_t());
+      x_friend.copy_from(buf[2], tag_t());
+      y_friend.copy_from(buf[3], tag_t());
+      x_ennemy.copy_from(buf[4], tag_t());
+      y_ennemy.copy_from(buf[5], tag_t());
+
+      // rule #1, move towards box center
+      simd_t dx = simd_t(compute_t(-0.01)) * xs;
+      simd_t dy = simd_t(compute_t(-0.01)) * ys;
+
+      simd_t dir_x, dir_y;
+
+      // rule #2, move towards friend
+      kboids::simd_direction<compute_t>(xs, ys, x_friend, y_friend, dir_x, dir_y);
+      dx += simd_t(compute_t(0.05)) * dir_x;
+      dy += simd_t(compute_t(0.05)) * dir_y;
+
+      // rule #3, move away from ennemy
+      kboids::simd_direction<compute_t>(xs, ys, x_ennemy, y_ennemy, dir_x, dir_y);
+      dx -= simd_t(compute_t(0.03)) * dir_x;
+      dy -= simd_t(compute_t(0.03)) * dir_y;
+
+      // update positions
+      (xs + dx).copy_to(buf[0], tag_t());
+      (ys + dy).copy_to(buf[1], tag_t());
+
+      for (int l=0; l<nLanes; ++l)
+      {
+        x_new(first+l) = buf[0][l];
+        y_new(first+l) = buf[1][l];
+      }
+    });
+
+    // swap old and new data
+    std::swap(m_pos, m_pos_new);
+    setCoordinates();
+  }
+#endif // KBOIDS_USE_SIMD_MATH
+
+} // BoidsData<DeviceType, Precision>::updatePositionsSimd
 
 // ===================================================
 // ===================================================
-template<typename DeviceType>
-void BoidsData<DeviceType>::renderPositions(PngData data)
+template<typename DeviceType, typename Precision>
+void BoidsData<DeviceType, Precision>::updatePositionsPrefetch(execution_space const &exec_space,
+                                                               int distance)
+{
+
+  if constexpr (not kboids::prefetch_enabled<execution_space>)
+  {
+    updatePositions(exec_space);
+  }
+  else
+  {
+    constexpr int B = kboids::PREFETCH_BATCH_SIZE;
+
+    distance = (distance < 0) ? 0 : distance;
+    distance = (distance > B) ? B : distance;
+
+    const int nBatches = (m_nBoids + B - 1) / B;
+
+    auto policy = Kokkos::RangePolicy<execution_space>(exec_space, 0, nBatches);
+
+    Kokkos::parallel_for("updatePositionsPrefetch", policy, KOKKOS_CLASS_LAMBDA(const int& iBatch)
+    {
+      const int first = iBatch * B;
+      const int last  = (first + B < m_nBoids) ? first + B : m_nBoids;
+
+      // pipeline prologue
+      for (int index=first; index<first+distance and index<last; ++index)
+        prefetchPartners(index);
+
+      // steady state : prefetch distance boids ahead, compute current boid
+      for (int index=first; index<last; ++index)
+      {
+        if (distance > 0 and index+distance < last)
+          prefetchPartners(index+distance);
+
+        updatePosition(index);
+      }
+    });
+
+    // swap old and new data
+    std::swap(m_pos, m_pos_new);
+    setCoordinates();
+  }
+
+} // BoidsData<DeviceType, Precision>::updatePositionsPrefetch
+
+// ===================================================
+// ===================================================
+template<typename DeviceType, typename Precision>
+void BoidsData<DeviceType, Precision>::renderPositions(PngData data)
 {
 
   auto scale = (data.extent(0)-1)/2.0;
 
   // 1. copy back on host boids positions
-  Kokkos::deep_copy(m_x_host, m_x);
-  Kokkos::deep_copy(m_y_host, m_y);
+  Kokkos::deep_copy(m_pos_host, m_pos);
 
   // 2. create image
   //auto policy = Kokkos::RangePolicy<>(Kokkos::OpenMP{}, 0, m_nBoids);
@@ -297,16 +895,20 @@ void BoidsData<DeviceType>::renderPositions(PngData data)
     }
   }
 
-} // BoidsData<DeviceType>::renderPositions
+} // BoidsData<DeviceType, Precision>::renderPositions
 
 // ===================================================
 // ===================================================
-template<typename DeviceType>
-void BoidsData<DeviceType>::copyPositionsForOpenGLRendering(execution_space const &exec_space)
+template<typename DeviceType, typename Precision>
+void BoidsData<DeviceType, Precision>::copyPositionsForOpenGLRendering(execution_space const &exec_space)
 {
 
 #ifdef FORGE_ENABLED
 
+  // interleaved float storage can be used directly for rendering
+  if (direct_rendering)
+    return;
+
   auto policy = Kokkos::RangePolicy<execution_space>(exec_space, 0, m_nBoids);
 
   Kokkos::parallel_for("copyPositionsForOpenGLRendering", policy, KOKKOS_CLASS_LAMBDA(const int& index)
@@ -320,7 +922,7 @@ void BoidsData<DeviceType>::copyPositionsForOpenGLRendering(execution_space cons
 
 #endif
 
-} // BoidsData<DeviceType>::copyPositionsForOpenGLRendering
+} // BoidsData<DeviceType, Precision>::copyPositionsForOpenGLRendering
 
 // ===================================================
 // ===================================================
@@ -25,7 +25,17 @@ void usage(const std::string &app_name)
       "  -n, --nboids arg        Number of boids (default: 1000)\n"
       "  -i, --iter arg          Number of time steps (default: 100)\n"
       "  -s, --seed arg          Random seed (default: 42)\n"
+      "  -w, --window arg        Draw friends/ennemies within this index distance (default: 0, i.e. whole flock)\n"
+      "  -r, --resort arg        Re-sort flock along a Morton curve every arg time steps (default: 0, i.e. never)\n"
+      "  -k, --kernel arg        updatePositions kernel : scalar, simd or prefetch (default: scalar)\n"
+      "  --prefetch-distance arg Prefetch distance (in boids) of the prefetch kernel (default: 16)\n"
+      "  --prefetch-bench        Time scalar and prefetch kernels for distances from 0 to 128 (arg -i time steps per distance)\n"
+      "  --shuffle arg           Friends/ennemies shuffle algorithm : dense, sparse or auto (default: auto)\n"
+      "  --shuffle-bench         Time dense and sparse shuffles for rates from 0.001 to 1 (arg -i shuffles per rate)\n"
+      "  --no-fuse               Do not fuse position update and shuffle on shuffle steps\n"
       "  -d, --dump              Dump data to PNG files\n"
+      "  --drift                 Report trajectory drift of float/mixed/16-bit storage against a double precision reference\n"
+      "  --storage-bench         Time float and 16-bit storage formats (arg -i time steps per format)\n"
       "  -g, --gui               Add a simple visualization gui (require FORGE library)\n"
       "  -h, --help              Show this help";
 
@@ -59,12 +69,12 @@ void print_kokkos_config()
 // ===================================================
 // ===================================================
 template<typename DeviceType>
-void run_simu(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool dump_data, bool gui_enabled)
+void run_simu(const RunParams& params, bool gui_enabled)
 {
   if (gui_enabled)
     {
 #ifdef FORGE_ENABLED
-      run_boids_flight_gui<DeviceType>(nBoids, nIter, seed, dump_data);
+      run_boids_flight_gui<DeviceType>(params.nBoids, params.nIter, params.seed, params.dump_data);
 #else
       std::cerr << "Rerun cmake and enable Forge library.\n";
 #endif
@@ -85,7 +95,16 @@ void run_simu(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool dump_data, bo
       // std::cout << "GUI enabled, we limit the number of boids to 1000\n";
       // nBoids = (nBoids > 1000) ? 1000 : nBoids;
 
-      run_boids_flight<DeviceType>(nBoids, nIter, seed, dump_data);
+      if (params.drift_report)
+        run_precision_drift<DeviceType>(params);
+      else if (params.shuffle_benchmark)
+        run_shuffle_benchmark<DeviceType>(params);
+      else if (params.prefetch_benchmark)
+        run_prefetch_benchmark<DeviceType>(params);
+      else if (params.storage_benchmark)
+        run_storage_benchmark<DeviceType>(params);
+      else
+        run_boids_flight<DeviceType>(params);
 
       LIKWID_MARKER_CLOSE;
 
@@ -102,24 +121,62 @@ int main(int argc, char* argv[])
       "-n", "--nboids",
       "-i", "--iter",
       "-s", "--seed",
+      "-w", "--window",
+      "-r", "--resort",
+      "-k", "--kernel",
+      "--shuffle",
+      "--prefetch-distance",
       "-d", "--dump",
       "-g", "--gui",
       "-c", "--cuda"});
     cmdl.parse(argc, argv);
 
 
-  uint32_t nBoids;
-  cmdl({"n", "nboids"}, 1000) >> nBoids;
+  RunParams params;
 
-  uint32_t nIter;
-  cmdl({"i", "iter"}, 100) >> nIter;
+  cmdl({"n", "nboids"}, 1000) >> params.nBoids;
+
+  cmdl({"i", "iter"}, 100) >> params.nIter;
 
   // initialize the random generator pool
   //uint64_t seed = std::chrono::high_resolution_clock::now().time_since_epoch().count();
-  uint64_t seed;
-  cmdl({"s", "seed"}, 42) >> seed;
+  cmdl({"s", "seed"}, 42) >> params.seed;
+
+  // spatially local friends/ennemies selection
+  cmdl({"w", "window"}, 0) >> params.window;
+  cmdl({"r", "resort"}, 0) >> params.resortPeriod;
+
+  // kernel variant
+  std::string kernel_name;
+  cmdl({"k", "kernel"}, "scalar") >> kernel_name;
+  if (not kboids::kernel_from_string(kernel_name, params.kernel))
+  {
+    std::cerr << "Unknown kernel : " << kernel_name << "\n";
+    return EXIT_FAILURE;
+  }
+
+  // shuffle algorithm
+  std::string shuffle_name;
+  cmdl({"shuffle"}, "auto") >> shuffle_name;
+  if (not kboids::shuffle_mode_from_string(shuffle_name, params.shuffleMode))
+  {
+    std::cerr << "Unknown shuffle mode : " << shuffle_name << "\n";
+    return EXIT_FAILURE;
+  }
+
+  params.shuffle_benchmark = cmdl[{"shuffle-bench"}];
+
+  params.fuseShuffle = not cmdl[{"no-fuse"}];
+
+  // gather pipelined kernel
+  cmdl({"prefetch-distance"}, kboids::PREFETCH_DEFAULT_DISTANCE) >> params.prefetchDistance;
+  params.prefetch_benchmark = cmdl[{"prefetch-bench"}];
+
+  params.dump_data = cmdl[{"d","dump"}];
+
+  params.drift_report = cmdl[{"drift"}];
 
-  bool dump_data = cmdl[{"d","dump"}];
+  params.storage_benchmark = cmdl[{"storage-bench"}];
 
   bool gui_enabled = cmdl[{"g","gui"}];
 
@@ -142,14 +199,14 @@ int main(int argc, char* argv[])
     std::cout << "=================================\n";
     std::cout << "Running on Kokkos::OpenMP device \n";
     std::cout << "=================================\n";
-    run_simu<Kokkos::OpenMP>(nBoids, nIter, seed, dump_data, false);
+    run_simu<Kokkos::OpenMP>(params, false);
 #endif
 
 #ifdef KOKKOS_ENABLE_CUDA
     std::cout << "=================================\n";
     std::cout << "Running on Kokkos::Cuda device   \n";
     std::cout << "=================================\n";
-    run_simu<Kokkos::Cuda>(nBoids, nIter, seed, dump_data, false);
+    run_simu<Kokkos::Cuda>(params, false);
 #endif
   }
 
@@ -3,25 +3,113 @@
 #include "Boids.h"
 
 #include <iostream>
+#include <iomanip>
 #include <cstdint>
+#include <string>
 
+#include "utils/kernel-type.h"
 #include "utils/likwid-utils.h"
+#include "utils/prefetch-utils.h"
 #include "time/Timer.h"
 
+// ===================================================================================
+// ===================================================================================
+//! run parameters (as read from the command line)
+struct RunParams
+{
+  //! number of boids
+  uint32_t nBoids = 1000;
+
+  //! number of time steps
+  uint32_t nIter = 100;
+
+  //! random seed
+  uint64_t seed = 42;
+
+  //! dump data to PNG files
+  bool dump_data = false;
+
+  //! if > 0, friends and ennemies are drawn within this index distance
+  int window = 0;
+
+  //! if > 0, re-sort the flock along a Morton curve every resortPeriod time steps
+  uint32_t resortPeriod = 0;
+
+  //! report trajectory drift of each precision policy instead of a regular run
+  bool drift_report = false;
+
+  //! updatePositions kernel variant
+  kboids::UpdateKernel kernel = kboids::UpdateKernel::SCALAR;
+
+  //! friends/ennemies shuffle algorithm
+  kboids::ShuffleMode shuffleMode = kboids::ShuffleMode::AUTO;
+
+  //! run the shuffle benchmark instead of a regular run
+  bool shuffle_benchmark = false;
+
+  //! fuse position update and shuffle on shuffle steps (scalar kernel only)
+  bool fuseShuffle = true;
+
+  //! prefetch distance (in boids) of the prefetch kernel
+  int prefetchDistance = kboids::PREFETCH_DEFAULT_DISTANCE;
+
+  //! run the prefetch benchmark instead of a regular run
+  bool prefetch_benchmark = false;
+
+  //! run the storage formats benchmark instead of a regular run
+  bool storage_benchmark = false;
+
+}; // struct RunParams
+
 // ===================================================================================
 // ===================================================================================
 template<typename DeviceType>
-void run_boids_flight(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool dump_data)
+void run_boids_flight(const RunParams& params)
 {
   using execution_space = typename DeviceType::execution_space;
 
+  const auto nBoids       = params.nBoids;
+  const auto nIter        = params.nIter;
+  const auto dump_data    = params.dump_data;
+  const auto window       = params.window;
+  const auto resortPeriod = params.resortPeriod;
+
+  auto kernel = params.kernel;
+
+  if (kernel == kboids::UpdateKernel::SIMD and
+      not kboids::simd_enabled<execution_space>)
+  {
+    std::cout << "SIMD kernel not available (requires cmake option USE_SIMD_MATH and a host backend)\n";
+    kernel = kboids::UpdateKernel::SCALAR;
+  }
+
+  if (kernel == kboids::UpdateKernel::PREFETCH and
+      not kboids::prefetch_enabled<execution_space>)
+  {
+    std::cout << "Prefetch kernel not available (requires a host backend)\n";
+    kernel = kboids::UpdateKernel::SCALAR;
+  }
+
+  std::cout << "Update kernel : " << kboids::kernel_name(kernel) << "\n";
+  if (kernel == kboids::UpdateKernel::PREFETCH)
+    std::cout << "Prefetch distance : " << params.prefetchDistance << " boids\n";
+  std::cout << "Shuffle mode  : " << kboids::shuffle_mode_name(params.shuffleMode) << "\n";
+
   execution_space exec_space{};
 
+  std::cout << "Precision policy : " << BoidsData<DeviceType>::precision::name << "\n";
+
   // create a BoidsData object
-  BoidsData<DeviceType> boidsData(nBoids, seed);
+  BoidsData<DeviceType> boidsData(nBoids, params.seed);
 
   boidsData.initPositions();
-  boidsData.shuffleFriendsAndEnnemies(exec_space, 1.0);
+
+  // sort before drawing initial friends/ennemies, so that a bounded window is
+  // also spatially local
+  if (resortPeriod > 0)
+    boidsData.sortAlongMortonCurve(exec_space);
+
+  boidsData.shuffleFriendsAndEnnemies(exec_space, 1.0, window, params.shuffleMode);
 
   // 2d array for display
   PngData data("render_image", 768, 768, 4);
@@ -33,6 +121,9 @@ void run_boids_flight(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool dump_
 
     timer.start();
 
+    if (resortPeriod > 0 and iTime % resortPeriod == 0)
+      boidsData.sortAlongMortonCurve(exec_space);
+
 #ifdef _OPENMP
 #pragma omp parallel
 #endif
@@ -40,7 +131,19 @@ void run_boids_flight(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool dump_
       LIKWID_MARKER_START("updatePositions");
     }
 
-    boidsData.updatePositions(exec_space);
+    // on shuffle steps, fuse update and shuffle in a single sweep
+    const bool shuffleStep = (iTime % 20 == 0);
+    const bool fused = shuffleStep and params.fuseShuffle and
+      kernel == kboids::UpdateKernel::SCALAR;
+
+    if (fused)
+      boidsData.updatePositionsAndShuffle(exec_space, 0.1, window, params.shuffleMode);
+    else if (kernel == kboids::UpdateKernel::SIMD)
+      boidsData.updatePositionsSimd(exec_space);
+    else if (kernel == kboids::UpdateKernel::PREFETCH)
+      boidsData.updatePositionsPrefetch(exec_space, params.prefetchDistance);
+    else
+      boidsData.updatePositions(exec_space);
 
 #ifdef _OPENMP
 #pragma omp parallel
@@ -49,8 +152,8 @@ void run_boids_flight(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool dump_
       LIKWID_MARKER_STOP("updatePositions");
     }
 
-    if (iTime % 20 == 0)
-      boidsData.shuffleFriendsAndEnnemies(exec_space, 0.1);
+    if (shuffleStep and not fused)
+      boidsData.shuffleFriendsAndEnnemies(exec_space, 0.1, window, params.shuffleMode);
 
     timer.stop();
 
@@ -67,7 +170,340 @@ void run_boids_flight(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool dump_
   // report time spent in computations
   auto time_seconds = timer.elapsed();
   std::cout << "Total time : " << time_seconds << " seconds\n";
-  std::cout << "Throughput : " << (nBoids*nIter)/time_seconds/1e6 << " MBoids-updates/s \n";
+  std::cout << "Throughput (" << kboids::kernel_name(kernel) << " kernel) : "
+            << (nBoids*nIter)/time_seconds/1e6 << " MBoids-updates/s \n";
+
+  boidsData.reportGatherDistance(exec_space);
 
 } // run_boids_flight
 
+// ===================================================================================
+// ===================================================================================
+/**
+ * Validation of precision policies : the same flock is advanced with float, mixed
+ * and 16-bit storage precision policies, alongside a double precision reference,
+ * and the deviation of positions from the reference is reported along time.
+ *
+ * All flocks start from the same positions and share the same friends and
+ * ennemies (drawn by the reference), so that the deviation only comes from
+ * arithmetic and storage rounding. Float is the baseline of 16-bit formats.
+ */
+template<typename DeviceType>
+void run_precision_drift(const RunParams& params)
+{
+  using execution_space = typename DeviceType::execution_space;
+
+  const auto nBoids = params.nBoids;
+  const auto nIter  = params.nIter;
+  const auto window = params.window;
+
+  execution_space exec_space{};
+
+  BoidsData<DeviceType, kboids::DoublePrecision> reference(nBoids, params.seed);
+  BoidsData<DeviceType, kboids::FloatPrecision>  boidsFloat(nBoids, params.seed);
+  BoidsData<DeviceType, kboids::MixedPrecision>  boidsMixed(nBoids, params.seed);
+  BoidsData<DeviceType, kboids::Bf16Precision>    boidsBf16(nBoids, params.seed);
+  BoidsData<DeviceType, kboids::Fp16Precision>    boidsFp16(nBoids, params.seed);
+  BoidsData<DeviceType, kboids::Fixed16Precision> boidsFixed16(nBoids, params.seed);
+
+  reference.initPositions();
+  reference.shuffleFriendsAndEnnemies(exec_space, 1.0, window, params.shuffleMode);
+
+  boidsFloat.copyStateFrom(exec_space, reference);
+  boidsMixed.copyStateFrom(exec_space, reference);
+  boidsBf16.copyStateFrom(exec_space, reference);
+  boidsFp16.copyStateFrom(exec_space, reference);
+  boidsFixed16.copyStateFrom(exec_space, reference);
+
+  const uint32_t reportPeriod = (nIter >= 10) ? nIter/10 : 1;
+
+  // rms deviations at last report
+  double rmsFloat = 0, rmsBf16 = 0, rmsFp16 = 0, rmsFixed16 = 0;
+
+  auto report = [&](uint32_t iTime)
+  {
+    auto devFloat   = boidsFloat.positionDeviation(exec_space, reference);
+    auto devMixed   = boidsMixed.positionDeviation(exec_space, reference);
+    auto devBf16    = boidsBf16.positionDeviation(exec_space, reference);
+    auto devFp16    = boidsFp16.positionDeviation(exec_space, reference);
+    auto devFixed16 = boidsFixed16.positionDeviation(exec_space, reference);
+
+    rmsFloat   = devFloat.second;
+    rmsBf16    = devBf16.second;
+    rmsFp16    = devFp16.second;
+    rmsFixed16 = devFixed16.second;
+
+    std::cout << std::setw(8) << iTime
+              << std::scientific << std::setprecision(3)
+              << std::setw(12) << devFloat.first   << std::setw(12) << devFloat.second
+              << std::setw(12) << devMixed.first   << std::setw(12) << devMixed.second
+              << std::setw(12) << devBf16.first    << std::setw(12) << devBf16.second
+              << std::setw(12) << devFp16.first    << std::setw(12) << devFp16.second
+              << std::setw(12) << devFixed16.first << std::setw(12) << devFixed16.second
+              << std::defaultfloat << "\n";
+  };
+
+  std::cout << "Position deviation from double precision reference :\n";
+  std::cout << std::setw(8) << "step"
+            << std::setw(12) << "float max"   << std::setw(12) << "float rms"
+            << std::setw(12) << "mixed max"   << std::setw(12) << "mixed rms"
+            << std::setw(12) << "bf16 max"    << std::setw(12) << "bf16 rms"
+            << std::setw(12) << "fp16 max"    << std::setw(12) << "fp16 rms"
+            << std::setw(12) << "fixed16 max" << std::setw(12) << "fixed16 rms" << "\n";
+
+  report(0);
+
+  for(uint32_t iTime=0; iTime<nIter; ++iTime)
+  {
+
+    reference.updatePositions(exec_space);
+    boidsFloat.updatePositions(exec_space);
+    boidsMixed.updatePositions(exec_space);
+    boidsBf16.updatePositions(exec_space);
+    boidsFp16.updatePositions(exec_space);
+    boidsFixed16.updatePositions(exec_space);
+
+    if (iTime % 20 == 0)
+    {
+      reference.shuffleFriendsAndEnnemies(exec_space, 0.1, window, params.shuffleMode);
+      boidsFloat.copyFriendsAndEnnemiesFrom(reference);
+      boidsMixed.copyFriendsAndEnnemiesFrom(reference);
+      boidsBf16.copyFriendsAndEnnemiesFrom(reference);
+      boidsFp16.copyFriendsAndEnnemiesFrom(reference);
+      boidsFixed16.copyFriendsAndEnnemiesFrom(reference);
+    }
+
+    if ((iTime+1) % reportPeriod == 0)
+      report(iTime+1);
+
+  } // end for iTime
+
+  // 16-bit storage against the float baseline
+  auto ratio = [&](double rms) { return (rmsFloat > 0) ? rms/rmsFloat : 0; };
+
+  std::cout << "16-bit storage rms deviation relative to float (at step " << nIter << ") :"
+            << " bf16 " << ratio(rmsBf16)
+            << ", fp16 " << ratio(rmsFp16)
+            << ", fixed16 " << ratio(rmsFixed16) << "\n";
+
+} // run_precision_drift
+
+// ===================================================================================
+// ===================================================================================
+/**
+ * Time dense and sparse shuffles over a range of rates, and report the fraction
+ * of boids actually refreshed (should be close to rate for both algorithms).
+ */
+template<typename DeviceType>
+void run_shuffle_benchmark(const RunParams& params)
+{
+  using execution_space = typename DeviceType::execution_space;
+  using VecInt          = typename BoidsData<DeviceType>::VecInt;
+
+  const auto nBoids = params.nBoids;
+  const auto nIter  = params.nIter;
+
+  execution_space exec_space{};
+
+  BoidsData<DeviceType> boidsData(nBoids, params.seed);
+
+  boidsData.initPositions();
+  boidsData.shuffleFriendsAndEnnemies(exec_space, 1.0, params.window);
+
+  VecInt friends_old("friends_old", nBoids);
+
+  const float rates[] = {0.001, 0.003, 0.01, 0.03, 0.1, 0.3, 1.0};
+
+  const kboids::ShuffleMode modes[] = {kboids::ShuffleMode::DENSE, kboids::ShuffleMode::SPARSE};
+
+  std::cout << "Shuffle benchmark (" << nBoids << " boids, " << nIter << " shuffles per rate) :\n";
+  std::cout << "    rate    mode   time per shuffle (ms)   MBoids/s   refreshed (%)\n";
+
+  for (auto rate : rates)
+  {
+    for (auto mode : modes)
+    {
+      Timer timer;
+
+      for (uint32_t iTime=0; iTime<nIter; ++iTime)
+      {
+        timer.start();
+        boidsData.shuffleFriendsAndEnnemies(exec_space, rate, params.window, mode);
+        exec_space.fence();
+        timer.stop();
+      }
+
+      // fraction of refreshed boids (friend index actually changed) in one more shuffle
+      Kokkos::deep_copy(friends_old, boidsData.friends());
+      boidsData.shuffleFriendsAndEnnemies(exec_space, rate, params.window, mode);
+
+      auto friends = boidsData.friends();
+      int nChanged = 0;
+      Kokkos::parallel_reduce("count refreshed",
+        Kokkos::RangePolicy<execution_space>(exec_space, 0, nBoids),
+        KOKKOS_LAMBDA(const int& index, int& count)
+        {
+          if (friends(index) != friends_old(index))
+            ++count;
+        }, nChanged);
+
+      const double time_seconds = timer.elapsed();
+
+      std::cout << std::setw(8) << rate
+                << std::setw(8) << kboids::shuffle_mode_name(mode)
+                << std::setw(24) << 1000*time_seconds/nIter
+                << std::setw(11) << (double(nBoids)*nIter)/time_seconds/1e6
+                << std::setw(16) << 100.0*nChanged/nBoids << "\n";
+    }
+  }
+
+} // run_shuffle_benchmark
+
+
+// ===================================================================================
+// ===================================================================================
+/**
+ * Time the scalar kernel and the prefetch kernel over a range of prefetch distances.
+ *
+ * Achieved memory-level parallelism (random gathers in flight per thread) is
+ * estimated with Little's law from the gather rate and the measured latency of a
+ * dependent random load.
+ */
+template<typename DeviceType>
+void run_prefetch_benchmark(const RunParams& params)
+{
+  using execution_space = typename DeviceType::execution_space;
+  using real_t          = typename BoidsData<DeviceType>::real_t;
+
+  const auto nBoids = params.nBoids;
+  const auto nIter  = params.nIter;
+
+  execution_space exec_space{};
+
+  BoidsData<DeviceType> boidsData(nBoids, params.seed);
+
+  boidsData.initPositions();
+  boidsData.shuffleFriendsAndEnnemies(exec_space, 1.0, params.window);
+
+  const int nThreads = exec_space.concurrency();
+
+  // latency of a random load in a (host) buffer as large as positions
+  const size_t bytes = 2 * sizeof(real_t) * size_t(nBoids);
+  const double latency_ns = kboids::measure_load_latency(bytes, params.seed);
+
+  std::cout << "Prefetch benchmark (" << nBoids << " boids, " << nIter << " time steps per distance, "
+            << nThreads << " threads) :\n";
+  std::cout << "Dependent load latency (" << bytes/1e6 << " MB buffer) : " << latency_ns << " ns\n";
+  std::cout << "    kernel  distance   time per step (ms)   MBoids/s   Mgathers/s   loads in flight per thread\n";
+
+  // distance < 0 is the scalar kernel
+  const int distances[] = {-1, 0, 1, 2, 4, 8, 16, 32, 64, 128};
+
+  for (auto distance : distances)
+  {
+    Timer timer;
+
+    for (uint32_t iTime=0; iTime<nIter; ++iTime)
+    {
+      timer.start();
+      if (distance < 0)
+        boidsData.updatePositions(exec_space);
+      else
+        boidsData.updatePositionsPrefetch(exec_space, distance);
+      exec_space.fence();
+      timer.stop();
+    }
+
+    const double time_seconds = timer.elapsed();
+
+    // 2 random gathers (friend and ennemy) per boid update; memory-level
+    // parallelism from Little's law (upper bound : some gathers hit in cache)
+    const double gathers_per_second = 2.0*nBoids*nIter/time_seconds;
+    const double mlp = gathers_per_second * latency_ns * 1e-9 / nThreads;
+
+    std::cout << std::setw(10) << ((distance < 0) ? "scalar" : "prefetch")
+              << std::setw(10) << ((distance < 0) ? std::string("-") : std::to_string(distance))
+              << std::setw(21) << 1000*time_seconds/nIter
+              << std::setw(11) << (double(nBoids)*nIter)/time_seconds/1e6
+              << std::setw(13) << gathers_per_second/1e6
+              << std::setw(29) << mlp << "\n";
+  }
+
+} // run_prefetch_benchmark
+
+// ===================================================================================
+// ===================================================================================
+/**
+ * Time nIter updatePositions and one sortAlongMortonCurve with the given precision
+ * policy, print a line of the storage benchmark.
+ *
+ * \return time per update (seconds)
+ */
+template<typename DeviceType, typename Precision>
+double run_storage_benchmark_policy(const RunParams& params, double time_float)
+{
+  using execution_space = typename DeviceType::execution_space;
+  using real_t          = typename BoidsData<DeviceType, Precision>::real_t;
+
+  const auto nBoids = params.nBoids;
+  const auto nIter  = params.nIter;
+
+  execution_space exec_space{};
+
+  BoidsData<DeviceType, Precision> boidsData(nBoids, params.seed);
+
+  boidsData.initPositions();
+  boidsData.shuffleFriendsAndEnnemies(exec_space, 1.0, params.window);
+
+  Timer timer;
+  for (uint32_t iTime=0; iTime<nIter; ++iTime)
+  {
+    timer.start();
+    boidsData.updatePositions(exec_space);
+    exec_space.fence();
+    timer.stop();
+  }
+  const double time_update = timer.elapsed()/nIter;
+
+  // re-sort : Morton keys and sort do not depend on storage, permutation does
+  Timer timer_sort;
+  timer_sort.start();
+  boidsData.sortAlongMortonCurve(exec_space);
+  exec_space.fence();
+  timer_sort.stop();
+
+  // positions (old and new) and friend/ennemy index
+  const double footprint = (4.0*sizeof(real_t) + 2.0*sizeof(int)) * nBoids;
+
+  std::cout << std::setw(10) << Precision::name
+            << std::setw(20) << footprint/1e6
+            << std::setw(21) << 1000*time_update
+            << std::setw(11) << nBoids/time_update/1e6
+            << std::setw(10) << ((time_float > 0) ? time_float/time_update : 1.0)
+            << std::setw(16) << 1000*timer_sort.elapsed() << "\n";
+
+  return time_update;
+
+} // run_storage_benchmark_policy
+
+// ===================================================================================
+// ===================================================================================
+/**
+ * Compare throughput of float and 16-bit storage formats (use a flock size such
+ * that the data footprint exceeds the last level cache).
+ */
+template<typename DeviceType>
+void run_storage_benchmark(const RunParams& params)
+{
+
+  std::cout << "Storage benchmark (" << params.nBoids << " boids, " << params.nIter
+            << " time steps per format) :\n";
+  std::cout << "    format   footprint (MB)   time per step (ms)   MBoids/s   speedup   re-sort (ms)\n";
+
+  const double time_float =
+    run_storage_benchmark_policy<DeviceType, kboids::FloatPrecision>(params, 0);
+  run_storage_benchmark_policy<DeviceType, kboids::Bf16Precision>(params, time_float);
+  run_storage_benchmark_policy<DeviceType, kboids::Fp16Precision>(params, time_float);
+  run_storage_benchmark_policy<DeviceType, kboids::Fixed16Precision>(params, time_float);
+
+} // run_storage_benchmark
@@ -51,7 +51,7 @@ void run_boids_flight_gui<Kokkos::Cuda>(uint32_t nBoids, uint32_t nIter, uint64_
     if (iTime % 20 == 0)
       boidsData.shuffleFriendsAndEnnemies(exec_space, 0.1);
 
-    copyToGLBuffer(handles, (ComputeResourceHandle)boidsData.m_xy.data(),
+    copyToGLBuffer(handles, (ComputeResourceHandle)boidsData.renderData(),
                    boidsXY.verticesSize());
     wnd.draw(chart);
 
@@ -0,0 +1,58 @@
+#pragma once
+
+// Include Kokkos Headers
+#include<Kokkos_Core.hpp>
+
+#include "utils/precision-policy.h"
+
+// ===================================================
+// ===================================================
+/**
+ * Adaptive sort frequency (optional alternative to sorting boids every step).
+ *
+ * Between two sorts, boids stay stored (and colored) by the box they were in
+ * at the last sort. The neighbour walk stays exact by growing the searched area
+ * by the largest displacement since the last sort (drift). Boids are sorted
+ * again when more than threshold of them left their box, or when the drift
+ * exceeds half a box (neighbour walk would visit too many boxes).
+ */
+struct AdaptiveSort
+{
+  using value_t  = kboids::DefaultPrecision::value_t;
+  using VecValue = Kokkos::View<value_t*, Kokkos::DefaultExecutionSpace>;
+
+  //! default fraction of boids out of their box triggering a sort (up to 45%
+  //! of boids change box in a single step, a lower threshold sorts every step)
+  static constexpr float THRESHOLD = 0.5;
+
+  //! \param[in] nBoids is the number of boids
+  //! \param[in] threshold is the fraction of boids out of their box triggering a sort
+  AdaptiveSort(int nBoids, float threshold = THRESHOLD)
+    : threshold(threshold),
+      x0("x at sort", nBoids),
+      y0("y at sort", nBoids)
+  {}
+
+  //! fraction of boids out of their box triggering a sort
+  float threshold;
+
+  //! largest displacement since the last sort
+  float drift = 0;
+
+  //! positions at the last sort
+  VecValue x0, y0;
+
+  //! number of steps boids moved since the last sort
+  int stepsSinceSort = 0;
+
+  //! statistics : steps, sorts (triggered by drift only), and fraction of boids out of their box when sorting
+  int nSteps = 0;
+  int nSorts = 0;
+  int nDriftSorts = 0;
+  double outOfBoxAtSort = 0;
+
+  //! statistics : fraction of boids out of their box one step after a sort
+  int nFirstSteps = 0;
+  double outOfBoxFirstStep = 0;
+
+}; // struct AdaptiveSort
@@ -8,159 +8,276 @@
 
 // ===================================================
 // ===================================================
-void initPositions(BoidsData& boidsData, MyRandomPool::RGPool_t& rand_pool)
+void initPositions(BoidsData& boidsData, MyRandom& myRand)
 {
 
-  Kokkos::fill_random(boidsData.x,  rand_pool, BoidsData::XMIN, BoidsData::XMAX);
-  Kokkos::fill_random(boidsData.y,  rand_pool, BoidsData::YMIN, BoidsData::YMAX);
-  Kokkos::fill_random(boidsData.dx, rand_pool, -1., 1.);
-  Kokkos::fill_random(boidsData.dy, rand_pool, -1., 1.);
+  using value_t = BoidsData::value_t;
+
+  const auto rng    = myRand.rng;
+  const auto stream = myRand.nextStream();
+
+  Kokkos::parallel_for("initPositions", boidsData.nBoids, KOKKOS_LAMBDA(const int& index)
+  {
+    const auto r = rng(stream, index);
+
+    boidsData.x(index)  = kboids::uniform_real<value_t>(r[0], boidsData.grid.xmin, boidsData.grid.xmax);
+    boidsData.y(index)  = kboids::uniform_real<value_t>(r[1], boidsData.grid.ymin, boidsData.grid.ymax);
+    boidsData.dx(index) = kboids::uniform_real<value_t>(r[2], -1., 1.);
+    boidsData.dy(index) = kboids::uniform_real<value_t>(r[3], -1., 1.);
+  });
 
 } // BoidsData::initPositions
 
 // ===================================================
 // ===================================================
-std::pair<float,float> updateAverageVelocity(BoidsData& boidsData)
+void initClusteredPositions(BoidsData& boidsData, MyRandom& myRand,
+                            int nClusters, float radius)
 {
 
-  // this is just a reduction
-  // we could also use a custom reducer, and place output directly in
-  // device memory
-  // see https://github.com/kokkos/kokkos/wiki/Custom-Reductions%3A-Built-In-Reducers-with-Custom-Scalar-Types
+  using value_t = BoidsData::value_t;
 
-  float vx, vy;
+  const auto rng    = myRand.rng;
+  const auto stream = myRand.nextStream();
 
-  Kokkos::parallel_reduce("updateAverageVelocity x", boidsData.nBoids,
-     KOKKOS_LAMBDA(const int index, float& value)
-     {
-       value += boidsData.dx(index);
-     }, vx);
+  // cluster centers (one counter per cluster) and velocities in separate streams
+  const auto centerStream   = myRand.nextStream();
+  const auto velocityStream = myRand.nextStream();
+
+  Kokkos::parallel_for("initClusteredPositions", boidsData.nBoids, KOKKOS_LAMBDA(const int& index)
+  {
+    const auto r = rng(stream, index);
+
+    // cluster, small indexes being the most populated
+    const float u = kboids::uniform_real<float>(r[0], 0., 1.);
+    const int cluster = (int) (nClusters * u * u);
+
+    const auto c = rng(centerStream, cluster);
+    const float xc = kboids::uniform_real<float>(c[0], boidsData.grid.xmin, boidsData.grid.xmax);
+    const float yc = kboids::uniform_real<float>(c[1], boidsData.grid.ymin, boidsData.grid.ymax);
+
+    // gaussian offset (Box-Muller)
+    const float rho   = radius * sqrt(-2 * log(kboids::uniform_real<float>(r[1], 0., 1.) + 1e-7f));
+    const float angle = kboids::uniform_real<float>(r[2], 0., 2*M_PI);
+
+    // clusters crossing a periodic border wrap around
+    boidsData.x(index)  = value_t(boidsData.grid.wrap<0>(xc + rho * cos(angle)));
+    boidsData.y(index)  = value_t(boidsData.grid.wrap<1>(yc + rho * sin(angle)));
+    const auto v = rng(velocityStream, index);
+    boidsData.dx(index) = kboids::uniform_real<value_t>(v[0], -1., 1.);
+    boidsData.dy(index) = kboids::uniform_real<value_t>(v[1], -1., 1.);
+  });
+
+} // initClusteredPositions
+
+// ===================================================
+// ===================================================
+void updateFlockStats(BoidsData& boidsData)
+{
 
-  Kokkos::parallel_reduce("updateAverageVelocity y", boidsData.nBoids,
-     KOKKOS_LAMBDA(const int index, float& value)
+  using compute_t = BoidsData::compute_t;
+  using reducer_t = FlockStatsReducer<compute_t, Kokkos::DefaultExecutionSpace::memory_space>;
+  using stats_t   = BoidsData::FlockStats_t;
+
+  // one pass over boids, result written in device memory
+  Kokkos::parallel_reduce("updateFlockStats", boidsData.nBoids,
+     KOKKOS_LAMBDA(const int index, stats_t& value)
      {
-       value += boidsData.dy(index);
-     }, vy);
+       const compute_t x  = boidsData.x(index);
+       const compute_t y  = boidsData.y(index);
+       const compute_t dx = boidsData.dx(index);
+       const compute_t dy = boidsData.dy(index);
+
+       value.sum.data[stats_t::DX] += dx;
+       value.sum.data[stats_t::DY] += dy;
+       value.sum.data[stats_t::X]  += x;
+       value.sum.data[stats_t::Y]  += y;
 
-  vx /= boidsData.nBoids;
-  vy /= boidsData.nBoids;
+       value.xmin = (x < value.xmin) ? x : value.xmin;
+       value.xmax = (x > value.xmax) ? x : value.xmax;
+       value.ymin = (y < value.ymin) ? y : value.ymin;
+       value.ymax = (y > value.ymax) ? y : value.ymax;
 
-  return std::make_pair(vx,vy);
+       const compute_t speed = sqrt(dx*dx + dy*dy);
+       value.speed_min = (speed < value.speed_min) ? speed : value.speed_min;
+       value.speed_max = (speed > value.speed_max) ? speed : value.speed_max;
+     }, reducer_t(boidsData.stats));
 
-} // updateAverageVelocity
+} // updateFlockStats
 
 // ===================================================
 // ===================================================
-void shuffleEnnemies(BoidsData& boidsData, MyRandomPool::RGPool_t& rand_pool, float rate)
+void shuffleEnnemies(BoidsData& boidsData, MyRandom& myRand, float rate)
 {
 
   // rate should be in range [0,1]
   rate = (rate < 0) ? 0 : rate;
   rate = (rate > 1) ? 1 : rate;
 
-  using rnd_t = MyRandomPool::rnd_t;
+  const auto rng    = myRand.rng;
+  const auto stream = myRand.nextStream();
 
   Kokkos::parallel_for("shuffleEnnemies", boidsData.nBoids, KOKKOS_LAMBDA(const int& index)
   {
-    rnd_t rand_gen = rand_pool.get_state();
-
-    float r = Kokkos::rand<rnd_t,float>::draw(rand_gen, 0, 1);
+    const auto r = rng(stream, index);
 
     // shuffle friends and ennemies
-    if (r < rate)
+    if (kboids::uniform_real<float>(r[0], 0, 1) < rate)
     {
-      boidsData.ennemies(index) = Kokkos::rand<rnd_t,int>::draw(rand_gen, boidsData.nBoids);
+      boidsData.ennemies(index) = kboids::uniform_int(r[1], boidsData.nBoids);
     }
 
-    // free random gen state, so that it can used by other threads later.
-    rand_pool.free_state(rand_gen);
-
   });
 
 } // BoidsData::shuffleEnnemies
 
 // ===================================================
 // ===================================================
-void computeBoxData(BoidsData& boidsData)
+void accumulateBoxDataAtomic(BoidsData& boidsData)
 {
 
-  boidsData.resetBoxData();
-
-  // compute the number of boids per box
-  // and compute boids color
-  // TODO:
-  // - alternative : use Kokkos::ScatterView instead of Kokkos memory traits atomic
-
   using VecIntAtomic = BoidsData::VecIntAtomic;
   VecIntAtomic boxCount = boidsData.boxCount;
 
-  using VecFloatAtomic = BoidsData::VecFloatAtomic;
-  VecFloatAtomic box_x  = boidsData.box_x;
-  VecFloatAtomic box_y  = boidsData.box_y;
-  VecFloatAtomic box_dx = boidsData.box_dx;
-  VecFloatAtomic box_dy = boidsData.box_dy;
-
   Kokkos::parallel_for("computeBoxCount",
                        boidsData.nBoids, KOKKOS_LAMBDA(const int& index)
   {
-    auto x = boidsData.x(index);
-    auto y = boidsData.y(index);
-    auto dx = boidsData.dx(index);
-    auto dy = boidsData.dy(index);
+    const BoidsData::value_t x  = boidsData.x(index);
+    const BoidsData::value_t y  = boidsData.y(index);
 
-    int iBox = pos2box(x,y);
+    int iBox = pos2box(boidsData.grid, x, y);
 
-    //printf("index=%d %f %f | iBox=%d | %d %d\n",index,x,y,iBox,pos2box<0>(x),pos2box<1>(y));
+    //printf("index=%d %f %f | iBox=%d | %d %d\n",index,x,y,iBox,pos2box<0>(boidsData.grid,x),pos2box<1>(boidsData.grid,y));
 
     boxCount(iBox) += 1;
-    box_x(iBox)  += x;
-    box_y(iBox)  += y;
-    box_dx(iBox) += dx;
-    box_dy(iBox) += dy;
 
     // update current boid color
     boidsData.color(index) = iBox;
 
   });
 
-  Kokkos::parallel_for("compute box average velocity",
-                       BoidsData::NBOX_X*BoidsData::NBOX_Y, KOKKOS_LAMBDA(const int& iBox)
+} // accumulateBoxDataAtomic
+
+// ===================================================
+// ===================================================
+void accumulateBoxDataScatter(BoidsData& boidsData)
+{
+
+  auto& scatter_count = boidsData.scatter_count;
+
+  scatter_count.reset();
+
+  Kokkos::parallel_for("computeBoxCount scatter",
+                       boidsData.nBoids, KOKKOS_LAMBDA(const int& index)
+  {
+    const BoidsData::value_t x  = boidsData.x(index);
+    const BoidsData::value_t y  = boidsData.y(index);
+
+    int iBox = pos2box(boidsData.grid, x, y);
+
+    auto boxCount = scatter_count.access();
+
+    boxCount(iBox) += 1;
+
+    boidsData.color(index) = iBox;
+
+  });
+
+  Kokkos::Experimental::contribute(boidsData.boxCount, scatter_count);
+
+} // accumulateBoxDataScatter
+
+// ===================================================
+// ===================================================
+/**
+ * Each team accumulates a chunk of boids into histograms in scratch memory
+ * (shared memory on GPU), then adds its non empty boxes to the box arrays : one
+ * global atomic per box and per team instead of one per boid.
+ */
+void accumulateBoxDataPrivate(BoidsData& boidsData)
+{
+
+  using value_t = BoidsData::value_t;
+
+  using team_policy_t = Kokkos::TeamPolicy<>;
+  using member_t      = team_policy_t::member_type;
+  using scratch_t     = Kokkos::DefaultExecutionSpace::scratch_memory_space;
+
+  using ScratchInt = Kokkos::View<int*, scratch_t, Kokkos::MemoryTraits<Kokkos::Unmanaged>>;
+
+  const int nBoids = boidsData.nBoids;
+  const int nBoxes = boidsData.grid.nBoxes();
+
+  // enough boids per team to amortize histograms reset and flush
+  const int boidsPerTeam = (8*nBoxes > kboids::PRIVATE_MIN_BOIDS_PER_TEAM) ?
+    8*nBoxes : kboids::PRIVATE_MIN_BOIDS_PER_TEAM;
+  const int nTeams = (nBoids + boidsPerTeam - 1) / boidsPerTeam;
+
+  const size_t scratch_size = ScratchInt::shmem_size(nBoxes);
+
+  auto policy = team_policy_t(nTeams, Kokkos::AUTO)
+    .set_scratch_size(0, Kokkos::PerTeam(scratch_size));
+
+  Kokkos::parallel_for("computeBoxCount private", policy, KOKKOS_LAMBDA(const member_t& team)
   {
-    auto n = boidsData.boxCount(iBox);
-    if (n > 0)
+    ScratchInt count(team.team_scratch(0), nBoxes);
+
+    Kokkos::parallel_for(Kokkos::TeamThreadRange(team, nBoxes), [&](const int& iBox)
     {
-      boidsData.box_x(iBox) /= n;
-      boidsData.box_y(iBox) /= n;
-      boidsData.box_dx(iBox) /= n;
-      boidsData.box_dy(iBox) /= n;
-    }
-    else
+      count(iBox) = 0;
+    });
+    team.team_barrier();
+
+    const int first = team.league_rank() * boidsPerTeam;
+    const int last  = (first + boidsPerTeam < nBoids) ? first + boidsPerTeam : nBoids;
+
+    Kokkos::parallel_for(Kokkos::TeamThreadRange(team, first, last), [&](const int& index)
     {
-      boidsData.box_x(iBox) = 0;
-      boidsData.box_y(iBox) = 0;
-      boidsData.box_dx(iBox) = 0;
-      boidsData.box_dy(iBox) = 0;
-    }
+      const value_t x = boidsData.x(index);
+      const value_t y = boidsData.y(index);
+
+      int iBox = pos2box(boidsData.grid, x, y);
+
+      // team members share the histogram
+      Kokkos::atomic_add(&count(iBox), 1);
+
+      boidsData.color(index) = iBox;
+    });
+    team.team_barrier();
+
+    Kokkos::parallel_for(Kokkos::TeamThreadRange(team, nBoxes), [&](const int& iBox)
+    {
+      if (count(iBox) > 0)
+      {
+        Kokkos::atomic_add(&boidsData.boxCount(iBox), count(iBox));
+      }
+    });
+
   });
 
-  // sort boids per color
-  auto permutation = kboids::sort(boidsData.color);
+} // accumulateBoxDataPrivate
 
-  // apply permutation to boids coordinates and displacements
-  kboids::apply_permutation(boidsData.x,  boidsData.tmp, permutation);
-  kboids::apply_permutation(boidsData.y,  boidsData.tmp, permutation);
-  kboids::apply_permutation(boidsData.dx, boidsData.tmp, permutation);
-  kboids::apply_permutation(boidsData.dy, boidsData.tmp, permutation);
+// ===================================================
+// ===================================================
+/**
+ * Box data (populations and offsets) and boids color, boids are not
+ * sorted.
+ */
+void binBoids(BoidsData& boidsData)
+{
 
-   // for (int i = 0; i<100; ++i)
-   //   printf("%d %d | perm=%d |%f %f %d %d\n",i,boidsData.color(i),permutation(i),boidsData.x(i),boidsData.y(i),
-   //          pos2box<0>(boidsData.x(i)),
-   //          pos2box<1>(boidsData.y(i)));
+  boidsData.resetBoxData();
 
+  // compute the number of boids per box and boids color
+  switch (boidsData.accumulation)
+  {
+  case kboids::BoxAccumulation::SCATTER : accumulateBoxDataScatter(boidsData); break;
+  case kboids::BoxAccumulation::PRIVATE : accumulateBoxDataPrivate(boidsData); break;
+  default                               : accumulateBoxDataAtomic(boidsData);  break;
+  }
 
   // compute index to first boids of each color
   // using exclusive scan pattern
-  Kokkos::parallel_scan("Compute BoxIndex", BoidsData::NBOX_X*BoidsData::NBOX_Y,
+  Kokkos::parallel_scan("Compute BoxIndex", boidsData.grid.nBoxes(),
      KOKKOS_LAMBDA(const int iBox,
                    int& update, const bool final)
      {
@@ -172,123 +289,1524 @@ void computeBoxData(BoidsData& boidsData)
        update += iTmp;
      });
 
-  //for (int i = 0; i<BoidsData::NBOX_X*BoidsData::NBOX_Y; ++i)
-  //  printf("%d %d %d | %f %f\n",i,boidsData.boxCount(i),boidsData.boxIndex(i),boidsData.box_x(i),boidsData.box_y(i));
+  //for (int i = 0; i<boidsData.grid.nBoxes(); ++i)
+  //  printf("%d %d %d\n",i,boidsData.boxCount(i),boidsData.boxIndex(i));
+
+} // binBoids
+
+// ===================================================
+// ===================================================
+void computeBoxData(BoidsData& boidsData)
+{
+
+  binBoids(boidsData);
+
+  // sort boids per color : colors are box indexes, so that a stable counting
+  // sort is enough (no comparison sort of colors), boids of a box keep their order
+  auto permutation = boidsData.countingSort.sort(boidsData.color, boidsData.nBoids,
+                                                boidsData.grid.nBoxes());
+
+  // apply permutation to boids coordinates and displacements
+  kboids::apply_permutation(permutation,
+                            kboids::payload(boidsData.pos, boidsData.pos_tmp),
+                            kboids::payload(boidsData.dx,  boidsData.dx_tmp),
+                            kboids::payload(boidsData.dy,  boidsData.dy_tmp));
+  boidsData.setCoordinates();
+
+   // for (int i = 0; i<100; ++i)
+   //   printf("%d %d | perm=%d |%f %f %d %d\n",i,boidsData.color(i),permutation(i),boidsData.x(i),boidsData.y(i),
+   //          pos2box<0>(boidsData.grid,boidsData.x(i)),
+   //          pos2box<1>(boidsData.grid,boidsData.y(i)));
 
 } // computeBoxData
 
 // ===================================================
 // ===================================================
-void updatePositions(BoidsData& boidsData)
+void computeBoxData(BoidsData& boidsData, RefinedGrid& refined)
 {
 
-  // prepare data used in rule #2
-  // i.e. adjust velocity to close neighbors
-  computeBoxData(boidsData);
+  binBoids(boidsData);
 
-  // compute average velocity over all boids
-  auto vel = updateAverageVelocity(boidsData);
-  auto vx = std::get<0>(vel);
-  auto vy = std::get<1>(vel);
+  const Grid& grid = boidsData.grid;
+  const int nBoxes = grid.nBoxes();
+  const int threshold = refined.threshold;
 
-  const float centeringFactor = 0.005;
-  const float matchingFactor = 0.05;
-  const float minDistance = 20;
-  const float avoidFactor = 0.05;
+  // refinement of each box, from its population
+  auto refinement = refined.refinement;
+  auto cellOffset = refined.cellOffset;
 
-  Kokkos::parallel_for("updatePositions", boidsData.nBoids, KOKKOS_LAMBDA(const int& index)
+  int nRefinedBoxes = 0;
+  Kokkos::parallel_reduce("RefinedGrid refinement", nBoxes,
+    KOKKOS_LAMBDA(const int iBox, int& count)
+    {
+      const int r = RefinedGrid::refinement_for(boidsData.boxCount(iBox), threshold);
+      refinement(iBox) = r;
+      count += (r > 1);
+    }, nRefinedBoxes);
+
+  // first cell of each box (exclusive scan), cellOffset(nBoxes) is the number of cells
+  int nCells = 0;
+  Kokkos::parallel_scan("RefinedGrid cell offset", nBoxes+1,
+     KOKKOS_LAMBDA(const int iBox, int& update, const bool final)
+     {
+       const int n = (iBox < nBoxes) ? refinement(iBox)*refinement(iBox) : 0;
+
+       if (final)
+         cellOffset(iBox) = update;
+
+       update += n;
+     }, nCells);
+
+  refined.nCells = nCells;
+  refined.nRefinedBoxes = nRefinedBoxes;
+
+  if (nCells > (int) refined.cellCount.extent(0))
+  {
+    refined.cellCount = RefinedGrid::VecInt("cell count", nCells + nCells/4);
+    refined.cellIndex = RefinedGrid::VecInt("cell index", nCells + nCells/4);
+  }
+
+  Kokkos::deep_copy(refined.cellCount, 0);
+
+  // cell of each boid, and number of boids per cell
+  auto cellKey   = refined.cellKey;
+  auto cellCount = refined.cellCount;
+  Kokkos::parallel_for("RefinedGrid cell key", boidsData.nBoids, KOKKOS_LAMBDA(const int& index)
+  {
+    const int iBox = boidsData.color(index);
+    const int r    = refinement(iBox);
+
+    int bi, bj;
+    grid.cell_coords(iBox, bi, bj);
+
+    int si = (int) floor( (boidsData.x(index) - (grid.xmin + bi*grid.hx())) / grid.hx() * r );
+    int sj = (int) floor( (boidsData.y(index) - (grid.ymin + bj*grid.hy())) / grid.hy() * r );
+    si = (si < 0) ? 0 : ((si >= r) ? r-1 : si);
+    sj = (sj < 0) ? 0 : ((sj >= r) ? r-1 : sj);
+
+    const int cell = cellOffset(iBox) + si + r*sj;
+    cellKey(index) = cell;
+    Kokkos::atomic_increment(&cellCount(cell));
+  });
+
+  // index of the first boid of each cell
+  auto cellIndex = Kokkos::subview(refined.cellIndex, Kokkos::make_pair(0, nCells));
+  Kokkos::parallel_scan("RefinedGrid cell index", nCells,
+     KOKKOS_LAMBDA(const int cell, int& update, const bool final)
+     {
+       const int n = cellCount(cell);
+
+       if (final)
+         cellIndex(cell) = update;
+
+       update += n;
+     });
+
+  // sort boids per cell, cells of a box being contiguous, boids stay sorted
+  // by box
+  auto permutation = boidsData.countingSort.sort(refined.cellKey, boidsData.nBoids, nCells);
+
+  kboids::apply_permutation(permutation,
+                            kboids::payload(boidsData.pos,   boidsData.pos_tmp),
+                            kboids::payload(boidsData.dx,    boidsData.dx_tmp),
+                            kboids::payload(boidsData.dy,    boidsData.dy_tmp),
+                            kboids::payload(boidsData.color, refined.color_tmp));
+  boidsData.setCoordinates();
+
+} // computeBoxData
+
+// ===================================================
+// ===================================================
+int updateBoxData(BoidsData& boidsData, IncrementalBinning& binning)
+{
+
+  const int nBoids = boidsData.nBoids;
+  const int nBoxes = boidsData.grid.nBoxes();
+
+  auto newColor  = binning.newColor;
+  auto moverScan = binning.moverScan;
+  auto movers       = binning.movers;
+  auto moverColor   = binning.moverColor;
+  auto oldIndex     = binning.oldIndex;
+  auto oldCount     = binning.oldCount;
+  auto firstArrival = binning.firstArrival;
+  auto permute      = binning.permutation;
+
+  binning.nSteps++;
+
+  // first call : boids are not sorted yet
+  if (binning.nSteps == 1)
+  {
+    computeBoxData(boidsData);
+    binning.nFullRebuilds++;
+    return nBoids;
+  }
+
+  // detect movers (boids are sorted by their previous box), and list them
+  int nMovers = 0;
+  Kokkos::parallel_scan("rebin detect movers", nBoids+1,
+     KOKKOS_LAMBDA(const int index, int& update, const bool final)
+     {
+       int moved = 0;
+
+       if (index < nBoids)
+       {
+         const int iBox = pos2box(boidsData.grid, boidsData.x(index), boidsData.y(index));
+         moved = (iBox != boidsData.color(index));
+
+         if (final)
+         {
+           newColor(index) = iBox;
+           if (moved)
+             movers(update) = index;
+         }
+       }
+
+       if (final)
+         moverScan(index) = update;
+
+       update += moved;
+     }, nMovers);
+
+  binning.nMovers += nMovers;
+
+  if (nMovers > binning.maxMoverFraction * nBoids)
+  {
+    computeBoxData(boidsData);
+    binning.nFullRebuilds++;
+    return nMovers;
+  }
+
+  // patch box populations with movers only
+  Kokkos::deep_copy(oldIndex, boidsData.boxIndex);
+  Kokkos::deep_copy(oldCount, boidsData.boxCount);
+
+  Kokkos::parallel_for("rebin patch box count", nMovers, KOKKOS_LAMBDA(const int& i)
+  {
+    const int index = movers(i);
+    moverColor(i) = newColor(index);
+    Kokkos::atomic_add(&boidsData.boxCount(boidsData.color(index)), -1);
+    Kokkos::atomic_add(&boidsData.boxCount(newColor(index)), 1);
+  });
+
+  Kokkos::parallel_scan("Compute BoxIndex", nBoxes,
+     KOKKOS_LAMBDA(const int iBox,
+                   int& update, const bool final)
+     {
+       const int iTmp = boidsData.boxCount(iBox);
+
+       if (final)
+         boidsData.boxIndex(iBox) = update;
+
+       update += iTmp;
+     });
+
+  // boids that stayed keep their rank among the boids that stayed in their box
+  Kokkos::parallel_for("rebin stayers", nBoids, KOKKOS_LAMBDA(const int& index)
+  {
+    const int iBox = boidsData.color(index);
+    if (newColor(index) == iBox)
+    {
+      const int first = oldIndex(iBox);
+      const int rank  = (index - first) - (moverScan(index) - moverScan(first));
+      permute(boidsData.boxIndex(iBox) + rank) = index;
+    }
+  });
+
+  // movers sorted by new box, listed by increasing index : the stable sort
+  // keeps arrivals of a box in their previous order (deterministic)
+  auto order = boidsData.countingSort.sort(moverColor, nMovers, nBoxes);
+
+  Kokkos::parallel_for("rebin first arrival", nMovers, KOKKOS_LAMBDA(const int& i)
+  {
+    if (i == 0 or moverColor(i-1) != moverColor(i))
+      firstArrival(moverColor(i)) = i;
+  });
+
+  // movers are appended to their new box
+  Kokkos::parallel_for("rebin movers", nMovers, KOKKOS_LAMBDA(const int& i)
+  {
+    const int index = movers(order(i));
+    const int iBox  = moverColor(i);
+
+    const int first  = oldIndex(iBox);
+    const int last   = first + oldCount(iBox);
+    const int nStay  = oldCount(iBox) - (moverScan(last) - moverScan(first));
+
+    permute(boidsData.boxIndex(iBox) + nStay + (i - firstArrival(iBox))) = index;
+  });
+
+  // colors of sorted boids
+  Kokkos::parallel_for("rebin colors", nBoids, KOKKOS_LAMBDA(const int& i)
+  {
+    boidsData.color(i) = newColor(permute(i));
+  });
+
+  kboids::apply_permutation(permute,
+                            kboids::payload(boidsData.pos, boidsData.pos_tmp),
+                            kboids::payload(boidsData.dx,  boidsData.dx_tmp),
+                            kboids::payload(boidsData.dy,  boidsData.dy_tmp));
+  boidsData.setCoordinates();
+
+  return nMovers;
+
+} // updateBoxData
+
+// ===================================================
+// ===================================================
+/**
+ * Apply the three rules, then move boids. In a periodic domain, boids are not
+ * turned back at the borders but wrapped around.
+ *
+ * \param[in] separation(index, x, y, sep_x, sep_y) computes rule #3
+ * \param[in] cohesion(index, x, y, xg, yg, vxg, vyg) computes the position (rule #1)
+ *            and the velocity (rule #2) each boid is steered to
+ */
+template <typename Separation, typename Cohesion>
+void updateVelocitiesAndPositions(BoidsData& boidsData,
+                                  const Separation& separation,
+                                  const Cohesion& cohesion)
+{
+
+  using compute_t = BoidsData::compute_t;
+
+  const compute_t centeringFactor = 0.005;
+  const compute_t matchingFactor = 0.05;
+  const compute_t avoidFactor = 0.05;
+
+  // velocities first, from the positions of all neighbours at time t;
+  // positions are only moved once all velocities are known
+  Kokkos::parallel_for("updateVelocities", boidsData.nBoids, KOKKOS_LAMBDA(const int& index)
   {
+    const compute_t x = boidsData.x(index);
+    const compute_t y = boidsData.y(index);
+
+    compute_t dx = boidsData.dx(index);
+    compute_t dy = boidsData.dy(index);
+
+    compute_t xc, yc, vx, vy;
+    cohesion(index, x, y, xc, yc, vx, vy);
+
     //
     // rule #1 : flight towards center
     //
-    const auto x = boidsData.x(index);
-    const auto y = boidsData.y(index);
-
-    float dx = boidsData.dx(index);
-    float dy = boidsData.dy(index);
-
-    float xc = (BoidsData::XMIN+BoidsData::XMAX)/2;
-    float yc = (BoidsData::YMIN+BoidsData::YMAX)/2;
     dx += (xc-x) * centeringFactor;
     dy += (yc-y) * centeringFactor;
 
     //
     // rule #2, adjust velocity to average velocity of boids of same color
     //
-    const auto color = boidsData.color(index);
-    //const int nbColors = BoidsData.NBOX_X * BoidsData::NBOX_Y;
-
-    const auto box_dx = boidsData.box_dx(color);
-    const auto box_dy = boidsData.box_dy(color);
-    // const auto xg = boidsData.box_x(color);
-    // const auto yg = boidsData.box_y(color);
-    // dx += (xg-x) * matchingFactor;
-    // dy += (yg-y) * matchingFactor;
-
-    //dx += matchingFactor * (box_dx - boidsData.dx(index));
-    //dy += matchingFactor * (box_dy - boidsData.dy(index));
     dx += matchingFactor * (vx - boidsData.dx(index));
     dy += matchingFactor * (vy - boidsData.dy(index));
 
-    /* float dx_n = 0; */
-    /* float dy_n = 0; */
-    /* { */
-    /*   auto beg = boidsData.boxIndex(color); */
-    /*   auto end = (color == nbColors-1) ? boidsData.nBoids : boidsData.boxIndex(color+1); */
-    /*   for (int i_n=beg; i_n<end; ++i_n) */
-    /*   { */
-    /*   } */
-    /* } */
-
     //
-    // rule #3: avoid neighbor (= move away from local barycenter)
+    // rule #3: avoid neighbors closer than minDistance
     //
-    //auto index_ennemy = boidsData.ennemies(index);
-
-    float dir_x, dir_y;
-
-    const auto box_x = boidsData.box_x(color);
-    const auto box_y = boidsData.box_y(color);
-
-    compute_direction(x,y,
-                      box_x,
-                      box_y,
-                      dir_x, dir_y);
+    compute_t sep_x, sep_y;
+    separation(index, x, y, sep_x, sep_y);
 
-    // compute_direction(x,y,
-    //                   boidsData.x(index_ennemy),
-    //                   boidsData.y(index_ennemy),
-    //                   dir_x, dir_y);
-
-    if(compute_distance(x,y,box_x,box_y)<minDistance)
-    {
-      dx -= dir_x * avoidFactor;
-      dy -= dir_y * avoidFactor;
-    }
+    dx += sep_x * avoidFactor;
+    dy += sep_y * avoidFactor;
 
     // speed limit
     speedLimit(dx,dy);
 
-    keepInTheBox(x,y,dx,dy);
+    if (not boidsData.grid.periodic)
+      keepInTheBox(boidsData.grid,x,y,dx,dy);
 
     // write final results
     boidsData.dx(index) = dx;
     boidsData.dy(index) = dy;
 
-    // final update
-    boidsData.x(index) += boidsData.dx(index);
-    boidsData.y(index) += boidsData.dy(index);
+  });
+
+  Kokkos::parallel_for("updatePositions", boidsData.nBoids, KOKKOS_LAMBDA(const int& index)
+  {
+    // final update (with the stored, i.e. rounded, displacement)
+    using value_t = BoidsData::value_t;
+    const value_t x = value_t(boidsData.x(index)) + value_t(boidsData.dx(index));
+    const value_t y = value_t(boidsData.y(index)) + value_t(boidsData.dy(index));
+
+    // back into a periodic domain
+    boidsData.x(index) = value_t(boidsData.grid.wrap<0>(compute_t(x)));
+    boidsData.y(index) = value_t(boidsData.grid.wrap<1>(compute_t(y)));
 
   });
 
+} // updateVelocitiesAndPositions
+
+// ===================================================
+// ===================================================
+/**
+ * Same as above, boids are steered to the domain center (rule #1) and to the
+ * flock mean velocity (rule #2, flock statistics must be up to date).
+ *
+ * A periodic domain has no center : rule #1 is off, so that density stays
+ * uniform.
+ */
+template <typename Separation>
+void updateVelocitiesAndPositions(BoidsData& boidsData,
+                                  const Separation& separation)
+{
+
+  using compute_t = BoidsData::compute_t;
+  using stats_t   = BoidsData::FlockStats_t;
+
+  updateVelocitiesAndPositions(boidsData, separation,
+    KOKKOS_LAMBDA(int, compute_t x, compute_t y,
+                  compute_t& xg, compute_t& yg, compute_t& vxg, compute_t& vyg)
+    {
+      xg = boidsData.grid.periodic ? x : boidsData.grid.xc();
+      yg = boidsData.grid.periodic ? y : boidsData.grid.yc();
+
+      // average velocity, from flock statistics in device memory
+      vxg = boidsData.stats().mean(stats_t::DX, boidsData.nBoids);
+      vyg = boidsData.stats().mean(stats_t::DY, boidsData.nBoids);
+    });
+
+} // updateVelocitiesAndPositions
+
+// ===================================================
+// ===================================================
+/**
+ * Apply the rules (separation from a cell list walk) and move boids, boids must
+ * be sorted by box, drift is their largest displacement since then.
+ */
+void updatePositionsFromBoxes(BoidsData& boidsData, BoidsData::compute_t drift = 0)
+{
+
+  // compute average velocity over all boids
+  updateFlockStats(boidsData);
+
+  using compute_t = BoidsData::compute_t;
+
+  const compute_t minDistance = boidsData.minDistance;
+
+  // boxes to visit for the separation rule (cell list walk)
+  const int rx = boidsData.grid.ring_x(boidsData.minDistance + 2*drift);
+  const int ry = boidsData.grid.ring_y(boidsData.minDistance + 2*drift);
+
+  updateVelocitiesAndPositions(boidsData,
+    KOKKOS_LAMBDA(int index, compute_t x, compute_t y, compute_t& sep_x, compute_t& sep_y)
+    {
+      separation<compute_t>(boidsData, index, x, y, minDistance, rx, ry, sep_x, sep_y, drift);
+    });
+
+} // updatePositionsFromBoxes
+
+// ===================================================
+// ===================================================
+void updatePositions(BoidsData& boidsData)
+{
+
+  // prepare data used in rule #2
+  // i.e. adjust velocity to close neighbors
+  computeBoxData(boidsData);
+
+  updatePositionsFromBoxes(boidsData);
+
 } // updatePositions
 
 // ===================================================
 // ===================================================
-void copyPositionsForRendering(BoidsData& boidsData)
+void updatePositions(BoidsData& boidsData, RefinedGrid& refined)
 {
 
-#ifdef FORGE_ENABLED
+  computeBoxData(boidsData, refined);
+
+  updateFlockStats(boidsData);
+
+  using compute_t = BoidsData::compute_t;
+
+  const compute_t minDistance = boidsData.minDistance;
+
+  const int rx = boidsData.grid.ring_x(boidsData.minDistance);
+  const int ry = boidsData.grid.ring_y(boidsData.minDistance);
+
+  updateVelocitiesAndPositions(boidsData,
+    KOKKOS_LAMBDA(int index, compute_t x, compute_t y, compute_t& sep_x, compute_t& sep_y)
+    {
+      separation<compute_t>(boidsData, refined, index, x, y, minDistance, rx, ry, sep_x, sep_y);
+    });
+
+} // updatePositions
+
+// ===================================================
+// ===================================================
+void findNearestNeighbours(BoidsData& boidsData, NearestNeighbours& knn)
+{
+
+  using compute_t = BoidsData::compute_t;
+
+  computeBoxData(boidsData);
+
+  const Grid& grid = boidsData.grid;
+  const int k = knn.k;
+  auto neighbours = knn.neighbours;
+
+  double nRings = 0;
+
+  Kokkos::parallel_reduce("findNearestNeighbours", boidsData.nBoids,
+    KOKKOS_LAMBDA(const int& index, double& rings)
+    {
+      const compute_t x = boidsData.x(index);
+      const compute_t y = boidsData.y(index);
+
+      const compute_t hx = grid.hx();
+      const compute_t hy = grid.hy();
+
+      int bi, bj;
+      grid.cell_coords(boidsData.color(index), bi, bj);
+
+      // boxes on each side of the box of the boid : up to the grid borders, or
+      // half the periodic domain (ghost boxes, each box being visited once)
+      const int loX = grid.periodic ? (grid.nx-1)/2 : bi;
+      const int hiX = grid.periodic ? grid.nx/2     : grid.nx-1-bi;
+      const int loY = grid.periodic ? (grid.ny-1)/2 : bj;
+      const int hiY = grid.periodic ? grid.ny/2     : grid.ny-1-bj;
+
+      // k nearest found so far, nearest first
+      int       best[NearestNeighbours::MAX_K];
+      compute_t bestD2[NearestNeighbours::MAX_K];
+      int n = 0;
+
+      for (int r = 0; ; ++r)
+      {
+        for (int oj = -r; oj <= r; ++oj)
+        {
+          if (oj < -loY or oj > hiY)
+            continue;
+
+          // inner rows of the ring : only its first and last boxes
+          const int step = (oj == -r or oj == r) ? 1 : 2*r;
+
+          for (int oi = -r; oi <= r; oi += step)
+          {
+            if (oi < -loX or oi > hiX)
+              continue;
+
+            // box (i,j), a ghost box if out of the grid (periodic domain)
+            const int i = bi+oi;
+            const int j = bj+oj;
+
+            // skip boxes farther than the k-th neighbour (border boxes extend to infinity)
+            if (n == k)
+            {
+              compute_t ddx = grid.box_distance<0>(x, i);
+              compute_t ddy = grid.box_distance<1>(y, j);
+
+              // the ghost of a box half the periodic domain away may not be its closest image
+              if (grid.periodic and 2*oi >= grid.nx) ddx = 0;
+              if (grid.periodic and 2*oj >= grid.ny) ddy = 0;
+
+              if (ddx*ddx + ddy*ddy >= bestD2[k-1])
+                continue;
+            }
+
+            const int jBox  = grid.cell(grid.wrap_box<0>(i), grid.wrap_box<1>(j));
+            const int first = boidsData.boxIndex(jBox);
+            const int last  = first + boidsData.boxCount(jBox);
+
+            for (int m = first; m < last; ++m)
+            {
+              if (m == index)
+                continue;
+
+              compute_t xm, ym;
+              neighbourPosition<compute_t>(boidsData, m, x, y, xm, ym);
+              const compute_t d2 = (xm-x)*(xm-x) + (ym-y)*(ym-y);
+
+              if (n == k and d2 >= bestD2[k-1])
+                continue;
+
+              // insertion, dropping the farthest when full
+              int p = (n < k) ? n++ : k-1;
+              while (p > 0 and bestD2[p-1] > d2)
+              {
+                best[p]   = best[p-1];
+                bestD2[p] = bestD2[p-1];
+                --p;
+              }
+              best[p]   = m;
+              bestD2[p] = d2;
+            }
+          }
+        }
+
+        // distance from (x,y) to the boxes outside rings 0..r (none beyond the grid)
+        const bool left   = r < loX;
+        const bool right  = r < hiX;
+        const bool bottom = r < loY;
+        const bool top    = r < hiY;
+
+        if (not (left or right or bottom or top))
+        {
+          rings += r+1;
+          break;
+        }
+
+        // in a periodic domain, boxes left on one side may be closer through the other
+        const bool wrapX = grid.periodic and (left or right);
+        const bool wrapY = grid.periodic and (bottom or top);
+
+        compute_t reach = Kokkos::reduction_identity<compute_t>::min();
+        if (left   or wrapX) reach = fmin(reach, x - (grid.xmin + (bi-r)*hx));
+        if (right  or wrapX) reach = fmin(reach, (grid.xmin + (bi+r+1)*hx) - x);
+        if (bottom or wrapY) reach = fmin(reach, y - (grid.ymin + (bj-r)*hy));
+        if (top    or wrapY) reach = fmin(reach, (grid.ymin + (bj+r+1)*hy) - y);
+
+        if (n == k and reach > 0 and bestD2[k-1] <= reach*reach)
+        {
+          rings += r+1;
+          break;
+        }
+      }
+
+      for (int m = 0; m < k; ++m)
+        neighbours(index, m) = (m < n) ? best[m] : -1;
+    }, nRings);
+
+  knn.nSteps++;
+  knn.nRings += nRings / boidsData.nBoids;
+
+} // findNearestNeighbours
+
+// ===================================================
+// ===================================================
+void updatePositionsFromNeighbours(BoidsData& boidsData, const NearestNeighbours& knn)
+{
+
+  using compute_t = BoidsData::compute_t;
+
+  updateFlockStats(boidsData);
+
+  const compute_t minDistance = boidsData.minDistance;
+  const int k = knn.k;
+  auto neighbours = knn.neighbours;
+
+  // velocities at time t : the velocity kernel overwrites dx, dy in place
+  auto dx0 = boidsData.dx_tmp;
+  auto dy0 = boidsData.dy_tmp;
+  Kokkos::deep_copy(dx0, boidsData.dx);
+  Kokkos::deep_copy(dy0, boidsData.dy);
+
+  updateVelocitiesAndPositions(boidsData,
+    KOKKOS_LAMBDA(int index, compute_t x, compute_t y, compute_t& sep_x, compute_t& sep_y)
+    {
+      sep_x = 0;
+      sep_y = 0;
+
+      for (int m = 0; m < k; ++m)
+      {
+        const int j = neighbours(index, m);
+        if (j < 0)
+          continue;
+
+        compute_t xj, yj;
+        neighbourPosition<compute_t>(boidsData, j, x, y, xj, yj);
+        addSeparation<compute_t>(x, y, xj, yj, minDistance, sep_x, sep_y);
+      }
+    },
+    KOKKOS_LAMBDA(int index, compute_t x, compute_t y,
+                  compute_t& xg, compute_t& yg, compute_t& vxg, compute_t& vyg)
+    {
+      xg = 0; yg = 0; vxg = 0; vyg = 0;
+
+      int n = 0;
+      for (int m = 0; m < k; ++m)
+      {
+        const int j = neighbours(index, m);
+        if (j < 0)
+          continue;
+
+        compute_t xj, yj;
+        neighbourPosition<compute_t>(boidsData, j, x, y, xj, yj);
+
+        xg  += xj;
+        yg  += yj;
+        vxg += compute_t(dx0(j));
+        vyg += compute_t(dy0(j));
+        ++n;
+      }
+
+      if (n > 0)
+      {
+        xg /= n; yg /= n; vxg /= n; vyg /= n;
+      }
+      else
+      {
+        // no neighbour : no steering
+        xg  = x;
+        yg  = y;
+        vxg = compute_t(dx0(index));
+        vyg = compute_t(dy0(index));
+      }
+    });
+
+} // updatePositionsFromNeighbours
+
+// ===================================================
+// ===================================================
+void updatePositions(BoidsData& boidsData, NearestNeighbours& knn)
+{
+
+  findNearestNeighbours(boidsData, knn);
+
+  updatePositionsFromNeighbours(boidsData, knn);
+
+} // updatePositions
+
+// ===================================================
+// ===================================================
+void computeSeparationTiled(BoidsData& boidsData, SeparationTiles& tiles)
+{
+
+  using compute_t = BoidsData::compute_t;
+
+  using team_policy_t = Kokkos::TeamPolicy<>;
+  using member_t      = team_policy_t::member_type;
+  using scratch_t     = Kokkos::DefaultExecutionSpace::scratch_memory_space;
+
+  using ScratchCompute = Kokkos::View<compute_t*, scratch_t, Kokkos::MemoryTraits<Kokkos::Unmanaged>>;
+
+  const Grid& grid = boidsData.grid;
+  const compute_t minDistance = boidsData.minDistance;
+
+  const int rx = grid.ring_x(boidsData.minDistance);
+  const int ry = grid.ring_y(boidsData.minDistance);
+
+  const int capacity = tiles.capacity;
+  auto sep_x = tiles.sep_x;
+  auto sep_y = tiles.sep_y;
+
+  const size_t scratch_size = 2*ScratchCompute::shmem_size(capacity);
+
+  auto policy = team_policy_t(grid.nBoxes(), Kokkos::AUTO)
+    .set_scratch_size(0, Kokkos::PerTeam(scratch_size));
+
+  // number of non empty boxes, and of boxes whose stencil overflows scratch memory
+  Array_t<double,2> count;
+
+  Kokkos::parallel_reduce("separation tiled", policy,
+    KOKKOS_LAMBDA(const member_t& team, Array_t<double,2>& boxes)
+    {
+      const int iBox  = team.league_rank();
+      const int first = boidsData.boxIndex(iBox);
+      const int n     = boidsData.boxCount(iBox);
+
+      if (n == 0)
+        return;
+
+      int bi, bj;
+      grid.cell_coords(iBox, bi, bj);
+
+      int imin, imax, jmin, jmax;
+      grid.box_range<0>(bi, rx, imin, imax);
+      grid.box_range<1>(bj, ry, jmin, jmax);
+
+      const compute_t hx = grid.hx();
+      const compute_t hy = grid.hy();
+      const compute_t d2max = minDistance*minDistance;
+
+      // stencil : boxes that may hold neighbours of a boid of box iBox
+      auto inStencil = [&](int i, int j)
+      {
+        const int gx = (i > bi+1) ? i-bi-1 : ((i < bi-1) ? bi-1-i : 0);
+        const int gy = (j > bj+1) ? j-bj-1 : ((j < bj-1) ? bj-1-j : 0);
+        return (gx*hx)*(gx*hx) + (gy*hy)*(gy*hy) <= d2max;
+      };
+
+      // box (i,j) of the stencil, possibly a ghost box (periodic domain)
+      auto stencilBox = [&](int i, int j)
+      {
+        return grid.cell(grid.wrap_box<0>(i), grid.wrap_box<1>(j));
+      };
+
+      int nStaged = 0;
+      for (int j=jmin; j<=jmax; ++j)
+        for (int i=imin; i<=imax; ++i)
+          if (inStencil(i, j))
+            nStaged += boidsData.boxCount(stencilBox(i, j));
+
+      Kokkos::single(Kokkos::PerTeam(team), [&]()
+      {
+        boxes.data[0] += 1;
+        boxes.data[1] += (nStaged > capacity);
+      });
+
+      // a stencil spanning the whole periodic domain has no single image of
+      // its boxes : neighbours are then taken at their closest image instead
+      const bool spans = grid.spans_domain<0>(rx) or grid.spans_domain<1>(ry);
+
+      if (nStaged > capacity or spans)
+      {
+        // overflow : neighbours read from main memory
+        Kokkos::parallel_for(Kokkos::TeamThreadRange(team, first, first+n), [&](const int& index)
+        {
+          const compute_t x = boidsData.x(index);
+          const compute_t y = boidsData.y(index);
+
+          compute_t sx, sy;
+          separation<compute_t>(boidsData, index, x, y, minDistance, rx, ry, sx, sy);
+          sep_x(index) = sx;
+          sep_y(index) = sy;
+        });
+        return;
+      }
+
+      // stage stencil positions, shifted to the ghost boxes of a periodic
+      // domain; self is the first staged boid of box iBox
+      ScratchCompute xs(team.team_scratch(0), capacity);
+      ScratchCompute ys(team.team_scratch(0), capacity);
+
+      int offset = 0;
+      int self   = 0;
+      for (int j=jmin; j<=jmax; ++j)
+        for (int i=imin; i<=imax; ++i)
+        {
+          if (not inStencil(i, j))
+            continue;
+
+          const int jBox   = stencilBox(i, j);
+          const int kFirst = boidsData.boxIndex(jBox);
+          const int m      = boidsData.boxCount(jBox);
+
+          if (i == bi and j == bj)
+            self = offset;
+
+          const compute_t shift_x = (i - grid.wrap_box<0>(i)) * hx;
+          const compute_t shift_y = (j - grid.wrap_box<1>(j)) * hy;
+
+          Kokkos::parallel_for(Kokkos::TeamThreadRange(team, m), [&](const int& k)
+          {
+            xs(offset+k) = compute_t(boidsData.x(kFirst+k)) + shift_x;
+            ys(offset+k) = compute_t(boidsData.y(kFirst+k)) + shift_y;
+          });
+
+          offset += m;
+        }
+      team.team_barrier();
+
+      // all pairs from scratch memory
+      Kokkos::parallel_for(Kokkos::TeamThreadRange(team, n), [&](const int& i)
+      {
+        const compute_t x = xs(self+i);
+        const compute_t y = ys(self+i);
+
+        compute_t sx = 0, sy = 0;
+        for (int k=0; k<nStaged; ++k)
+          if (k != self+i)
+            addSeparation<compute_t>(x, y, xs(k), ys(k), minDistance, sx, sy);
+
+        sep_x(first+i) = sx;
+        sep_y(first+i) = sy;
+      });
+    }, count);
+
+  tiles.nSteps++;
+  tiles.nBoxes     += count.data[0];
+  tiles.nOverflows += count.data[1];
+
+} // computeSeparationTiled
+
+// ===================================================
+// ===================================================
+void updatePositions(BoidsData& boidsData, SeparationTiles& tiles)
+{
+
+  using compute_t = BoidsData::compute_t;
+
+  computeBoxData(boidsData);
+
+  updateFlockStats(boidsData);
+
+  computeSeparationTiled(boidsData, tiles);
+
+  auto sep_x = tiles.sep_x;
+  auto sep_y = tiles.sep_y;
+
+  updateVelocitiesAndPositions(boidsData,
+    KOKKOS_LAMBDA(int index, compute_t, compute_t, compute_t& sx, compute_t& sy)
+    {
+      sx = sep_x(index);
+      sy = sep_y(index);
+    });
+
+} // updatePositions
+
+// ===================================================
+// ===================================================
+void updatePositions(BoidsData& boidsData, IncrementalBinning& binning)
+{
+
+  updateBoxData(boidsData, binning);
+
+  updatePositionsFromBoxes(boidsData);
+
+} // updatePositions
+
+// ===================================================
+// ===================================================
+bool updatePositions(BoidsData& boidsData, AdaptiveSort& adaptiveSort)
+{
+
+  using compute_t = BoidsData::compute_t;
+
+  adaptiveSort.nSteps++;
+
+  bool sort = (adaptiveSort.nSorts == 0);
+  compute_t drift = 0;
+
+  if (not sort)
+  {
+    // sortedness : boids out of the box they are stored in
+    int nOut = 0;
+    Kokkos::parallel_reduce("adaptiveSort out of box", boidsData.nBoids,
+      KOKKOS_LAMBDA(const int& index, int& count)
+      {
+        count += (pos2box(boidsData.grid, boidsData.x(index), boidsData.y(index)) != boidsData.color(index));
+      }, nOut);
+
+    drift = maxDisplacement(boidsData, adaptiveSort.x0, adaptiveSort.y0);
+
+    const compute_t hmin = fmin(boidsData.grid.hx(), boidsData.grid.hy());
+    const double outOfBox = double(nOut) / boidsData.nBoids;
+
+    const bool tooManyOut = outOfBox > adaptiveSort.threshold;
+    const bool tooFar     = drift > hmin / 2;
+
+    sort = tooManyOut or tooFar;
+
+    if (sort)
+      adaptiveSort.outOfBoxAtSort += outOfBox;
+
+    if (tooFar and not tooManyOut)
+      adaptiveSort.nDriftSorts++;
+
+    // per step fraction of boids changing box
+    if (adaptiveSort.stepsSinceSort == 1)
+    {
+      adaptiveSort.outOfBoxFirstStep += outOfBox;
+      adaptiveSort.nFirstSteps++;
+    }
+  }
+
+  if (sort)
+  {
+    computeBoxData(boidsData);
+
+    Kokkos::deep_copy(adaptiveSort.x0, boidsData.x);
+    Kokkos::deep_copy(adaptiveSort.y0, boidsData.y);
+
+    adaptiveSort.nSorts++;
+    drift = 0;
+  }
+
+  adaptiveSort.drift = drift;
+
+  updatePositionsFromBoxes(boidsData, drift);
+
+  adaptiveSort.stepsSinceSort = sort ? 1 : adaptiveSort.stepsSinceSort + 1;
+
+  return sort;
+
+} // updatePositions
+
+// ===================================================
+// ===================================================
+void buildVerletList(BoidsData& boidsData, VerletList& verlet)
+{
+
+  using compute_t = BoidsData::compute_t;
+
+  // sort boids by box
+  computeBoxData(boidsData);
+
+  const compute_t cutoff = boidsData.minDistance + verlet.skin;
+
+  const int rx = boidsData.grid.ring_x(cutoff);
+  const int ry = boidsData.grid.ring_y(cutoff);
+
+  auto offset     = verlet.offset;
+  const int nBoids = boidsData.nBoids;
+
+  // count neighbours of each boid
+  Kokkos::parallel_for("buildVerletList count", nBoids, KOKKOS_LAMBDA(const int& index)
+  {
+    const compute_t x = boidsData.x(index);
+    const compute_t y = boidsData.y(index);
+
+    int n = 0;
+    forEachNeighbourCandidate(boidsData, index, x, y, cutoff, rx, ry,
+      [&](int k)
+      {
+        compute_t xk, yk;
+        neighbourPosition<compute_t>(boidsData, k, x, y, xk, yk);
+        if (compute_distance<compute_t>(x, y, xk, yk) < cutoff)
+          ++n;
+      });
+
+    offset(index) = n;
+  });
+
+  // counts to offsets (exclusive scan), offset(nBoids) is the number of pairs
+  int nPairs = 0;
+  Kokkos::parallel_scan("buildVerletList offset", nBoids+1,
+     KOKKOS_LAMBDA(const int index, int& update, const bool final)
+     {
+       const int n = (index < nBoids) ? offset(index) : 0;
+
+       if (final)
+         offset(index) = update;
+
+       update += n;
+     }, nPairs);
+
+  if (nPairs > (int) verlet.neighbours.extent(0))
+    verlet.neighbours = VerletList::VecInt("neighbours", nPairs + nPairs/4);
+
+  // fill lists (same walk as counting)
+  auto neighbours = verlet.neighbours;
+  Kokkos::parallel_for("buildVerletList fill", nBoids, KOKKOS_LAMBDA(const int& index)
+  {
+    const compute_t x = boidsData.x(index);
+    const compute_t y = boidsData.y(index);
+
+    int i = offset(index);
+    forEachNeighbourCandidate(boidsData, index, x, y, cutoff, rx, ry,
+      [&](int k)
+      {
+        compute_t xk, yk;
+        neighbourPosition<compute_t>(boidsData, k, x, y, xk, yk);
+        if (compute_distance<compute_t>(x, y, xk, yk) < cutoff)
+          neighbours(i++) = k;
+      });
+  });
+
+  // reference positions for displacement tracking
+  auto x0 = verlet.x0;
+  auto y0 = verlet.y0;
+  Kokkos::parallel_for("Verlet reference positions", boidsData.nBoids, KOKKOS_LAMBDA(const int& index)
+  {
+    x0(index) = boidsData.x(index);
+    y0(index) = boidsData.y(index);
+  });
+
+  verlet.nBuilds++;
+
+} // buildVerletList
+
+// ===================================================
+// ===================================================
+BoidsData::compute_t maxDisplacement(const BoidsData& boidsData,
+                                     const BoidsData::VecValue& x0,
+                                     const BoidsData::VecValue& y0)
+{
+
+  using compute_t = BoidsData::compute_t;
+
+  compute_t max_d2 = 0;
+
+  Kokkos::parallel_reduce("maxDisplacement", boidsData.nBoids,
+    KOKKOS_LAMBDA(const int& index, compute_t& value)
+    {
+      // (closest image of the reference position in a periodic domain)
+      const compute_t x = boidsData.x(index);
+      const compute_t y = boidsData.y(index);
+      const compute_t ddx = x - boidsData.grid.image<0>(x, compute_t(x0(index)));
+      const compute_t ddy = y - boidsData.grid.image<1>(y, compute_t(y0(index)));
+      const compute_t d2 = ddx*ddx + ddy*ddy;
+      value = (d2 > value) ? d2 : value;
+    }, Kokkos::Max<compute_t>(max_d2));
+
+  return sqrt(max_d2);
+
+} // maxDisplacement
+
+// ===================================================
+// ===================================================
+bool updatePositions(BoidsData& boidsData, VerletList& verlet)
+{
+
+  // lists are valid as long as no boid moved by more than half the skin
+  const bool rebuild = verlet.nBuilds == 0 or
+    maxDisplacement(boidsData, verlet.x0, verlet.y0) > verlet.skin / 2;
+
+  if (rebuild)
+    buildVerletList(boidsData, verlet);
+
+  verlet.nSteps++;
+
+  // compute average velocity over all boids
+  updateFlockStats(boidsData);
+
+  using compute_t = BoidsData::compute_t;
+
+  const compute_t minDistance = boidsData.minDistance;
+
+  const VerletList lists = verlet;
+
+  updateVelocitiesAndPositions(boidsData,
+    KOKKOS_LAMBDA(int index, compute_t x, compute_t y, compute_t& sep_x, compute_t& sep_y)
+    {
+      separation<compute_t>(boidsData, lists, index, x, y, minDistance, sep_x, sep_y);
+    });
+
+  return rebuild;
+
+} // updatePositions
+
+// ===================================================
+// ===================================================
+void buildQuadTree(BoidsData& boidsData, QuadTree& tree)
+{
+
+  using compute_t = BoidsData::compute_t;
+  using value_t   = BoidsData::value_t;
+
+  const int nBoids = boidsData.nBoids;
+
+  // root cell : bounding square of the flock, from flock statistics in device memory
+  Kokkos::parallel_for("buildQuadTree bounds", 1, KOKKOS_LAMBDA(const int&)
+  {
+    const auto& s = boidsData.stats();
+    const compute_t size = fmax(s.xmax - s.xmin, s.ymax - s.ymin);
+
+    tree.bounds(0) = s.xmin;
+    tree.bounds(1) = s.ymin;
+    tree.bounds(2) = (size > 0) ? size : 1;
+  });
+
+  // leaf of each boid, and number of boids per leaf
+  Kokkos::deep_copy(tree.leafCount, 0);
+
+  Kokkos::parallel_for("buildQuadTree leaves", nBoids, KOKKOS_LAMBDA(const int& index)
+  {
+    const int key = tree.leaf(boidsData.x(index), boidsData.y(index));
+    tree.leafKey(index) = key;
+    Kokkos::atomic_increment(&tree.leafCount(key));
+  });
+
+  Kokkos::parallel_scan("buildQuadTree leaf offset", tree.nLeaves,
+     KOKKOS_LAMBDA(const int leaf, int& update, const bool final)
+     {
+       const int n = tree.leafCount(leaf);
+
+       if (final)
+         tree.leafOffset(leaf) = update;
+
+       update += n;
+     });
+
+  // boids sorted by leaf; as they already are sorted by box along a Z-order
+  // curve (see Grid::setCellOrder), the gather below is mostly contiguous
+  tree.boid = tree.countingSort.sort(tree.leafKey, nBoids, tree.nLeaves);
+
+  Kokkos::parallel_for("buildQuadTree gather", nBoids, KOKKOS_LAMBDA(const int& i)
+  {
+    const int index = tree.boid(i);
+    tree.x(i)  = compute_t(boidsData.x(index));
+    tree.y(i)  = compute_t(boidsData.y(index));
+    tree.dx(i) = compute_t(boidsData.dx(index));
+    tree.dy(i) = compute_t(boidsData.dy(index));
+  });
+
+  // leaves
+  Kokkos::parallel_for("buildQuadTree leaf cells", tree.nLeaves, KOKKOS_LAMBDA(const int& leaf)
+  {
+    const int cell  = QuadTree::levelOffset(tree.depth) + leaf;
+    const int first = tree.leafOffset(leaf);
+    const int n     = tree.leafCount(leaf);
+
+    value_t sx = 0, sy = 0, sdx = 0, sdy = 0;
+    for (int i = first; i < first + n; ++i)
+    {
+      sx  += tree.x(i);
+      sy  += tree.y(i);
+      sdx += tree.dx(i);
+      sdy += tree.dy(i);
+    }
+
+    tree.count(cell) = n;
+    tree.cx(cell)  = (n > 0) ? sx/n  : 0;
+    tree.cy(cell)  = (n > 0) ? sy/n  : 0;
+    tree.cdx(cell) = (n > 0) ? sdx/n : 0;
+    tree.cdy(cell) = (n > 0) ? sdy/n : 0;
+  });
+
+  // other levels, from their 4 children
+  for (int l = tree.depth-1; l >= 0; --l)
+  {
+    Kokkos::parallel_for("buildQuadTree cells", 1 << (2*l), KOKKOS_LAMBDA(const int& c)
+    {
+      const int cell  = QuadTree::levelOffset(l) + c;
+      const int child = QuadTree::levelOffset(l+1) + 4*c;
+
+      int n = 0;
+      value_t sx = 0, sy = 0, sdx = 0, sdy = 0;
+      for (int k = 0; k < 4; ++k)
+      {
+        const int m = tree.count(child+k);
+        n   += m;
+        sx  += m * tree.cx(child+k);
+        sy  += m * tree.cy(child+k);
+        sdx += m * tree.cdx(child+k);
+        sdy += m * tree.cdy(child+k);
+      }
+
+      tree.count(cell) = n;
+      tree.cx(cell)  = (n > 0) ? sx/n  : 0;
+      tree.cy(cell)  = (n > 0) ? sy/n  : 0;
+      tree.cdx(cell) = (n > 0) ? sdx/n : 0;
+      tree.cdy(cell) = (n > 0) ? sdy/n : 0;
+    });
+  }
+
+} // buildQuadTree
+
+// ===================================================
+// ===================================================
+void updatePositions(BoidsData& boidsData, QuadTree& tree)
+{
+
+  using compute_t = BoidsData::compute_t;
+
+  // boids sorted by box, for the separation rule
+  computeBoxData(boidsData);
+
+  // flock bounding box, for the root cell
+  updateFlockStats(boidsData);
+
+  buildQuadTree(boidsData, tree);
+
+  const compute_t minDistance = boidsData.minDistance;
+
+  const int rx = boidsData.grid.ring_x(boidsData.minDistance);
+  const int ry = boidsData.grid.ring_y(boidsData.minDistance);
+
+  updateVelocitiesAndPositions(boidsData,
+    KOKKOS_LAMBDA(int index, compute_t x, compute_t y, compute_t& sep_x, compute_t& sep_y)
+    {
+      separation<compute_t>(boidsData, index, x, y, minDistance, rx, ry, sep_x, sep_y);
+    },
+    KOKKOS_LAMBDA(int index, compute_t x, compute_t y,
+                  compute_t& xg, compute_t& yg, compute_t& vxg, compute_t& vyg)
+    {
+      barnesHutCohesion<compute_t>(tree, index, x, y,
+                                   compute_t(boidsData.dx(index)), compute_t(boidsData.dy(index)),
+                                   minDistance, xg, yg, vxg, vyg);
+    });
+
+} // updatePositions
+
+// ===================================================
+// ===================================================
+double barnesHutTraversal(BoidsData& boidsData, const QuadTree& tree)
+{
+
+  using compute_t = BoidsData::compute_t;
+
+  const compute_t softening = boidsData.minDistance;
+
+  double nInteractions = 0;
+
+  Kokkos::parallel_reduce("barnesHutTraversal", boidsData.nBoids,
+    KOKKOS_LAMBDA(const int& index, double& count)
+    {
+      compute_t xg, yg, vxg, vyg;
+      count += barnesHutCohesion<compute_t>(tree, index,
+                                            boidsData.x(index), boidsData.y(index),
+                                            compute_t(boidsData.dx(index)), compute_t(boidsData.dy(index)),
+                                            softening, xg, yg, vxg, vyg);
+    }, nInteractions);
+
+  return nInteractions / boidsData.nBoids;
+
+} // barnesHutTraversal
+
+// ===================================================
+// ===================================================
+void barnesHutError(BoidsData& boidsData, const QuadTree& tree, int nSamples,
+                    double& cohesionError, double& alignmentError)
+{
+
+  using compute_t = BoidsData::compute_t;
+  using result_t  = Array_t<double,4>;
+
+  const int nBoids = boidsData.nBoids;
+  const compute_t s2 = boidsData.minDistance * boidsData.minDistance;
+
+  nSamples = (nSamples < nBoids) ? nSamples : nBoids;
+  const int stride = nBoids / nSamples;
+
+  // squared errors and squared norms of the exact targets (cohesion, alignment)
+  enum { COHESION_ERROR = 0, ALIGNMENT_ERROR = 1, COHESION_NORM = 2, ALIGNMENT_NORM = 3 };
+
+  result_t sums;
+
+  Kokkos::parallel_reduce("barnesHutError", nSamples,
+    KOKKOS_LAMBDA(const int& iSample, result_t& sum)
+    {
+      const int index = iSample * stride;
+
+      const compute_t x  = boidsData.x(index);
+      const compute_t y  = boidsData.y(index);
+      const compute_t vx = boidsData.dx(index);
+      const compute_t vy = boidsData.dy(index);
+
+      compute_t xg, yg, vxg, vyg;
+      barnesHutCohesion<compute_t>(tree, index, x, y, vx, vy, boidsData.minDistance,
+                                   xg, yg, vxg, vyg);
+
+      // exact sum over all other boids
+      double w = 0, wx = 0, wy = 0, wvx = 0, wvy = 0;
+      for (int k = 0; k < nBoids; ++k)
+      {
+        if (k == index)
+          continue;
+
+        const double xk = compute_t(boidsData.x(k));
+        const double yk = compute_t(boidsData.y(k));
+        const double wk = 1 / ((xk-x)*(xk-x) + (yk-y)*(yk-y) + s2);
+        w   += wk;
+        wx  += wk * xk;
+        wy  += wk * yk;
+        wvx += wk * compute_t(boidsData.dx(k));
+        wvy += wk * compute_t(boidsData.dy(k));
+      }
+
+      const double ex  = (w > 0) ? wx/w  - x  : 0;
+      const double ey  = (w > 0) ? wy/w  - y  : 0;
+      const double evx = (w > 0) ? wvx/w - vx : 0;
+      const double evy = (w > 0) ? wvy/w - vy : 0;
+
+      sum.data[COHESION_ERROR]  += SQR(xg-x - ex) + SQR(yg-y - ey);
+      sum.data[ALIGNMENT_ERROR] += SQR(vxg-vx - evx) + SQR(vyg-vy - evy);
+      sum.data[COHESION_NORM]   += SQR(ex) + SQR(ey);
+      sum.data[ALIGNMENT_NORM]  += SQR(evx) + SQR(evy);
+    }, sums);
+
+  cohesionError  = sqrt(sums.data[COHESION_ERROR]  / sums.data[COHESION_NORM]);
+  alignmentError = sqrt(sums.data[ALIGNMENT_ERROR] / sums.data[ALIGNMENT_NORM]);
+
+} // barnesHutError
+
+// ===================================================
+// ===================================================
+//! neighbour candidates from the boxes of the grid (see forEachNeighbourCandidate)
+struct BoxWalk
+{
+  BoidsData boidsData;
+
+  template <typename T, typename Function>
+  KOKKOS_INLINE_FUNCTION
+  void operator()(int index, T x, T y, T distance, int rx, int ry, const Function& f) const
+  {
+    forEachNeighbourCandidate(boidsData, index, x, y, distance, rx, ry, f);
+  }
+};
+
+//! neighbour candidates from the cells of refined boxes
+struct RefinedWalk
+{
+  BoidsData boidsData;
+  RefinedGrid refined;
+
+  template <typename T, typename Function>
+  KOKKOS_INLINE_FUNCTION
+  void operator()(int index, T x, T y, T distance, int rx, int ry, const Function& f) const
+  {
+    forEachNeighbourCandidate(boidsData, refined, index, x, y, distance, rx, ry, f);
+  }
+};
+
+// ===================================================
+// ===================================================
+/**
+ * Mean number of distance tests and of actual neighbours per boid in the
+ * separation rule, neighbour candidates given by walk.
+ */
+template <typename Walk>
+void countNeighbours(BoidsData& boidsData, const Walk& walk,
+                     double& testsPerBoid, double& neighboursPerBoid)
+{
+
+  using compute_t = BoidsData::compute_t;
+
+  const compute_t minDistance = boidsData.minDistance;
+
+  const int rx = boidsData.grid.ring_x(boidsData.minDistance);
+  const int ry = boidsData.grid.ring_y(boidsData.minDistance);
+
+  double nTests = 0;
+  double nNeighbours = 0;
+
+  Kokkos::parallel_reduce("reportNeighbourStats tests", boidsData.nBoids,
+    KOKKOS_LAMBDA(const int& index, double& count)
+    {
+      const compute_t x = boidsData.x(index);
+      const compute_t y = boidsData.y(index);
+      walk(index, x, y, minDistance, rx, ry, [&](int) { count += 1; });
+    }, nTests);
+
+  Kokkos::parallel_reduce("reportNeighbourStats neighbours", boidsData.nBoids,
+    KOKKOS_LAMBDA(const int& index, double& count)
+    {
+      const compute_t x = boidsData.x(index);
+      const compute_t y = boidsData.y(index);
+      walk(index, x, y, minDistance, rx, ry,
+        [&](int k)
+        {
+          compute_t xk, yk;
+          neighbourPosition<compute_t>(boidsData, k, x, y, xk, yk);
+          if (compute_distance<compute_t>(x, y, xk, yk) < minDistance)
+            count += 1;
+        });
+    }, nNeighbours);
+
+  testsPerBoid      = nTests/boidsData.nBoids;
+  neighboursPerBoid = nNeighbours/boidsData.nBoids;
+
+} // countNeighbours
+
+// ===================================================
+// ===================================================
+void reportNeighbourStats(BoidsData& boidsData)
+{
+
+  const int rx = boidsData.grid.ring_x(boidsData.minDistance);
+  const int ry = boidsData.grid.ring_y(boidsData.minDistance);
+
+  double nTests, nNeighbours;
+  countNeighbours(boidsData, BoxWalk{boidsData}, nTests, nNeighbours);
+
+  std::cout << "Separation rule : " << (2*rx+1) << "x" << (2*ry+1) << " boxes stencil, "
+            << nTests << " distance tests and "
+            << nNeighbours << " neighbours per boid\n";
+
+} // reportNeighbourStats
+
+// ===================================================
+// ===================================================
+void reportNeighbourStats(BoidsData& boidsData, const RefinedGrid& refined)
+{
+
+  const int rx = boidsData.grid.ring_x(boidsData.minDistance);
+  const int ry = boidsData.grid.ring_y(boidsData.minDistance);
+
+  double nTests, nNeighbours;
+  countNeighbours(boidsData, RefinedWalk{boidsData, refined}, nTests, nNeighbours);
+
+  std::cout << "Separation rule : " << (2*rx+1) << "x" << (2*ry+1) << " boxes stencil, "
+            << refined.nRefinedBoxes << " boxes refined (" << refined.nCells << " cells), "
+            << nTests << " distance tests and "
+            << nNeighbours << " neighbours per boid\n";
+
+} // reportNeighbourStats
+
+// ===================================================
+// ===================================================
+//! separation of every boid, neighbour candidates given by walk (see neighbourTraversal)
+template <typename Walk>
+BoidsData::compute_t traverseNeighbours(BoidsData& boidsData, const Walk& walk)
+{
+
+  using compute_t = BoidsData::compute_t;
+
+  const compute_t minDistance = boidsData.minDistance;
+
+  const int rx = boidsData.grid.ring_x(boidsData.minDistance);
+  const int ry = boidsData.grid.ring_y(boidsData.minDistance);
+
+  compute_t checksum = 0;
+
+  Kokkos::parallel_reduce("neighbourTraversal", boidsData.nBoids,
+    KOKKOS_LAMBDA(const int& index, compute_t& sum)
+    {
+      const compute_t x = boidsData.x(index);
+      const compute_t y = boidsData.y(index);
+
+      compute_t sep_x = 0, sep_y = 0;
+      walk(index, x, y, minDistance, rx, ry,
+        [&](int k)
+        {
+          compute_t xk, yk;
+          neighbourPosition<compute_t>(boidsData, k, x, y, xk, yk);
+          addSeparation<compute_t>(x, y, xk, yk, minDistance, sep_x, sep_y);
+        });
+
+      sum += sqrt(sep_x*sep_x + sep_y*sep_y);
+    }, checksum);
+
+  return checksum;
+
+} // traverseNeighbours
+
+// ===================================================
+// ===================================================
+BoidsData::compute_t neighbourTraversal(BoidsData& boidsData)
+{
+
+  return traverseNeighbours(boidsData, BoxWalk{boidsData});
+
+} // neighbourTraversal
+
+// ===================================================
+// ===================================================
+BoidsData::compute_t neighbourTraversal(BoidsData& boidsData, const RefinedGrid& refined)
+{
+
+  return traverseNeighbours(boidsData, RefinedWalk{boidsData, refined});
+
+} // neighbourTraversal
+
+// ===================================================
+// ===================================================
+double farGatherFraction(BoidsData& boidsData, int window)
+{
+
+  using compute_t = BoidsData::compute_t;
+
+  const compute_t minDistance = boidsData.minDistance;
+
+  const int rx = boidsData.grid.ring_x(boidsData.minDistance);
+  const int ry = boidsData.grid.ring_y(boidsData.minDistance);
+
+  double nFar = 0;
+  double nGathers = 0;
+
+  Kokkos::parallel_reduce("farGatherFraction", boidsData.nBoids,
+    KOKKOS_LAMBDA(const int& index, double& sum)
+    {
+      forEachNeighbourCandidate(boidsData, index,
+                                compute_t(boidsData.x(index)), compute_t(boidsData.y(index)),
+                                minDistance, rx, ry,
+                                [&](int k) { sum += ((k > index) ? k - index : index - k) > window; });
+    }, nFar);
+
+  Kokkos::parallel_reduce("farGatherFraction count", boidsData.nBoids,
+    KOKKOS_LAMBDA(const int& index, double& count)
+    {
+      forEachNeighbourCandidate(boidsData, index,
+                                compute_t(boidsData.x(index)), compute_t(boidsData.y(index)),
+                                minDistance, rx, ry,
+                                [&](int) { count += 1; });
+    }, nGathers);
+
+  return (nGathers > 0) ? nFar / nGathers : 0;
+
+} // farGatherFraction
+
+// ===================================================
+// ===================================================
+void copyPositionsForRendering(BoidsData& boidsData)
+{
+
+#ifdef FORGE_ENABLED
+
+  // interleaved float storage can be used directly for rendering
+  if (BoidsData::direct_rendering)
+    return;
 
   Kokkos::parallel_for("copyPositionsForRendering", boidsData.nBoids, KOKKOS_LAMBDA(const int& index)
   {
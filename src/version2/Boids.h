@@ -1,14 +1,28 @@
 #pragma once
 
 #include <math.h>
+#include <type_traits>
 #include <utility>
 
 // Include Kokkos Headers
 #include<Kokkos_Core.hpp>
-#include <Kokkos_Random.hpp>
+#include<Kokkos_ScatterView.hpp>
 
 
-#include "Array.h"
+#include "AdaptiveSort.h"
+#include "FlockStats.h"
+#include "Grid.h"
+#include "IncrementalBinning.h"
+#include "NearestNeighbours.h"
+#include "QuadTree.h"
+#include "RefinedGrid.h"
+#include "SeparationTiles.h"
+#include "VerletList.h"
+#include "utils/kernel-type.h"
+#include "utils/position-layout.h"
+#include "utils/precision-policy.h"
+#include "utils/random-utils.h"
+#include "utils/sort-utils.h"
 
 // ===================================================
 // ===================================================
@@ -43,65 +57,147 @@
 // ===================================================
 struct BoidsData
 {
+  //! precision policy (chosen at compile time, see utils/precision-policy.h)
+  using Precision = kboids::DefaultPrecision;
+
+  //! storage of positions, in [-1024,1024) (bounds of fixed point storage)
+  using real_t     = Precision::storage_for<10>;
+
+  //! storage of displacements, in [-32,32) (speed limit is 20)
+  using velocity_t = Precision::storage_for<5>;
+
+  using value_t    = Precision::value_t;
+  using compute_t  = Precision::compute_t;
+
   //using Flock    = Kokkos::View<Boid*,  Kokkos::DefaultExecutionSpace>;
   using VecInt   = Kokkos::View<int*,   Kokkos::DefaultExecutionSpace>;
   using VecFloat = Kokkos::View<float*, Kokkos::DefaultExecutionSpace>;
+  using VecVelocity  = Kokkos::View<velocity_t*, Kokkos::DefaultExecutionSpace>;
+
+  //! flock statistics (single value, in device memory)
+  using FlockStats_t = FlockStats<compute_t>;
+  using ViewStats    = Kokkos::View<FlockStats_t, Kokkos::DefaultExecutionSpace>;
+
+  //! reference positions (never stored on 16 bits, see maxDisplacement)
+  using VecValue = Kokkos::View<value_t*, Kokkos::DefaultExecutionSpace>;
+
+  //! positions storage (layout chosen at compile time, see utils/position-layout.h)
+  using VecPos   = kboids::PositionView<Kokkos::DefaultExecutionSpace::memory_space, real_t>;
+  using VecCoord = kboids::CoordView<VecPos>;
+
+  using VecPosHost   = VecPos::HostMirror;
+  using VecCoordHost = kboids::CoordView<VecPosHost>;
 
   using VecIntAtomic = Kokkos::View<int*, Kokkos::DefaultExecutionSpace, Kokkos::MemoryTraits<Kokkos::Atomic>>;
-  using VecFloatAtomic = Kokkos::View<float*, Kokkos::DefaultExecutionSpace, Kokkos::MemoryTraits<Kokkos::Atomic>>;
 
-  static constexpr float XMIN = 0;
-  static constexpr float XMAX = 150;
-  static constexpr float YMIN = 0;
-  static constexpr float YMAX = 150;
+  //! box count accumulator (default duplication/atomicity of the execution space)
+  using ScatterInt   = Kokkos::Experimental::ScatterView<int*>;
 
-  static constexpr int NBOX_X = 10;
-  static constexpr int NBOX_Y = 10;
+  //! default neighbour distance (rule #3)
+  static constexpr float MIN_DISTANCE = 20;
 
-  BoidsData(int nBoids)
+  //! largest displacement of a boid in one time step (see speedLimit)
+  static constexpr float SPEED_LIMIT = 20;
+
+  //! \param[in] nBoids is the number of boids
+  //! \param[in] grid is the flight domain and its boxes
+  //! \param[in] minDistance is the neighbour distance (rule #3)
+  //! \param[in] accumulation is the box data accumulation strategy (AUTO is resolved here)
+  BoidsData(int nBoids, const Grid& grid, float minDistance = MIN_DISTANCE,
+            kboids::BoxAccumulation accumulation = kboids::BoxAccumulation::AUTO)
     : nBoids(nBoids),
-      x("x",nBoids),
-      y("y",nBoids),
+      grid(grid),
+      minDistance(minDistance),
+      accumulation(chooseBoxAccumulation(accumulation, grid)),
+      pos("pos",nBoids),
       dx("dx",nBoids),
       dy("dy",nBoids),
       ennemies("ennemies",nBoids),
       color("color", nBoids),
-      tmp("tmp",nBoids),
-      boxCount("box count", NBOX_X*NBOX_Y),
-      boxIndex("box count integrated", NBOX_X*NBOX_Y),
-      box_x("box average x", NBOX_X*NBOX_Y),
-      box_y("box average y", NBOX_X*NBOX_Y),
-      box_dx("box average dx", NBOX_X*NBOX_Y),
-      box_dy("box average dy", NBOX_X*NBOX_Y),
-      x_host(),
-      y_host()
+      dx_tmp("dx_tmp",nBoids),
+      dy_tmp("dy_tmp",nBoids),
+      pos_tmp("pos_tmp",nBoids),
+      countingSort(nBoids),
+      boxCount("box count", grid.nBoxes()),
+      boxIndex("box count integrated", grid.nBoxes()),
+      stats("flock stats"),
+      pos_host()
 #ifdef FORGE_ENABLED
-      ,xy("xy",2*nBoids)
+      ,xy("xy",direct_rendering ? 0 : 2*nBoids)
 #endif
   {
-    x_host = Kokkos::create_mirror(x);
-    y_host = Kokkos::create_mirror(y);
+    setCoordinates();
+
+    pos_host = Kokkos::create_mirror(pos);
+    x_host = kboids::coordinate(pos_host, 0);
+    y_host = kboids::coordinate(pos_host, 1);
+
     resetBoxData();
+
+    if (this->accumulation == kboids::BoxAccumulation::SCATTER)
+      scatter_count = ScatterInt(boxCount);
+  }
+
+  //! size in bytes of per box data in a private (per team) histogram
+  static constexpr size_t PRIVATE_BYTES_PER_BOX = sizeof(int);
+
+  /**
+   * Resolve AUTO box accumulation : atomics when boxes are many compared to
+   * threads (little contention), else per team histograms when they fit in
+   * scratch memory, else ScatterView.
+   */
+  static kboids::BoxAccumulation chooseBoxAccumulation(kboids::BoxAccumulation accumulation,
+                                                       const Grid& grid)
+  {
+    using kboids::BoxAccumulation;
+
+    if (accumulation != BoxAccumulation::AUTO)
+      return accumulation;
+
+    const int nThreads = Kokkos::DefaultExecutionSpace().concurrency();
+
+    if (grid.nBoxes() >= kboids::ATOMIC_MIN_BOXES_PER_THREAD * nThreads)
+      return BoxAccumulation::ATOMIC;
+
+    if (grid.nBoxes() * PRIVATE_BYTES_PER_BOX <= (size_t) Kokkos::TeamPolicy<>::scratch_size_max(0))
+      return BoxAccumulation::PRIVATE;
+
+    return BoxAccumulation::SCATTER;
+  }
+
+  //! (re)build x,y views on top of positions storage
+  void setCoordinates()
+  {
+    x = kboids::coordinate(pos, 0);
+    y = kboids::coordinate(pos, 1);
   }
 
   void resetBoxData()
   {
     Kokkos::deep_copy(boxCount, 0);
     Kokkos::deep_copy(boxIndex, 0);
-    Kokkos::deep_copy(box_x, 0.0);
-    Kokkos::deep_copy(box_y, 0.0);
-    Kokkos::deep_copy(box_dx, 0.0);
-    Kokkos::deep_copy(box_dy, 0.0);
   }
 
   //! number of boids
   int nBoids;
 
+  //! flight domain and boxes
+  Grid grid;
+
+  //! neighbour distance
+  float minDistance;
+
+  //! box data accumulation strategy (never AUTO)
+  kboids::BoxAccumulation accumulation;
+
+  //! positions storage
+  VecPos pos;
+
   //! set of boids coordinates
-  VecFloat x, y;
+  VecCoord x, y;
 
   //! displacement (or velocity)
-  VecFloat dx, dy;
+  VecVelocity dx, dy;
 
   //! ennemies index
   VecInt ennemies;
@@ -109,8 +205,14 @@ struct BoidsData
   //! color (used for sorting)
   VecInt color;
 
-  //! temp array of boids used to perform permutation
-  VecFloat tmp;
+  //! temp displacements used to perform permutation
+  VecVelocity dx_tmp, dy_tmp;
+
+  //! temp positions storage used to perform permutation
+  VecPos pos_tmp;
+
+  //! counting sort of boids by box (work views reused every step)
+  kboids::CountingSort<VecInt> countingSort;
 
   //! box population
   VecInt boxCount;
@@ -118,57 +220,84 @@ struct BoidsData
   //! integrated box count
   VecInt boxIndex;
 
-  //! box average position
-  VecFloat box_x, box_y;
+  //! flock statistics of the last updateFlockStats
+  ViewStats stats;
 
-  //! box average velocity
-  VecFloat box_dx, box_dy;
+  //! box count accumulator (only allocated with BoxAccumulation::SCATTER)
+  ScatterInt scatter_count;
 
   //! mirror of flock data on host (for image rendering only)
-  VecFloat::HostMirror x_host, y_host;
+  VecPosHost pos_host;
+  VecCoordHost x_host, y_host;
 
 #ifdef FORGE_ENABLED
+  //! can positions storage be directly used as an OpenGL vertex buffer ?
+  static constexpr bool direct_rendering =
+    kboids::interleaved_positions and std::is_same<real_t, float>::value;
+
+  //! interleaved positions for OpenGL rendering (not allocated when direct_rendering)
   VecFloat xy;
+
+  //! pointer to interleaved {x,y} float data for OpenGL rendering
+  float* renderData()
+  {
+    return direct_rendering ? reinterpret_cast<float*>(pos.data()) : xy.data();
+  }
 #endif
 
 }; // struct BoidsData
 
 // ===================================================
 // ===================================================
-class MyRandomPool
+/**
+ * Counter-based random number generator (see utils/random-utils.h).
+ *
+ * Each kernel drawing random numbers uses its own stream; random numbers of boid
+ * index are rng(stream, index), so there is no generator state to check out and
+ * results do not depend on the number of threads.
+ */
+class MyRandom
 {
 
 public:
 
-  // define an alias to the random generator pool
-  using RGPool_t = Kokkos::Random_XorShift64_Pool<Kokkos::DefaultExecutionSpace>;
+  MyRandom(uint64_t seed)
+    : rng(seed),
+      stream(0)
+  {
 
-  // type for hold the random generator state
-  using rnd_t = RGPool_t::generator_type;
+  }
 
-  // which execution space ? OpenMP, Cuda, ...
-  using device_t = RGPool_t::device_type;
+  //! stream to be used by the next kernel
+  uint64_t nextStream() { return stream++; }
 
-  MyRandomPool(uint64_t seed)
-    : pool(seed)
-  {
+  kboids::CounterRNG rng;
 
-  }
+  //! index of the next unused stream
+  uint64_t stream;
 
-  RGPool_t pool;
+}; // MyRandom
 
-}; // MyRandomPool
+// ===================================================
+// ===================================================
+void initPositions(BoidsData& boidsData, MyRandom& myRand);
 
 // ===================================================
 // ===================================================
-void initPositions(BoidsData& boidsData, MyRandomPool::RGPool_t& rand_pool);
+/**
+ * Clustered flock : boids are spread around nClusters centers drawn uniformly in
+ * the domain (gaussian, standard deviation radius), cluster populations
+ * decreasing from the first cluster to the last.
+ */
+void initClusteredPositions(BoidsData& boidsData, MyRandom& myRand,
+                            int nClusters, float radius);
 
 // ===================================================
 // ===================================================
 /**
  * Randomly change ennemies.
  */
-void shuffleEnnemies(BoidsData& boidsData, MyRandomPool::RGPool_t& rand_pool, float rate);
+void shuffleEnnemies(BoidsData& boidsData, MyRandom& myRand, float rate);
 
 // ===================================================
 // ===================================================
@@ -176,7 +305,33 @@ void computeBoxData(BoidsData& boidsData);
 
 // ===================================================
 // ===================================================
-std::pair<float,float> updateAverageVelocity(BoidsData& boidsData);
+/**
+ * Same as computeBoxData, boxes holding too many boids are refined (see
+ * RefinedGrid), and boids are sorted by cell (hence still by box).
+ */
+void computeBoxData(BoidsData& boidsData, RefinedGrid& refined);
+
+// ===================================================
+// ===================================================
+/**
+ * Update box data after boids moved, only moving boids that changed box (see
+ * IncrementalBinning); falls back to computeBoxData when there are too many
+ * movers, or on the first call.
+ *
+ * \return the number of movers
+ */
+int updateBoxData(BoidsData& boidsData, IncrementalBinning& binning);
+
+// ===================================================
+// ===================================================
+/**
+ * Compute flock statistics (mean velocity, centroid, bounding box, speed range)
+ * into boidsData.stats, in a single reduction.
+ *
+ * The result stays in device memory, the host does not wait for it : kernels
+ * launched afterwards read boidsData.stats() directly.
+ */
+void updateFlockStats(BoidsData& boidsData);
 
 // ===================================================
 // ===================================================
@@ -185,31 +340,35 @@ double SQR(const double& v) {return v*v;}
 
 // ===================================================
 // ===================================================
+/**
+ * Unit vector from (x1,y1) to (x2,y2), or (0,0) when both points are closer than 1e-6.
+ *
+ * Branch free : one reciprocal square root and a select (no test around divisions).
+ */
+template <typename T>
 KOKKOS_INLINE_FUNCTION
-void compute_direction(const float& x1, const float& y1,
-                       const float& x2, const float& y2,
-                       float& x, float& y)
+void compute_direction(T x1, T y1,
+                       T x2, T y2,
+                       T& x, T& y)
 {
-  double norm = sqrt( (x2-x1)*(x2-x1) +
-                      (y2-y1)*(y2-y1) );
-  if (norm < 1e-6)
-  {
-    x = 0;
-    y = 0;
-  }
-  else
-  {
-    x = (x2-x1)/norm;
-    y = (y2-y1)/norm;
-  }
+  const T ddx = x2-x1;
+  const T ddy = y2-y1;
+  const T norm2 = ddx*ddx + ddy*ddy;
+
+  // norm < 1e-6 <=> norm2 < 1e-12
+  const T inv_norm = (norm2 < T(1e-12)) ? T(0) : kboids::rsqrt(norm2);
+
+  x = ddx*inv_norm;
+  y = ddy*inv_norm;
 }
 
 // ===================================================
 // ===================================================
+template <typename T>
 KOKKOS_INLINE_FUNCTION
-float compute_distance(float x1, float y1, float x2, float y2)
+T compute_distance(T x1, T y1, T x2, T y2)
 {
-  float d = sqrt( (x2-x1)*(x2-x1) + (y2-y1)*(y2-y1) );
+  T d = sqrt( (x2-x1)*(x2-x1) + (y2-y1)*(y2-y1) );
   return d; //(d<1e-6) ? 0 : d;
 }
 
@@ -217,37 +376,30 @@ float compute_distance(float x1, float y1, float x2, float y2)
 // ===================================================
 template<int dir>
 KOKKOS_INLINE_FUNCTION
-int pos2box(float x)
+int pos2box(const Grid& grid, float x)
 {
-
-  auto MIN  = dir == 0 ? BoidsData::XMIN   : BoidsData::YMIN;
-  auto MAX  = dir == 0 ? BoidsData::XMAX   : BoidsData::YMAX;
-  auto NBOX = dir == 0 ? BoidsData::NBOX_X : BoidsData::NBOX_Y;
-
-  int i = (int) std::floor( (x+MIN)/(MAX-MIN)*NBOX );
-  if (i<0) i=0;
-  if (i>= NBOX) i=NBOX-1;
-  return i;
+  return grid.box<dir>(x);
 }
 
 // ===================================================
 // ===================================================
 KOKKOS_INLINE_FUNCTION
-int pos2box(float x, float y)
+int pos2box(const Grid& grid, float x, float y)
 {
-  int i = pos2box<0>(x);
-  int j = pos2box<1>(y);
+  int i = pos2box<0>(grid, x);
+  int j = pos2box<1>(grid, y);
 
-  return i + BoidsData::NBOX_X * j;
+  return grid.cell(i, j);
 }
 
 // ===================================================
 // ===================================================
+template <typename T>
 KOKKOS_INLINE_FUNCTION
-void speedLimit(float& dx, float& dy)
+void speedLimit(T& dx, T& dy)
 {
-  const auto speed = sqrt(dx*dx+dy*dy);
-  const float speedLimit = 20;
+  const T speed = sqrt(dx*dx+dy*dy);
+  const T speedLimit = BoidsData::SPEED_LIMIT;
   if (speed > speedLimit)
   {
     dx = (dx / speed) * speedLimit;
@@ -257,43 +409,487 @@ void speedLimit(float& dx, float& dy)
 
 // ===================================================
 // ===================================================
+template <typename T>
 KOKKOS_INLINE_FUNCTION
-void keepInTheBox(float x, float y, float& dx, float& dy)
+void keepInTheBox(const Grid& grid, T x, T y, T& dx, T& dy)
 {
 
-  float margin = 2*(BoidsData::XMAX-BoidsData::XMIN);
+  T margin = 2*(grid.xmax-grid.xmin);
 
-  float turnFactor = 1;
+  T turnFactor = 1;
 
-  if (x < BoidsData::XMIN + margin) {
+  if (x < grid.xmin + margin) {
     dx += turnFactor;
   }
-  if (x > BoidsData::XMAX - margin) {
+  if (x > grid.xmax - margin) {
     dx -= turnFactor;
   }
-  if (y < BoidsData::YMIN + margin) {
+  if (y < grid.ymin + margin) {
     dy += turnFactor;
   }
-  if (y > BoidsData::YMAX - margin) {
+  if (y > grid.ymax - margin) {
     dy -= turnFactor;
   }
 
-  // float margin = 0.01*(BoidsData::XMAX-BoidsData::XMIN);
-  // if (x > BoidsData::XMIN - margin) {
+  // float margin = 0.01*(grid.xmax-grid.xmin);
+  // if (x > grid.xmin - margin) {
   //   dx = -dx;
   // }
-  // if (x < BoidsData::XMAX + margin) {
+  // if (x < grid.xmax + margin) {
   //   dx = -dx;
   // }
-  // if (y > BoidsData::YMIN - margin) {
+  // if (y > grid.ymin - margin) {
   //   dy = -dy;
   // }
-  // if (y < BoidsData::YMAX + margin) {
+  // if (y < grid.ymax + margin) {
   //   dy = -dy;
   // }
 
 }
 
+// ===================================================
+// ===================================================
+/**
+ * Call f(j) for every boid j != index in boxes around the box of boid index,
+ * that may be closer than distance to (x,y) (cell list).
+ *
+ * Boids must be sorted by box (see computeBoxData). Boxes are visited up to
+ * rx, ry rings away (see Grid::ring_x), boxes farther than distance from (x,y)
+ * are culled; border boxes extend to infinity, as they also hold boids outside
+ * of the domain. In a periodic domain, rings wrap around to the ghosts of the
+ * boxes on the other side (see Grid::box_range) : f must then use the closest
+ * image of boid j (see neighbourPosition).
+ */
+template <typename T, typename Function>
+KOKKOS_INLINE_FUNCTION
+void forEachNeighbourCandidate(const BoidsData& boidsData, int index,
+                               T x, T y, T distance, int rx, int ry,
+                               const Function& f)
+{
+  const Grid& grid = boidsData.grid;
+
+  int bi, bj;
+  grid.cell_coords(boidsData.color(index), bi, bj);
+
+  // (x,y) seen from the box of boid index : in a periodic domain, boids may
+  // have wrapped around since they were sorted (see AdaptiveSort)
+  x = grid.image<0>(grid.xmin + (bi+T(0.5))*grid.hx(), x);
+  y = grid.image<1>(grid.ymin + (bj+T(0.5))*grid.hy(), y);
+
+  const T d2max = distance*distance;
+
+  int imin, imax, jmin, jmax;
+  grid.box_range<0>(bi, rx, imin, imax);
+  grid.box_range<1>(bj, ry, jmin, jmax);
+
+  const bool cull_x = not grid.spans_domain<0>(rx);
+  const bool cull_y = not grid.spans_domain<1>(ry);
+
+  for (int j=jmin; j<=jmax; ++j)
+  {
+    // distance along y from (x,y) to box row j
+    const T ddy = cull_y ? grid.box_distance<1>(y, j) : T(0);
+
+    if (ddy*ddy > d2max)
+      continue;
+
+    for (int i=imin; i<=imax; ++i)
+    {
+      const T ddx = cull_x ? grid.box_distance<0>(x, i) : T(0);
+
+      // box culling
+      if (ddx*ddx + ddy*ddy > d2max)
+        continue;
+
+      const int jBox  = grid.cell(grid.wrap_box<0>(i), grid.wrap_box<1>(j));
+      const int first = boidsData.boxIndex(jBox);
+      const int last  = first + boidsData.boxCount(jBox);
+
+      for (int k=first; k<last; ++k)
+        if (k != index)
+          f(k);
+    }
+  }
+
+} // forEachNeighbourCandidate
+
+// ===================================================
+// ===================================================
+/**
+ * Same as above, boxes refined into cells (see RefinedGrid) are only visited
+ * through their cells closer than distance to (x,y).
+ *
+ * Boids must be sorted by cell (see computeBoxData(BoidsData&, RefinedGrid&)).
+ * Outer cells of border boxes extend to infinity, as border boxes do (open
+ * domain only).
+ */
+template <typename T, typename Function>
+KOKKOS_INLINE_FUNCTION
+void forEachNeighbourCandidate(const BoidsData& boidsData, const RefinedGrid& refined,
+                               int index, T x, T y, T distance, int rx, int ry,
+                               const Function& f)
+{
+  const Grid& grid = boidsData.grid;
+
+  int bi, bj;
+  grid.cell_coords(boidsData.color(index), bi, bj);
+
+  // (x,y) seen from the box of boid index : in a periodic domain, boids may
+  // have wrapped around since they were sorted (see AdaptiveSort)
+  x = grid.image<0>(grid.xmin + (bi+T(0.5))*grid.hx(), x);
+  y = grid.image<1>(grid.ymin + (bj+T(0.5))*grid.hy(), y);
+
+  const T hx = grid.hx();
+  const T hy = grid.hy();
+  const T d2max = distance*distance;
+
+  int imin, imax, jmin, jmax;
+  grid.box_range<0>(bi, rx, imin, imax);
+  grid.box_range<1>(bj, ry, jmin, jmax);
+
+  const bool cull_x = not grid.spans_domain<0>(rx);
+  const bool cull_y = not grid.spans_domain<1>(ry);
+
+  for (int j=jmin; j<=jmax; ++j)
+  {
+    // distance along y from (x,y) to box row j
+    const T ylo = grid.ymin + j*hy;
+    const T ddy = cull_y ? grid.box_distance<1>(y, j) : T(0);
+
+    if (ddy*ddy > d2max)
+      continue;
+
+    for (int i=imin; i<=imax; ++i)
+    {
+      const T xlo = grid.xmin + i*hx;
+      const T ddx = cull_x ? grid.box_distance<0>(x, i) : T(0);
+
+      // box culling
+      if (ddx*ddx + ddy*ddy > d2max)
+        continue;
+
+      const int jBox = grid.cell(grid.wrap_box<0>(i), grid.wrap_box<1>(j));
+      const int r    = refined.refinement(jBox);
+
+      // cells of the box overlapping [x-distance,x+distance]x[y-distance,y+distance]
+      const T sx = hx / r;
+      const T sy = hy / r;
+
+      int simin = (int) floor((x - distance - xlo) / sx);
+      int simax = (int) floor((x + distance - xlo) / sx);
+      int sjmin = (int) floor((y - distance - ylo) / sy);
+      int sjmax = (int) floor((y + distance - ylo) / sy);
+
+      simin = (simin < 0) ? 0 : ((simin >= r) ? r-1 : simin);
+      simax = (simax < 0) ? 0 : ((simax >= r) ? r-1 : simax);
+      sjmin = (sjmin < 0) ? 0 : ((sjmin >= r) ? r-1 : sjmin);
+      sjmax = (sjmax < 0) ? 0 : ((sjmax >= r) ? r-1 : sjmax);
+
+      // boxes spanning the whole periodic domain : all cells
+      if (not cull_x) { simin = 0; simax = r-1; }
+      if (not cull_y) { sjmin = 0; sjmax = r-1; }
+
+      const int first = refined.cellOffset(jBox);
+
+      for (int sj=sjmin; sj<=sjmax; ++sj)
+      {
+        const T cylo = ylo + sj*sy;
+        T cdy = 0;
+        if ((j > 0         or sj > 0   or grid.periodic) and y < cylo)    cdy = cylo - y;
+        if ((j < grid.ny-1 or sj < r-1 or grid.periodic) and y > cylo+sy) cdy = y - (cylo+sy);
+        if (not cull_y) cdy = 0;
+
+        for (int si=simin; si<=simax; ++si)
+        {
+          const T cxlo = xlo + si*sx;
+          T cdx = 0;
+          if ((i > 0         or si > 0   or grid.periodic) and x < cxlo)    cdx = cxlo - x;
+          if ((i < grid.nx-1 or si < r-1 or grid.periodic) and x > cxlo+sx) cdx = x - (cxlo+sx);
+          if (not cull_x) cdx = 0;
+
+          // cell culling
+          if (cdx*cdx + cdy*cdy > d2max)
+            continue;
+
+          const int cell = first + si + r*sj;
+          const int kmin = refined.cellIndex(cell);
+          const int kmax = kmin + refined.cellCount(cell);
+
+          for (int k=kmin; k<kmax; ++k)
+            if (k != index)
+              f(k);
+        }
+      }
+    }
+  }
+
+} // forEachNeighbourCandidate
+
+// ===================================================
+// ===================================================
+/**
+ * Position (xk,yk) of boid k seen from (x,y) : its closest image in a periodic
+ * domain, its position in an open domain.
+ */
+template <typename T>
+KOKKOS_INLINE_FUNCTION
+void neighbourPosition(const BoidsData& boidsData, int k, T x, T y, T& xk, T& yk)
+{
+  xk = boidsData.grid.image<0>(x, T(boidsData.x(k)));
+  yk = boidsData.grid.image<1>(y, T(boidsData.y(k)));
+}
+
+// ===================================================
+// ===================================================
+/**
+ * Add the repulsion of boid (xk,yk) on boid (x,y) if closer than distance :
+ * unit vector pointing away from (xk,yk), weighted by (1 - d/distance).
+ */
+template <typename T>
+KOKKOS_INLINE_FUNCTION
+void addSeparation(T x, T y, T xk, T yk, T distance, T& sep_x, T& sep_y)
+{
+  const T d = compute_distance(x, y, xk, yk);
+
+  if (d < distance)
+  {
+    T dir_x, dir_y;
+    compute_direction<T>(xk, yk, x, y, dir_x, dir_y);
+    sep_x += (1 - d/distance) * dir_x;
+    sep_y += (1 - d/distance) * dir_y;
+  }
+}
+
+// ===================================================
+// ===================================================
+/**
+ * Separation (rule #3) : sum of repulsions of the neighbours closer than
+ * distance (see addSeparation), found by walking the boxes.
+ *
+ * When boids moved since they were sorted, drift is their largest displacement :
+ * boxes are culled at distance + drift (rx, ry must cover distance + 2 drift).
+ */
+template <typename T>
+KOKKOS_INLINE_FUNCTION
+void separation(const BoidsData& boidsData, int index,
+                T x, T y, T distance, int rx, int ry,
+                T& sep_x, T& sep_y, T drift = 0)
+{
+  sep_x = 0;
+  sep_y = 0;
+
+  forEachNeighbourCandidate(boidsData, index, x, y, distance + drift, rx, ry,
+    [&](int k)
+    {
+      T xk, yk;
+      neighbourPosition<T>(boidsData, k, x, y, xk, yk);
+      addSeparation<T>(x, y, xk, yk, distance, sep_x, sep_y);
+    });
+
+} // separation
+
+// ===================================================
+// ===================================================
+/**
+ * Separation (rule #3), walking the cells of refined boxes (see RefinedGrid).
+ */
+template <typename T>
+KOKKOS_INLINE_FUNCTION
+void separation(const BoidsData& boidsData, const RefinedGrid& refined, int index,
+                T x, T y, T distance, int rx, int ry,
+                T& sep_x, T& sep_y)
+{
+  sep_x = 0;
+  sep_y = 0;
+
+  forEachNeighbourCandidate(boidsData, refined, index, x, y, distance, rx, ry,
+    [&](int k)
+    {
+      T xk, yk;
+      neighbourPosition<T>(boidsData, k, x, y, xk, yk);
+      addSeparation<T>(x, y, xk, yk, distance, sep_x, sep_y);
+    });
+
+} // separation
+
+// ===================================================
+// ===================================================
+/**
+ * Separation (rule #3), neighbours read from Verlet lists.
+ */
+template <typename T>
+KOKKOS_INLINE_FUNCTION
+void separation(const BoidsData& boidsData, const VerletList& verlet, int index,
+                T x, T y, T distance,
+                T& sep_x, T& sep_y)
+{
+  sep_x = 0;
+  sep_y = 0;
+
+  const int first = verlet.offset(index);
+  const int last  = verlet.offset(index+1);
+  for (int i=first; i<last; ++i)
+  {
+    const int k = verlet.neighbours(i);
+    T xk, yk;
+    neighbourPosition<T>(boidsData, k, x, y, xk, yk);
+    addSeparation<T>(x, y, xk, yk, distance, sep_x, sep_y);
+  }
+
+} // separation
+
+// ===================================================
+// ===================================================
+/**
+ * Distance-weighted cohesion and alignment target of boid index : centroid and
+ * mean velocity of the other boids, each weighted by 1/(d^2 + softening^2).
+ *
+ * Barnes-Hut traversal of the quadtree : a cell of size s whose centroid is at
+ * distance d is taken as a whole (its boids at its centroid, with its mean
+ * velocity) when s < theta d, else its children are visited; leaves that cannot
+ * be approximated are summed boid by boid. Cells holding boid index are always
+ * opened, so that it is never counted. theta = 0 gives the exact sum.
+ *
+ * Without any other boid, the target is the boid itself (xg=x, ..., vyg=vy).
+ *
+ * \return the number of interactions (cells or boids taken into account)
+ */
+template <typename T>
+KOKKOS_INLINE_FUNCTION
+int barnesHutCohesion(const QuadTree& tree, int index,
+                      T x, T y, T vx, T vy, T softening,
+                      T& xg, T& yg, T& vxg, T& vyg)
+{
+  const int key   = tree.leaf(x, y);
+  const T   theta2 = tree.theta * tree.theta;
+  const T   s2     = softening * softening;
+
+  T w = 0, wx = 0, wy = 0, wvx = 0, wvy = 0;
+  int nInteractions = 0;
+
+  // cells to visit : (level << 24) | Morton code in level
+  int stack[QuadTree::STACK_SIZE];
+  int top = 0;
+  stack[top++] = 0;
+
+  while (top > 0)
+  {
+    const int entry = stack[--top];
+    const int l = entry >> 24;
+    const int c = entry & 0xffffff;
+    const int cell = QuadTree::levelOffset(l) + c;
+
+    const int m = tree.count(cell);
+    if (m == 0)
+      continue;
+
+    const T xc = tree.cx(cell);
+    const T yc = tree.cy(cell);
+    const T d2 = (xc-x)*(xc-x) + (yc-y)*(yc-y);
+    const T s  = tree.size(l);
+
+    const bool holdsBoid = (c == (key >> (2*(tree.depth-l))));
+
+    if (not holdsBoid and s*s < theta2*d2)
+    {
+      // far cell : all its boids at its centroid
+      const T wc = m / (d2 + s2);
+      w   += wc;
+      wx  += wc * xc;
+      wy  += wc * yc;
+      wvx += wc * tree.cdx(cell);
+      wvy += wc * tree.cdy(cell);
+      ++nInteractions;
+    }
+    else if (l == tree.depth)
+    {
+      // leaf : boid by boid
+      const int first = tree.leafOffset(c);
+      for (int i = first; i < first + m; ++i)
+      {
+        if ((int) tree.boid(i) == index)
+          continue;
+
+        const T xk = tree.x(i);
+        const T yk = tree.y(i);
+        const T wk = 1 / ((xk-x)*(xk-x) + (yk-y)*(yk-y) + s2);
+        w   += wk;
+        wx  += wk * xk;
+        wy  += wk * yk;
+        wvx += wk * T(tree.dx(i));
+        wvy += wk * T(tree.dy(i));
+        ++nInteractions;
+      }
+    }
+    else
+    {
+      for (int k = 0; k < 4; ++k)
+        stack[top++] = ((l+1) << 24) | (4*c + k);
+    }
+  }
+
+  if (w > 0)
+  {
+    xg  = wx  / w;
+    yg  = wy  / w;
+    vxg = wvx / w;
+    vyg = wvy / w;
+  }
+  else
+  {
+    xg  = x;
+    yg  = y;
+    vxg = vx;
+    vyg = vy;
+  }
+
+  return nInteractions;
+
+} // barnesHutCohesion
+
+// ===================================================
+// ===================================================
+/**
+ * Print the mean number of distance tests and of actual neighbours per boid
+ * in the separation rule (boids must be sorted by box).
+ */
+void reportNeighbourStats(BoidsData& boidsData);
+
+// ===================================================
+// ===================================================
+/**
+ * Same as above, walking the cells of refined boxes (boids must be sorted by
+ * cell), and print the number of refined boxes and of cells.
+ */
+void reportNeighbourStats(BoidsData& boidsData, const RefinedGrid& refined);
+
+// ===================================================
+// ===================================================
+/**
+ * Walk the neighbour boxes of every boid and compute its separation (rule #3),
+ * without moving boids (boids must be sorted by box) : memory access pattern of
+ * the update kernel, used to benchmark boxes numbering.
+ *
+ * \return the sum of the norms of separations (checksum)
+ */
+BoidsData::compute_t neighbourTraversal(BoidsData& boidsData);
+
+// ===================================================
+// ===================================================
+/**
+ * Same as above, walking the cells of refined boxes (boids must be sorted by cell).
+ */
+BoidsData::compute_t neighbourTraversal(BoidsData& boidsData, const RefinedGrid& refined);
+
+// ===================================================
+// ===================================================
+/**
+ * Fraction of the gathers of neighbourTraversal (boid index reading boid k) that
+ * are farther than window boids away in the sorted boids arrays, i.e. that are
+ * unlikely to hit a cache holding the last window boids.
+ */
+double farGatherFraction(BoidsData& boidsData, int window);
+
 // ===================================================
 // ===================================================
 void computeBoxIndex(BoidsData& boidsData);
@@ -302,6 +898,143 @@ void computeBoxIndex(BoidsData& boidsData);
 // ===================================================
 void updatePositions(BoidsData& boidsData);
 
+// ===================================================
+// ===================================================
+/**
+ * Same as updatePositions, with box data updated incrementally (see updateBoxData).
+ */
+void updatePositions(BoidsData& boidsData, IncrementalBinning& binning);
+
+// ===================================================
+// ===================================================
+/**
+ * Same as updatePositions, boids are only sorted when too many of them left
+ * their box since the last sort (see AdaptiveSort).
+ *
+ * \return true if boids were sorted
+ */
+bool updatePositions(BoidsData& boidsData, AdaptiveSort& adaptiveSort);
+
+// ===================================================
+// ===================================================
+/**
+ * Sort boids by box (see computeBoxData), then find the k nearest neighbours of
+ * every boid (see NearestNeighbours).
+ *
+ * Boxes are visited ring after ring (Chebyshev distance to the box of the boid),
+ * boxes farther than the current k-th neighbour being skipped; the search stops
+ * when the k-th neighbour is closer than every box outside the visited rings.
+ */
+void findNearestNeighbours(BoidsData& boidsData, NearestNeighbours& knn);
+
+// ===================================================
+// ===================================================
+/**
+ * Apply the rules over the k nearest neighbours of each boid (found by
+ * findNearestNeighbours, boids must not have moved since) : cohesion to their
+ * centroid, alignment to their mean velocity, separation from those closer than
+ * minDistance; then move boids.
+ */
+void updatePositionsFromNeighbours(BoidsData& boidsData, const NearestNeighbours& knn);
+
+// ===================================================
+// ===================================================
+/**
+ * Same as updatePositions, boids interact with their k nearest neighbours
+ * (topological neighbours) : findNearestNeighbours, then
+ * updatePositionsFromNeighbours.
+ */
+void updatePositions(BoidsData& boidsData, NearestNeighbours& knn);
+
+// ===================================================
+// ===================================================
+/**
+ * Separation (rule #3) of every boid into tiles.sep_x, tiles.sep_y, one team
+ * per box, neighbours read from team scratch memory (see SeparationTiles).
+ * Boids must be sorted by box.
+ */
+void computeSeparationTiled(BoidsData& boidsData, SeparationTiles& tiles);
+
+// ===================================================
+// ===================================================
+/**
+ * Same as updatePositions, with separation computed box by box in team scratch
+ * memory (see computeSeparationTiled).
+ */
+void updatePositions(BoidsData& boidsData, SeparationTiles& tiles);
+
+// ===================================================
+// ===================================================
+/**
+ * Same as updatePositions, with crowded boxes refined into cells (see
+ * RefinedGrid) for the separation rule.
+ */
+void updatePositions(BoidsData& boidsData, RefinedGrid& refined);
+
+// ===================================================
+// ===================================================
+/**
+ * (Re)build Verlet lists : compute box data (boids are sorted), then store the
+ * neighbours closer than minDistance + skin of every boid.
+ */
+void buildVerletList(BoidsData& boidsData, VerletList& verlet);
+
+// ===================================================
+// ===================================================
+//! largest displacement of a boid since it was at (x0,y0)
+BoidsData::compute_t maxDisplacement(const BoidsData& boidsData,
+                                     const BoidsData::VecValue& x0,
+                                     const BoidsData::VecValue& y0);
+
+// ===================================================
+// ===================================================
+/**
+ * Same as updatePositions, with separation computed from Verlet lists, which are
+ * rebuilt first when a boid has moved by more than skin/2.
+ *
+ * \return true if lists were rebuilt
+ */
+bool updatePositions(BoidsData& boidsData, VerletList& verlet);
+
+// ===================================================
+// ===================================================
+/**
+ * Build the quadtree of the flock (see QuadTree) : root cell from the flock
+ * bounding box (flock statistics must be up to date, see updateFlockStats), boids
+ * sorted by leaf, then cells computed level by level from the leaves up.
+ */
+void buildQuadTree(BoidsData& boidsData, QuadTree& tree);
+
+// ===================================================
+// ===================================================
+/**
+ * Compute the Barnes-Hut cohesion of every boid (see barnesHutCohesion), without
+ * moving boids : used to time the traversal.
+ *
+ * \return the mean number of interactions per boid
+ */
+double barnesHutTraversal(BoidsData& boidsData, const QuadTree& tree);
+
+// ===================================================
+// ===================================================
+/**
+ * Relative RMS error of the Barnes-Hut cohesion and alignment targets, compared
+ * to the exact O(N) sum over all boids, on nSamples boids evenly spread over the
+ * flock (targets are taken relative to the boid, i.e. xg-x and vxg-vx).
+ */
+void barnesHutError(BoidsData& boidsData, const QuadTree& tree, int nSamples,
+                    double& cohesionError, double& alignmentError);
+
+// ===================================================
+// ===================================================
+/**
+ * Same as updatePositions, with cohesion (rule #1) and alignment (rule #2)
+ * towards the distance-weighted centroid and mean velocity of the other boids,
+ * computed from a quadtree rebuilt every step (instead of the domain center and
+ * the flock mean velocity).
+ */
+void updatePositions(BoidsData& boidsData, QuadTree& tree);
+
 // ===================================================
 // ===================================================
 void copyPositionsForRendering(BoidsData& boidsData);
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <math.h>
+
+// Include Kokkos Headers
+#include<Kokkos_Core.hpp>
+
+#include "Array.h"
+
+// ===================================================
+// ===================================================
+/**
+ * Flock statistics gathered in a single reduction (see updateFlockStats) :
+ * sums of velocities and positions, bounding box, speed range.
+ */
+template <typename T>
+struct FlockStats
+{
+  //! index of each sum
+  enum { DX = 0, DY = 1, X = 2, Y = 3 };
+
+  //! sums of dx, dy, x and y
+  Array_t<T,4> sum;
+
+  //! bounding box
+  T xmin, xmax, ymin, ymax;
+
+  //! speed range
+  T speed_min, speed_max;
+
+  //! mean of sum component i over n boids
+  KOKKOS_INLINE_FUNCTION
+  T mean(int i, int n) const { return sum.data[i] / n; }
+
+}; // struct FlockStats
+
+// ===================================================
+// ===================================================
+/**
+ * Custom reducer for FlockStats.
+ *
+ * The result can be a device View : then parallel_reduce does not wait for the
+ * result, and kernels launched afterwards read it directly from device memory.
+ */
+template <typename T, class Space>
+struct FlockStatsReducer
+{
+public:
+
+  using reducer          = FlockStatsReducer;
+  using value_type       = FlockStats<T>;
+  using result_view_type = Kokkos::View<value_type, Space, Kokkos::MemoryTraits<Kokkos::Unmanaged>>;
+
+private:
+
+  result_view_type value;
+  bool references_scalar_v;
+
+public:
+
+  KOKKOS_INLINE_FUNCTION
+  FlockStatsReducer(value_type& value_)
+    : value(&value_), references_scalar_v(true) {}
+
+  KOKKOS_INLINE_FUNCTION
+  FlockStatsReducer(const result_view_type& value_)
+    : value(value_), references_scalar_v(false) {}
+
+  KOKKOS_INLINE_FUNCTION
+  void join(value_type& dest, const value_type& src) const
+  {
+    dest.sum += src.sum;
+    dest.xmin = (src.xmin < dest.xmin) ? src.xmin : dest.xmin;
+    dest.xmax = (src.xmax > dest.xmax) ? src.xmax : dest.xmax;
+    dest.ymin = (src.ymin < dest.ymin) ? src.ymin : dest.ymin;
+    dest.ymax = (src.ymax > dest.ymax) ? src.ymax : dest.ymax;
+    dest.speed_min = (src.speed_min < dest.speed_min) ? src.speed_min : dest.speed_min;
+    dest.speed_max = (src.speed_max > dest.speed_max) ? src.speed_max : dest.speed_max;
+  }
+
+  KOKKOS_INLINE_FUNCTION
+  void join(volatile value_type& dest, const volatile value_type& src) const
+  {
+    dest.sum += src.sum;
+    dest.xmin = (src.xmin < dest.xmin) ? src.xmin : dest.xmin;
+    dest.xmax = (src.xmax > dest.xmax) ? src.xmax : dest.xmax;
+    dest.ymin = (src.ymin < dest.ymin) ? src.ymin : dest.ymin;
+    dest.ymax = (src.ymax > dest.ymax) ? src.ymax : dest.ymax;
+    dest.speed_min = (src.speed_min < dest.speed_min) ? src.speed_min : dest.speed_min;
+    dest.speed_max = (src.speed_max > dest.speed_max) ? src.speed_max : dest.speed_max;
+  }
+
+  KOKKOS_INLINE_FUNCTION
+  void init(value_type& val) const
+  {
+    val.sum = Array_t<T,4>();
+    val.xmin = val.ymin = val.speed_min = Kokkos::reduction_identity<T>::min();
+    val.xmax = val.ymax = val.speed_max = Kokkos::reduction_identity<T>::max();
+  }
+
+  KOKKOS_INLINE_FUNCTION
+  value_type& reference() const { return *value.data(); }
+
+  KOKKOS_INLINE_FUNCTION
+  result_view_type view() const { return value; }
+
+  KOKKOS_INLINE_FUNCTION
+  bool references_scalar() const { return references_scalar_v; }
+
+}; // struct FlockStatsReducer
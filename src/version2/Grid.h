@@ -0,0 +1,280 @@
+#pragma once
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+// Include Kokkos Headers
+#include<Kokkos_Core.hpp>
+
+#include "utils/kernel-type.h"
+#include "utils/morton-utils.h"
+
+// ===================================================
+// ===================================================
+/**
+ * Uniform cartesian grid over the flight domain [xmin,xmax]x[ymin,ymax],
+ * used to bin boids into boxes (cells).
+ *
+ * Domain and resolution are runtime parameters; Grid::automatic sizes both from
+ * the number of boids and the neighbour distance, so that the number of boxes
+ * grows with the flock instead of the box population.
+ *
+ * Boxes (i,j) are numbered row major (i + nx*j), or along a Z-order curve (see
+ * setCellOrder) : boids being sorted by box, the boxes around a box, hence their
+ * boids, are then mostly close in memory.
+ *
+ * The domain is either open (border boxes extend to infinity and hold the boids
+ * outside of the domain), or periodic (toroidal) : box indexes outside [0,n) are
+ * ghosts of the boxes n away, positions wrap around and neighbours are taken at
+ * their closest image (see wrap, image).
+ */
+struct Grid
+{
+  //! reference flock : 1000 boids in a 150x150 domain (constant density scaling)
+  static constexpr int   REFERENCE_NBOIDS      = 1000;
+  static constexpr float REFERENCE_DOMAIN_SIZE = 150;
+
+  //! target mean number of boids per box (automatic resolution)
+  static constexpr int TARGET_BOIDS_PER_BOX = 16;
+
+  //! maximum number of boxes per direction
+  static constexpr int MAX_BOX_PER_DIM = 1 << 14;
+
+  float xmin, xmax;
+  float ymin, ymax;
+
+  //! number of boxes along x and y
+  int nx, ny;
+
+  //! periodic (toroidal) domain
+  bool periodic = false;
+
+  //! boxes numbering
+  kboids::CellOrder order = kboids::CellOrder::ROW_MAJOR;
+
+  //! box index from row major index, and the reverse (only used with MORTON order)
+  Kokkos::View<int*, Kokkos::DefaultExecutionSpace> cell_from_row, row_from_cell;
+
+  //! number of boxes
+  KOKKOS_INLINE_FUNCTION
+  int nBoxes() const { return nx * ny; }
+
+  //! box coordinate along direction dir (positions outside are clamped to the
+  //! border boxes, or wrapped in a periodic domain)
+  template <int dir>
+  KOKKOS_INLINE_FUNCTION
+  int box(float v) const
+  {
+    const float vmin = (dir == 0) ? xmin : ymin;
+    const float vmax = (dir == 0) ? xmax : ymax;
+    const int   n    = (dir == 0) ? nx   : ny;
+
+    int i = (int) floor( (v-vmin)/(vmax-vmin)*n );
+    if (periodic)
+      return wrap_box<dir>(i);
+    if (i<0) i=0;
+    if (i>=n) i=n-1;
+    return i;
+  }
+
+  //! box coordinate i along direction dir, ghost boxes of a periodic domain
+  //! brought back into [0,n)
+  template <int dir>
+  KOKKOS_INLINE_FUNCTION
+  int wrap_box(int i) const
+  {
+    const int n = (dir == 0) ? nx : ny;
+    i %= n;
+    return (i < 0) ? i+n : i;
+  }
+
+  /**
+   * Boxes [first,last] at most r boxes away from box i along direction dir :
+   * clamped to the grid, or ghost boxes of a periodic domain, each box being
+   * taken once when 2r+1 > n.
+   */
+  template <int dir>
+  KOKKOS_INLINE_FUNCTION
+  void box_range(int i, int r, int& first, int& last) const
+  {
+    const int n = (dir == 0) ? nx : ny;
+
+    if (periodic)
+    {
+      first = (2*r+1 > n) ? i - (n-1)/2 : i - r;
+      last  = (2*r+1 > n) ? first + n-1 : i + r;
+    }
+    else
+    {
+      first = (i-r < 0)  ? 0   : i-r;
+      last  = (i+r >= n) ? n-1 : i+r;
+    }
+  }
+
+  //! true when the boxes at most r boxes away along direction dir span the
+  //! whole periodic domain (see box_range)
+  template <int dir>
+  KOKKOS_INLINE_FUNCTION
+  bool spans_domain(int r) const
+  {
+    const int n = (dir == 0) ? nx : ny;
+    return periodic and 2*r+1 > n;
+  }
+
+  /**
+   * Distance along direction dir from v to box i (possibly a ghost box). Border
+   * boxes of an open domain extend to infinity.
+   *
+   * In a periodic domain, the ghost box is assumed to be the closest image of
+   * box i : when box_range spans the whole domain (see spans_domain), callers
+   * must not cull boxes on this distance.
+   */
+  template <int dir, typename T>
+  KOKKOS_INLINE_FUNCTION
+  T box_distance(T v, int i) const
+  {
+    const int n   = (dir == 0) ? nx : ny;
+    const T   h   = (dir == 0) ? hx() : hy();
+    const T   vlo = ((dir == 0) ? xmin : ymin) + i*h;
+
+    T d = 0;
+    if ((periodic or i > 0)   and v < vlo)   d = vlo - v;
+    if ((periodic or i < n-1) and v > vlo+h) d = v - (vlo+h);
+    return d;
+  }
+
+  //! position v brought back into the domain along direction dir (periodic
+  //! domain only, v is returned unchanged in an open domain)
+  template <int dir, typename T>
+  KOKKOS_INLINE_FUNCTION
+  T wrap(T v) const
+  {
+    if (not periodic)
+      return v;
+
+    const T vmin = (dir == 0) ? xmin : ymin;
+    const T L    = (dir == 0) ? xmax-xmin : ymax-ymin;
+    return v - L*floor((v-vmin)/L);
+  }
+
+  //! image of neighbour position vk closest to v along direction dir (periodic
+  //! domain only, vk is returned unchanged in an open domain)
+  template <int dir, typename T>
+  KOKKOS_INLINE_FUNCTION
+  T image(T v, T vk) const
+  {
+    if (not periodic)
+      return vk;
+
+    const T L = (dir == 0) ? xmax-xmin : ymax-ymin;
+    return vk - L*floor((vk-v)/L + T(0.5));
+  }
+
+  //! index of box (i,j)
+  KOKKOS_INLINE_FUNCTION
+  int cell(int i, int j) const
+  {
+    const int r = i + nx * j;
+    return (order == kboids::CellOrder::MORTON) ? cell_from_row(r) : r;
+  }
+
+  //! coordinates (i,j) of box c
+  KOKKOS_INLINE_FUNCTION
+  void cell_coords(int c, int& i, int& j) const
+  {
+    const int r = (order == kboids::CellOrder::MORTON) ? row_from_cell(c) : c;
+    i = r % nx;
+    j = r / nx;
+  }
+
+  /**
+   * Change boxes numbering. Morton numbering is the rank of box (i,j) along the
+   * Z-order curve, so that box indexes stay in [0, nBoxes) for any nx, ny.
+   */
+  void setCellOrder(kboids::CellOrder newOrder)
+  {
+    order = newOrder;
+
+    if (order != kboids::CellOrder::MORTON)
+      return;
+
+    const int n = nBoxes();
+
+    std::vector<int> rows(n);
+    for (int r = 0; r < n; ++r)
+      rows[r] = r;
+
+    std::sort(rows.begin(), rows.end(), [&](int a, int b)
+    {
+      return kboids::morton_encode(a % nx, a / nx) < kboids::morton_encode(b % nx, b / nx);
+    });
+
+    cell_from_row = Kokkos::View<int*, Kokkos::DefaultExecutionSpace>("cell from row", n);
+    row_from_cell = Kokkos::View<int*, Kokkos::DefaultExecutionSpace>("row from cell", n);
+
+    auto cell_from_row_host = Kokkos::create_mirror_view(cell_from_row);
+    auto row_from_cell_host = Kokkos::create_mirror_view(row_from_cell);
+
+    for (int c = 0; c < n; ++c)
+    {
+      row_from_cell_host(c) = rows[c];
+      cell_from_row_host(rows[c]) = c;
+    }
+
+    Kokkos::deep_copy(cell_from_row, cell_from_row_host);
+    Kokkos::deep_copy(row_from_cell, row_from_cell_host);
+  }
+
+  //! box size along x and y
+  KOKKOS_INLINE_FUNCTION
+  float hx() const { return (xmax-xmin)/nx; }
+
+  KOKKOS_INLINE_FUNCTION
+  float hy() const { return (ymax-ymin)/ny; }
+
+  //! number of box rings to visit to find all neighbours within distance
+  //! (1, i.e. 3x3 boxes, when boxes are not smaller than distance)
+  int ring_x(float distance) const { return (int) ceil(distance/hx()); }
+  int ring_y(float distance) const { return (int) ceil(distance/hy()); }
+
+  //! center of the domain
+  KOKKOS_INLINE_FUNCTION
+  float xc() const { return (xmin+xmax)/2; }
+
+  KOKKOS_INLINE_FUNCTION
+  float yc() const { return (ymin+ymax)/2; }
+
+  /**
+   * Grid with automatic resolution over [0,size]x[0,size].
+   *
+   * \param[in] nBoids is the number of boids
+   * \param[in] minDistance is the neighbour distance : boxes are never smaller,
+   *            so that neighbours of a boid are at most one box away
+   * \param[in] size is the domain size; if <= 0, the domain is scaled with the
+   *            flock to keep the reference density
+   * \param[in] nx, ny force the number of boxes along x/y if > 0
+   */
+  static Grid automatic(int nBoids, float minDistance, float size = 0, int nx = 0, int ny = 0)
+  {
+    Grid grid;
+
+    if (size <= 0)
+      size = REFERENCE_DOMAIN_SIZE *
+        sqrt(fmax(1.0, double(nBoids)/REFERENCE_NBOIDS));
+
+    grid.xmin = 0; grid.xmax = size;
+    grid.ymin = 0; grid.ymax = size;
+
+    // box size : TARGET_BOIDS_PER_BOX boids per box on average, at least minDistance
+    const double h = fmax(minDistance, sqrt(double(size)*size*TARGET_BOIDS_PER_BOX/nBoids));
+    const int n = (int) fmin(fmax(1.0, floor(size/h)), MAX_BOX_PER_DIM);
+
+    grid.nx = (nx > 0) ? nx : n;
+    grid.ny = (ny > 0) ? ny : n;
+
+    return grid;
+  }
+
+}; // struct Grid
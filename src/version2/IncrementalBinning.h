@@ -0,0 +1,69 @@
+#pragma once
+
+// Include Kokkos Headers
+#include<Kokkos_Core.hpp>
+
+// ===================================================
+// ===================================================
+/**
+ * Incremental re-binning (optional alternative to recomputing box data and
+ * sorting all boids every step).
+ *
+ * Only boids that changed box since the last step (movers) update box
+ * populations; boids that stayed keep their relative order in their box, movers
+ * are appended to their new box by increasing previous index (stable counting
+ * sort of movers by new box). When movers exceed maxMoverFraction of the flock,
+ * box data are fully recomputed (see computeBoxData).
+ */
+struct IncrementalBinning
+{
+  using VecInt = Kokkos::View<int*, Kokkos::DefaultExecutionSpace>;
+
+  //! default fraction of movers above which box data are fully recomputed
+  static constexpr float MAX_MOVER_FRACTION = 0.25;
+
+  //! \param[in] nBoids is the number of boids
+  //! \param[in] nBoxes is the number of boxes
+  //! \param[in] maxMoverFraction is the fraction of movers triggering a full rebuild
+  IncrementalBinning(int nBoids, int nBoxes, float maxMoverFraction = MAX_MOVER_FRACTION)
+    : maxMoverFraction(maxMoverFraction),
+      newColor("new color", nBoids),
+      moverScan("movers before", nBoids+1),
+      movers("movers", nBoids),
+      moverColor("movers new box", nBoids),
+      oldIndex("old box index", nBoxes),
+      oldCount("old box count", nBoxes),
+      firstArrival("first arrival", nBoxes),
+      permutation("rebinning permutation", nBoids)
+  {}
+
+  //! fraction of movers triggering a full rebuild
+  float maxMoverFraction;
+
+  //! box of each boid after moving
+  VecInt newColor;
+
+  //! number of movers before each boid (exclusive scan, moverScan(nBoids) is the total)
+  VecInt moverScan;
+
+  //! indexes of movers (first moverScan(nBoids) entries)
+  VecInt movers;
+
+  //! new box of each mover (sorted by box during the update)
+  VecInt moverColor;
+
+  //! box offsets and populations before the update
+  VecInt oldIndex, oldCount;
+
+  //! rank of the first mover arrived in each box, among movers sorted by box
+  VecInt firstArrival;
+
+  //! boids new order
+  Kokkos::View<unsigned int*, Kokkos::DefaultExecutionSpace> permutation;
+
+  //! statistics : steps, full rebuilds and total number of movers
+  int nSteps = 0;
+  int nFullRebuilds = 0;
+  double nMovers = 0;
+
+}; // struct IncrementalBinning
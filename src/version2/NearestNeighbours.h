@@ -0,0 +1,53 @@
+#pragma once
+
+// Include Kokkos Headers
+#include<Kokkos_Core.hpp>
+
+// ===================================================
+// ===================================================
+/**
+ * Topological neighbours (optional alternative to metric neighbours) : every
+ * boid interacts with its k nearest boids, whatever their distance, so that the
+ * work per boid does not depend on the flock density.
+ *
+ * Neighbours are searched through the boxes, ring after ring around the box of
+ * the boid, until no unvisited box can hold a boid closer than the k-th nearest
+ * found (see findNearestNeighbours). Indexes refer to boids sorted by box.
+ */
+struct NearestNeighbours
+{
+  //! default number of neighbours (starlings interact with 6 to 7 neighbours)
+  static constexpr int K = 7;
+
+  //! maximum number of neighbours
+  static constexpr int MAX_K = 32;
+
+  //! \param[in] nBoids is the number of boids
+  //! \param[in] k is the number of neighbours (at most MAX_K and nBoids-1)
+  NearestNeighbours(int nBoids, int k = K)
+    : k(clamp_k(k, nBoids)),
+      neighbours("nearest neighbours", nBoids, this->k)
+  {}
+
+  //! number of neighbours per boid
+  int k;
+
+  //! k nearest neighbours of each boid, nearest first
+  Kokkos::View<int**, Kokkos::DefaultExecutionSpace> neighbours;
+
+  //! statistics : steps, box rings visited, and time spent searching / in whole steps
+  int nSteps = 0;
+  double nRings = 0;
+  double searchTime = 0;
+  double stepTime = 0;
+
+private:
+
+  static int clamp_k(int k, int nBoids)
+  {
+    if (k > MAX_K)    k = MAX_K;
+    if (k > nBoids-1) k = nBoids-1;
+    return (k < 1) ? 1 : k;
+  }
+
+}; // struct NearestNeighbours
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <math.h>
+
+// Include Kokkos Headers
+#include<Kokkos_Core.hpp>
+
+#include "utils/morton-utils.h"
+#include "utils/precision-policy.h"
+#include "utils/sort-utils.h"
+
+// ===================================================
+// ===================================================
+/**
+ * Complete quadtree over the bounding square of the flock, used to approximate
+ * distance-weighted cohesion and alignment (Barnes-Hut, see barnesHutCohesion).
+ *
+ * Level l has 2^l x 2^l cells, numbered along a Z-order curve, so that the
+ * children of cell c of level l are cells 4c to 4c+3 of level l+1. All cells of
+ * all levels are stored level after level (level l starts at levelOffset(l)).
+ *
+ * Boids are sorted by leaf (stable counting sort on leaf Morton keys, work views
+ * allocated once), leaves store the range of their boids; every cell stores its
+ * number of boids, their centroid and their mean velocity.
+ */
+struct QuadTree
+{
+  using value_t = kboids::DefaultPrecision::value_t;
+
+  using VecInt   = Kokkos::View<int*,     Kokkos::DefaultExecutionSpace>;
+  using VecValue = Kokkos::View<value_t*, Kokkos::DefaultExecutionSpace>;
+
+  //! default opening angle
+  static constexpr float THETA = 0.5;
+
+  //! target mean number of boids per leaf (uniform flock)
+  static constexpr int TARGET_BOIDS_PER_LEAF = 8;
+
+  //! maximum depth (4^MAX_DEPTH leaves)
+  static constexpr int MAX_DEPTH = 10;
+
+  //! maximum traversal stack size (3 siblings pending per level, plus one)
+  static constexpr int STACK_SIZE = 3*MAX_DEPTH + 1;
+
+  //! depth of the tree for nBoids boids
+  static int depth_for(int nBoids)
+  {
+    const double nLeaves = fmax(1.0, double(nBoids) / TARGET_BOIDS_PER_LEAF);
+    const int depth = (int) ceil(log(nLeaves) / log(4.0));
+    return (depth < 1) ? 1 : ((depth > MAX_DEPTH) ? MAX_DEPTH : depth);
+  }
+
+  //! index of the first cell of level l
+  KOKKOS_INLINE_FUNCTION
+  static int levelOffset(int l) { return ((1 << (2*l)) - 1) / 3; }
+
+  //! \param[in] nBoids is the number of boids
+  //! \param[in] theta is the opening angle
+  QuadTree(int nBoids, float theta = THETA)
+    : theta(theta),
+      depth(depth_for(nBoids)),
+      nLeaves(1 << (2*depth)),
+      nCells(levelOffset(depth+1)),
+      bounds("quadtree bounds", 3),
+      leafKey("leaf key", nBoids),
+      leafCount("leaf count", nLeaves),
+      leafOffset("leaf offset", nLeaves),
+      countingSort(nBoids),
+      x("quadtree x", nBoids),
+      y("quadtree y", nBoids),
+      dx("quadtree dx", nBoids),
+      dy("quadtree dy", nBoids),
+      count("cell count", nCells),
+      cx("cell centroid x", nCells),
+      cy("cell centroid y", nCells),
+      cdx("cell mean dx", nCells),
+      cdy("cell mean dy", nCells)
+  {}
+
+  //! opening angle : a cell of size s at distance d is approximated when s < theta d
+  float theta;
+
+  //! leaves level
+  int depth;
+
+  //! number of leaves and of cells (all levels)
+  int nLeaves, nCells;
+
+  //! root cell : lower left corner and size (in device memory)
+  Kokkos::View<float*, Kokkos::DefaultExecutionSpace> bounds;
+
+  //! leaf of each boid (sorted on exit of buildQuadTree)
+  VecInt leafKey;
+
+  //! number of boids per leaf, and index of the first one (exclusive scan)
+  VecInt leafCount, leafOffset;
+
+  //! sort of boids by leaf
+  kboids::CountingSort<VecInt> countingSort;
+
+  //! boids in leaf order : original index (a view of countingSort), positions
+  //! and velocities
+  Kokkos::View<unsigned int*, Kokkos::DefaultExecutionSpace> boid;
+  VecValue x, y, dx, dy;
+
+  //! cells : number of boids, centroid and mean velocity
+  VecInt count;
+  VecValue cx, cy, cdx, cdy;
+
+  //! size of a cell of level l
+  KOKKOS_INLINE_FUNCTION
+  float size(int l) const { return bounds(2) / (1 << l); }
+
+  //! leaf Morton key of position (x,y) (positions outside are clamped)
+  KOKKOS_INLINE_FUNCTION
+  int leaf(float xp, float yp) const
+  {
+    const int n = 1 << depth;
+
+    int i = (int) floor( (xp - bounds(0)) / bounds(2) * n );
+    int j = (int) floor( (yp - bounds(1)) / bounds(2) * n );
+
+    i = (i < 0) ? 0 : ((i >= n) ? n-1 : i);
+    j = (j < 0) ? 0 : ((j >= n) ? n-1 : j);
+
+    return (int) kboids::morton_encode(i, j);
+  }
+
+}; // struct QuadTree
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <math.h>
+
+// Include Kokkos Headers
+#include<Kokkos_Core.hpp>
+
+// ===================================================
+// ===================================================
+/**
+ * Two level grid for clustered flocks (optional alternative to the flat grid).
+ *
+ * Boxes of the grid holding more than threshold boids are refined into r x r
+ * cells, r chosen from the box population (about TARGET_BOIDS_PER_CELL boids per
+ * cell); other boxes are a single cell. Cells of a box are numbered row major
+ * after the cells of the previous boxes (box b owns cells cellOffset(b) to
+ * cellOffset(b+1)-1), so that boids sorted by cell are still sorted by box : box
+ * data (boxCount, boxIndex, ...) keep their meaning.
+ *
+ * See computeBoxData(BoidsData&, RefinedGrid&).
+ */
+struct RefinedGrid
+{
+  using VecInt = Kokkos::View<int*, Kokkos::DefaultExecutionSpace>;
+
+  //! default box population above which a box is refined
+  static constexpr int THRESHOLD = 64;
+
+  //! target mean number of boids per cell of a refined box
+  static constexpr int TARGET_BOIDS_PER_CELL = 16;
+
+  //! maximum number of cells per direction in a box
+  static constexpr int MAX_REFINEMENT = 16;
+
+  //! number of cells per direction of a box holding n boids
+  KOKKOS_INLINE_FUNCTION
+  static int refinement_for(int n, int threshold)
+  {
+    if (n <= threshold)
+      return 1;
+
+    const int r = (int) ceil(sqrt(double(n) / TARGET_BOIDS_PER_CELL));
+    return (r > MAX_REFINEMENT) ? MAX_REFINEMENT : r;
+  }
+
+  //! \param[in] nBoids is the number of boids
+  //! \param[in] nBoxes is the number of boxes of the grid
+  //! \param[in] threshold is the box population above which a box is refined
+  RefinedGrid(int nBoids, int nBoxes, int threshold = THRESHOLD)
+    : threshold(threshold),
+      refinement("box refinement", nBoxes),
+      cellOffset("box first cell", nBoxes+1),
+      cellKey("cell key", nBoids),
+      cellCount("cell count", nBoxes),
+      cellIndex("cell index", nBoxes),
+      color_tmp("color_tmp", nBoids)
+  {}
+
+  //! box population above which a box is refined
+  int threshold;
+
+  //! number of cells per direction of each box
+  VecInt refinement;
+
+  //! index of the first cell of each box (cellOffset(nBoxes) is the number of cells)
+  VecInt cellOffset;
+
+  //! cell of each boid (sorted on exit of computeBoxData)
+  VecInt cellKey;
+
+  //! number of boids per cell, and index of the first one (grown when needed, never shrunk)
+  VecInt cellCount, cellIndex;
+
+  //! used to sort boids color
+  VecInt color_tmp;
+
+  //! number of cells, and of refined boxes, at the last update
+  int nCells = 0;
+  int nRefinedBoxes = 0;
+
+}; // struct RefinedGrid
@@ -0,0 +1,52 @@
+#pragma once
+
+// Include Kokkos Headers
+#include<Kokkos_Core.hpp>
+
+#include "utils/precision-policy.h"
+
+// ===================================================
+// ===================================================
+/**
+ * Separation computed box by box in team scratch memory (optional alternative
+ * to every boid walking the boxes around its own, see computeSeparationTiled).
+ *
+ * One team handles one box : positions of the boids of the boxes around it
+ * (stencil) are staged once in scratch memory, then every boid of the box reads
+ * its neighbours from there instead of main memory. Boxes whose stencil holds
+ * more than capacity boids fall back to the main memory walk.
+ */
+struct SeparationTiles
+{
+  using compute_t = kboids::DefaultPrecision::compute_t;
+  using VecCompute = Kokkos::View<compute_t*, Kokkos::DefaultExecutionSpace>;
+
+  //! size in bytes of a staged boid (position)
+  static constexpr size_t BYTES_PER_BOID = 2*sizeof(compute_t);
+
+  //! largest capacity fitting in level 0 scratch memory
+  static int max_capacity()
+  {
+    return Kokkos::TeamPolicy<>::scratch_size_max(0) / BYTES_PER_BOID;
+  }
+
+  //! \param[in] nBoids is the number of boids
+  //! \param[in] capacity is the number of boids staged per team (<= 0 : max_capacity)
+  SeparationTiles(int nBoids, int capacity = 0)
+    : capacity((capacity > 0 and capacity < max_capacity()) ? capacity : max_capacity()),
+      sep_x("separation x", nBoids),
+      sep_y("separation y", nBoids)
+  {}
+
+  //! maximum number of boids staged per team
+  int capacity;
+
+  //! separation (rule #3) of each boid
+  VecCompute sep_x, sep_y;
+
+  //! statistics : steps, non empty boxes and boxes that overflowed scratch memory
+  int nSteps = 0;
+  double nBoxes = 0;
+  double nOverflows = 0;
+
+}; // struct SeparationTiles
@@ -0,0 +1,60 @@
+#pragma once
+
+// Include Kokkos Headers
+#include<Kokkos_Core.hpp>
+
+#include "utils/precision-policy.h"
+
+// ===================================================
+// ===================================================
+/**
+ * Verlet neighbour lists (optional alternative to walking the boxes every step).
+ *
+ * Each boid stores the indexes of all boids closer than minDistance + skin when
+ * lists are built. As long as no boid has moved by more than skin/2 since then,
+ * every pair closer than minDistance is still in the lists, so that boxes are
+ * only recomputed and boids only sorted when lists are rebuilt.
+ *
+ * Lists are stored back to back (compressed rows) : neighbours of boid index are
+ * neighbours(offset(index)) to neighbours(offset(index+1)-1), so that memory
+ * follows the actual number of pairs, even in dense clusters.
+ *
+ * Indexes refer to the order of boids at build time : boids must not be
+ * permuted between two builds.
+ */
+struct VerletList
+{
+  using value_t = kboids::DefaultPrecision::value_t;
+
+  using VecInt   = Kokkos::View<int*,     Kokkos::DefaultExecutionSpace>;
+  using VecValue = Kokkos::View<value_t*, Kokkos::DefaultExecutionSpace>;
+
+  //! \param[in] nBoids is the number of boids
+  //! \param[in] skin is the margin added to the neighbour distance
+  VerletList(int nBoids, float skin)
+    : skin(skin),
+      offset("neighbours offset", nBoids+1),
+      neighbours("neighbours", 0),
+      x0("x at build", nBoids),
+      y0("y at build", nBoids)
+  {}
+
+  //! margin added to the neighbour distance
+  float skin;
+
+  //! index of the first neighbour of each boid (offset(nBoids) is the number of pairs)
+  VecInt offset;
+
+  //! neighbour indexes (grown when needed, never shrunk)
+  VecInt neighbours;
+
+  //! positions at build time (used to track displacements)
+  VecValue x0, y0;
+
+  //! statistics : time steps, builds, and time spent in steps with/without build
+  int nSteps = 0;
+  int nBuilds = 0;
+  double buildStepsTime = 0;
+  double reuseStepsTime = 0;
+
+}; // struct VerletList
@@ -24,6 +24,32 @@ void usage(const std::string &app_name)
       "  -n, --nboids arg        Number of boids (default: 1000)\n"
       "  -i, --iter arg          Number of time steps (default: 100)\n"
       "  -s, --seed arg          Random seed (default: 42)\n"
+      "  --domain arg            Flight domain size, i.e. [0,arg]^2 (default: 0, i.e. scaled with the number of boids)\n"
+      "  --nbox-x arg            Number of boxes along x (default: 0, i.e. chosen from number of boids and min distance)\n"
+      "  --nbox-y arg            Number of boxes along y (default: 0, i.e. chosen from number of boids and min distance)\n"
+      "  --min-distance arg      Neighbour distance (default: 20)\n"
+      "  --periodic              Periodic (toroidal) domain : boids wrap around instead of being turned back at the borders\n"
+      "  --cell-order arg        Boxes numbering : row (row major) or morton (default: morton)\n"
+      "  --cell-bench            Time neighbour boxes traversal with row major and morton numbering (arg -i traversals)\n"
+      "  --clusters arg          Initial flock in arg gaussian clusters (default: 0, i.e. uniform flock)\n"
+      "  --cluster-radius arg    Clusters standard deviation (default: 40)\n"
+      "  --refine                Refine boxes holding too many boids into smaller cells (two level grid)\n"
+      "  --refine-threshold arg  Box population above which a box is refined (default: 64)\n"
+      "  --grid-bench            Time binning and neighbour traversal of a clustered flock with flat and refined grids (arg -i repetitions)\n"
+      "  --tiled                 Compute separation box by box, neighbours staged in team scratch memory\n"
+      "  --tile-capacity arg     Number of boids staged per box (default: 0, i.e. as many as fit in scratch memory)\n"
+      "  --accumulation arg      Box data accumulation : atomic, scatter, private or auto (default: auto)\n"
+      "  --incremental           Only move boids that changed box when updating box data\n"
+      "  --rebin-threshold arg   Fraction of boids changing box above which box data are fully recomputed (default: 0.25)\n"
+      "  --adaptive-sort         Only sort boids by box when too many of them left their box\n"
+      "  --sort-threshold arg    Fraction of boids out of their box above which boids are sorted (default: 0.5)\n"
+      "  --barnes-hut            Steer boids to the distance-weighted centroid and mean velocity of the flock (quadtree)\n"
+      "  --theta arg             Barnes-Hut opening angle (default: 0.5)\n"
+      "  --bh-bench              Time Barnes-Hut cohesion versus number of boids and check its accuracy versus theta (arg -i repetitions)\n"
+      "  --topological           Boids interact with their k nearest neighbours instead of the whole flock / boids closer than min distance\n"
+      "  --knn arg               Number of topological neighbours (default: 7, at most 32)\n"
+      "  --verlet                Use Verlet neighbour lists, rebuilt when a boid moved by more than skin/2\n"
+      "  --skin arg              Verlet lists skin distance (default: 20, the speed limit)\n"
       "  -d, --dump              Dump data to PNG files\n"
       "  -g, --gui               Add a simple visualization gui (require FORGE library)\n"
       "  -h, --help              Show this help";
@@ -64,23 +90,119 @@ int main(int argc, char* argv[])
       "-n", "--nboids",
       "-i", "--iter",
       "-s", "--seed",
+      "--domain",
+      "--nbox-x",
+      "--nbox-y",
+      "--min-distance",
+      "--skin",
+      "--accumulation",
+      "--clusters",
+      "--cluster-radius",
+      "--refine-threshold",
+      "--tile-capacity",
+      "--cell-order",
+      "--rebin-threshold",
+      "--sort-threshold",
+      "--theta",
+      "--knn",
       "-d", "--dump",
       "-g", "--gui"});
     cmdl.parse(argc, argv);
 
 
-  int nBoids;
-  cmdl({"n", "nboids"}, 1000) >> nBoids;
+  RunParams params;
 
-  uint32_t nIter;
-  cmdl({"i", "iter"}, 100) >> nIter;
+  cmdl({"n", "nboids"}, 1000) >> params.nBoids;
+
+  cmdl({"i", "iter"}, 100) >> params.nIter;
 
   // initialize the random generator pool
   //uint64_t seed = std::chrono::high_resolution_clock::now().time_since_epoch().count();
-  uint64_t seed;
-  cmdl({"s", "seed"}, 42) >> seed;
+  cmdl({"s", "seed"}, 42) >> params.seed;
+
+  // flight domain and boxes
+  cmdl({"domain"}, 0) >> params.domainSize;
+  cmdl({"nbox-x"}, 0) >> params.nbox_x;
+  cmdl({"nbox-y"}, 0) >> params.nbox_y;
+  cmdl({"min-distance"}, 20) >> params.minDistance;
+  params.periodic = cmdl[{"--periodic"}];
+
+  // boxes numbering
+  std::string cell_order_name;
+  cmdl({"cell-order"}, "morton") >> cell_order_name;
+  if (not kboids::cell_order_from_string(cell_order_name, params.cellOrder))
+  {
+    std::cerr << "Unknown cell order : " << cell_order_name << "\n";
+    return EXIT_FAILURE;
+  }
+
+  params.cell_order_benchmark = cmdl[{"cell-bench"}];
+
+  // initial flock
+  cmdl({"clusters"}, 0) >> params.nClusters;
+  cmdl({"cluster-radius"}, 40) >> params.clusterRadius;
+
+  // two level grid
+  params.refine = cmdl[{"--refine"}];
+  cmdl({"refine-threshold"}, 64) >> params.refineThreshold;
+  params.grid_benchmark = cmdl[{"grid-bench"}];
+
+  // separation in team scratch memory
+  params.tiled = cmdl[{"--tiled"}];
+  cmdl({"tile-capacity"}, 0) >> params.tileCapacity;
+
+  // box data accumulation strategy
+  std::string accumulation_name;
+  cmdl({"accumulation"}, "auto") >> accumulation_name;
+  if (not kboids::box_accumulation_from_string(accumulation_name, params.accumulation))
+  {
+    std::cerr << "Unknown box accumulation : " << accumulation_name << "\n";
+    return EXIT_FAILURE;
+  }
+
+  // incremental box data update
+  params.incremental = cmdl[{"--incremental"}];
+  cmdl({"rebin-threshold"}, 0.25) >> params.rebinThreshold;
+
+  // adaptive sort frequency
+  params.adaptiveSort = cmdl[{"--adaptive-sort"}];
+  cmdl({"sort-threshold"}, AdaptiveSort::THRESHOLD) >> params.sortThreshold;
+
+  // Barnes-Hut cohesion and alignment
+  params.barnesHut = cmdl[{"--barnes-hut"}];
+  cmdl({"theta"}, 0.5) >> params.theta;
+  params.barnes_hut_benchmark = cmdl[{"bh-bench"}];
+  if (params.periodic and (params.barnesHut or params.barnes_hut_benchmark))
+  {
+    std::cerr << "Barnes-Hut quadtree does not support a periodic domain\n";
+    return EXIT_FAILURE;
+  }
+
+  if (params.barnes_hut_benchmark and params.nBoids < 2)
+  {
+    std::cerr << "Barnes-Hut benchmark needs at least 2 boids\n";
+    return EXIT_FAILURE;
+  }
+
+  // topological neighbours
+  params.topological = cmdl[{"--topological"}];
+  cmdl({"knn"}, 7) >> params.k;
+
+  // Verlet neighbour lists
+  params.verlet = cmdl[{"--verlet"}];
+  cmdl({"skin"}, BoidsData::SPEED_LIMIT) >> params.skin;
+
+  // update modes are exclusive
+  const int nModes = params.verlet + params.incremental + params.adaptiveSort + params.barnesHut +
+                     params.refine + params.tiled + params.topological;
+  if (nModes > 1)
+  {
+    std::cerr << "Options --verlet, --incremental, --adaptive-sort, --barnes-hut, --refine, "
+              << "--tiled and --topological are exclusive\n";
+    return EXIT_FAILURE;
+  }
 
-  bool dump_data = cmdl[{"d","--dump"}];
+  params.dump_data = cmdl[{"d","--dump"}];
 
   bool guiEnabled = cmdl[{"g","--gui"}];
 
@@ -100,7 +222,7 @@ int main(int argc, char* argv[])
     if (guiEnabled)
     {
 #ifdef FORGE_ENABLED
-      run_boids_flight_gui(nBoids, nIter, seed, dump_data);
+      run_boids_flight_gui(params);
 #else
       std::cerr << "Rerun cmake and enable Forge library.\n";
 #endif
@@ -116,12 +238,21 @@ int main(int argc, char* argv[])
       {
         LIKWID_MARKER_THREADINIT;
         LIKWID_MARKER_REGISTER("updatePositions");
+        LIKWID_MARKER_REGISTER("neighbourTraversal_row");
+        LIKWID_MARKER_REGISTER("neighbourTraversal_morton");
       }
 
       // std::cout << "GUI enabled, we limit the number of boids to 1000\n";
       // nBoids = (nBoids > 1000) ? 1000 : nBoids;
 
-      run_boids_flight(nBoids, nIter, seed, dump_data);
+      if (params.cell_order_benchmark)
+        run_cell_order_benchmark(params);
+      else if (params.barnes_hut_benchmark)
+        run_barnes_hut_benchmark(params);
+      else if (params.grid_benchmark)
+        run_grid_benchmark(params);
+      else
+        run_boids_flight(params);
 
       LIKWID_MARKER_CLOSE;
 
@@ -1,8 +1,10 @@
 #include "Boids.h"
-#include "Array.h"
+#include "run.h"
 
+#include <algorithm>
 #include <iostream>
 #include <cstdint>
+#include <optional>
 #include <unistd.h>
 
 #include "utils/likwid-utils.h"
@@ -21,17 +23,263 @@
 
 // =====================================================================================
 // =====================================================================================
-void run_boids_flight(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool dump_data)
+// =====================================================================================
+// =====================================================================================
+//! flight domain and boxes from run parameters (and report them)
+Grid make_grid(const RunParams& params)
+{
+
+  Grid grid = Grid::automatic(params.nBoids, params.minDistance, params.domainSize,
+                              params.nbox_x, params.nbox_y);
+
+  grid.setCellOrder(params.cellOrder);
+  grid.periodic = params.periodic;
+
+  std::cout << (grid.periodic ? "Periodic domain : [" : "Domain : [")
+            << grid.xmin << "," << grid.xmax << "]x["
+            << grid.ymin << "," << grid.ymax << "], "
+            << grid.nx << "x" << grid.ny << " boxes ("
+            << double(params.nBoids)/grid.nBoxes() << " boids per box, "
+            << kboids::cell_order_name(grid.order) << " order)\n";
+
+  // neighbours are taken at their closest image only
+  if (grid.periodic and fmin(grid.xmax-grid.xmin, grid.ymax-grid.ymin) < 2*params.minDistance)
+    std::cout << "Warning : periodic domain smaller than twice the neighbour distance\n";
+
+  // 16-bit fixed point storage has a bounded range
+  if (kboids::storage_limit<BoidsData::real_t>() < fmax(fabs(grid.xmax), fabs(grid.ymax)))
+    std::cout << "Warning : domain exceeds the range of position storage ("
+              << BoidsData::Precision::name << ")\n";
+
+  return grid;
+
+} // make_grid
+
+// =====================================================================================
+// =====================================================================================
+/**
+ * Data of the update mode selected by run parameters (--verlet, --incremental,
+ * --adaptive-sort, --barnes-hut, --refine, --tiled or --topological, at most
+ * one of them) : only the structure of this mode is allocated.
+ */
+struct FlightMode
+{
+  FlightMode(const RunParams& params, const BoidsData& boidsData)
+  {
+    const int nBoids = boidsData.nBoids;
+    const int nBoxes = boidsData.grid.nBoxes();
+
+    if (params.verlet)
+      verlet.emplace(nBoids, params.skin);
+    else if (params.incremental)
+      binning.emplace(nBoids, nBoxes, params.rebinThreshold);
+    else if (params.adaptiveSort)
+      adaptiveSort.emplace(nBoids, params.sortThreshold);
+    else if (params.barnesHut)
+      tree.emplace(nBoids, params.theta);
+    else if (params.refine)
+      refined.emplace(nBoids, nBoxes, params.refineThreshold);
+    else if (params.tiled)
+      tiles.emplace(nBoids, params.tileCapacity);
+    else if (params.topological)
+      knn.emplace(nBoids, params.k);
+  }
+
+  std::optional<VerletList>         verlet;
+  std::optional<IncrementalBinning> binning;
+  std::optional<AdaptiveSort>       adaptiveSort;
+  std::optional<QuadTree>           tree;
+  std::optional<RefinedGrid>        refined;
+  std::optional<SeparationTiles>    tiles;
+  std::optional<NearestNeighbours>  knn;
+
+}; // struct FlightMode
+
+// =====================================================================================
+// =====================================================================================
+//! initial flock : uniform, or in clusters (--clusters)
+void init_flock(BoidsData& boidsData, MyRandom& myRand, const RunParams& params)
+{
+
+  if (params.nClusters > 0)
+    initClusteredPositions(boidsData, myRand, params.nClusters, params.clusterRadius);
+  else
+    initPositions(boidsData, myRand);
+
+} // init_flock
+
+// =====================================================================================
+// =====================================================================================
+//! flock statistics at the end of a run (centroid, bounding box, velocities)
+void report_flock_stats(BoidsData& boidsData)
+{
+
+  using stats_t = BoidsData::FlockStats_t;
+
+  updateFlockStats(boidsData);
+
+  auto stats_host = Kokkos::create_mirror_view(boidsData.stats);
+  Kokkos::deep_copy(stats_host, boidsData.stats);
+  const stats_t& s = stats_host();
+
+  const int n = boidsData.nBoids;
+
+  std::cout << "Flock : centroid (" << s.mean(stats_t::X, n) << "," << s.mean(stats_t::Y, n)
+            << "), bounding box [" << s.xmin << "," << s.xmax << "]x[" << s.ymin << "," << s.ymax
+            << "], mean velocity (" << s.mean(stats_t::DX, n) << "," << s.mean(stats_t::DY, n)
+            << "), speed in [" << s.speed_min << "," << s.speed_max << "]\n";
+
+} // report_flock_stats
+
+// =====================================================================================
+// =====================================================================================
+//! Verlet lists statistics : rebuild frequency and time saved by reusing lists
+void report_verlet_stats(const VerletList& verlet, int nBoids)
+{
+
+  const int nReuses = verlet.nSteps - verlet.nBuilds;
+
+  std::cout << "Verlet lists : skin " << verlet.skin << ", "
+            << verlet.nBuilds << " builds in " << verlet.nSteps << " steps ("
+            << double(verlet.nSteps)/verlet.nBuilds << " steps per build), "
+            << double(verlet.neighbours.extent(0))/nBoids << " neighbours per boid allocated ("
+            << double(verlet.neighbours.extent(0))*sizeof(int)/1e6 << " MB)\n";
+
+  // lists built for (about) a single step only cost memory and build time
+  if (verlet.nSteps < 2*verlet.nBuilds)
+    std::cout << "Verlet lists : warning, rebuilt almost every step, boids move by more than "
+              << "skin/2 = " << verlet.skin/2 << " in a step or two, increase --skin\n";
+
+  if (nReuses > 0)
+  {
+    const double buildStep = verlet.buildStepsTime / verlet.nBuilds;
+    const double reuseStep = verlet.reuseStepsTime / nReuses;
+
+    std::cout << "Verlet lists : mean step time " << buildStep*1e3 << " ms with build, "
+              << reuseStep*1e3 << " ms without ("
+              << 100*(1 - reuseStep/buildStep) << "% saved per reused step, "
+              << 100*(1 - (verlet.buildStepsTime+verlet.reuseStepsTime)/(buildStep*verlet.nSteps))
+              << "% overall)\n";
+  }
+
+} // report_verlet_stats
+
+// =====================================================================================
+// =====================================================================================
+//! incremental binning statistics : movers per step and full rebuilds
+void report_binning_stats(const IncrementalBinning& binning, int nBoids)
+{
+
+  // the first step always is a full rebuild, without movers detection
+  const int nSteps = binning.nSteps - 1;
+
+  if (nSteps <= 0)
+    return;
+
+  const double moversPerStep = binning.nMovers / nSteps;
+
+  std::cout << "Incremental binning : " << moversPerStep << " movers per step ("
+            << 100*moversPerStep/nBoids << "% of boids), "
+            << binning.nFullRebuilds-1 << " full rebuilds in " << nSteps << " steps (threshold "
+            << 100*binning.maxMoverFraction << "%)\n";
+
+} // report_binning_stats
+
+// =====================================================================================
+// =====================================================================================
+//! adaptive sort statistics : sort frequency and sortedness when sorting
+void report_sort_stats(const AdaptiveSort& adaptiveSort)
 {
 
+  std::cout << "Adaptive sort : threshold " << 100*adaptiveSort.threshold << "% of boids out of their box, "
+            << adaptiveSort.nSorts << " sorts in " << adaptiveSort.nSteps << " steps ("
+            << double(adaptiveSort.nSteps)/adaptiveSort.nSorts << " steps per sort, "
+            << adaptiveSort.nDriftSorts << " triggered by drift only)";
+
+  // the first step always sorts, without measuring sortedness
+  if (adaptiveSort.nSorts > 1)
+    std::cout << ", " << 100*adaptiveSort.outOfBoxAtSort/(adaptiveSort.nSorts-1)
+              << "% of boids out of their box when sorting";
+
+  std::cout << "\n";
+
+  if (adaptiveSort.nFirstSteps > 0)
+    std::cout << "Adaptive sort : " << 100*adaptiveSort.outOfBoxFirstStep/adaptiveSort.nFirstSteps
+              << "% of boids out of their box one step after a sort\n";
+
+  // sorting (almost) every step : the threshold is below the per step
+  // fraction, or boids move by half a box in a step or two
+  if (adaptiveSort.nSteps < 2*adaptiveSort.nSorts)
+  {
+    std::cout << "Adaptive sort : warning, sorted almost every step, ";
+    if (2*adaptiveSort.nDriftSorts > adaptiveSort.nSorts)
+      std::cout << "boids move by half a box in a step or two (sorting every step is cheaper)\n";
+    else
+      std::cout << "increase --sort-threshold\n";
+  }
+
+} // report_sort_stats
+
+// =====================================================================================
+// =====================================================================================
+//! tiled separation statistics : fraction of boxes that overflowed scratch memory
+void report_tile_stats(const SeparationTiles& tiles)
+{
+
+  if (tiles.nBoxes <= 0)
+    return;
+
+  std::cout << "Tiled separation : " << tiles.capacity << " boids staged per box ("
+            << tiles.capacity*SeparationTiles::BYTES_PER_BOID/1024.0 << " KB of scratch), "
+            << 100*tiles.nOverflows/tiles.nBoxes << "% of non empty boxes overflowed ("
+            << tiles.nOverflows/tiles.nSteps << " per step)\n";
+
+} // report_tile_stats
+
+// =====================================================================================
+// =====================================================================================
+//! topological neighbours statistics : search cost
+void report_knn_stats(const NearestNeighbours& knn)
+{
+
+  if (knn.nSteps <= 0)
+    return;
+
+  std::cout << "Topological neighbours : k " << knn.k << ", "
+            << knn.nRings/knn.nSteps << " box rings visited per boid, search "
+            << knn.searchTime/knn.nSteps*1e3 << " ms per step ("
+            << 100*knn.searchTime/knn.stepTime << "% of step time)\n";
+
+} // report_knn_stats
+
+// =====================================================================================
+// =====================================================================================
+void run_boids_flight(const RunParams& params)
+{
+
+  const auto nBoids = params.nBoids;
+  const auto nIter  = params.nIter;
+
+  std::cout << "Precision policy : " << BoidsData::Precision::name << "\n";
+
   // create a BoidsData object
-  BoidsData boidsData(nBoids);
+  BoidsData boidsData(nBoids, make_grid(params), params.minDistance, params.accumulation);
 
   // init friends and ennemies
-  MyRandomPool myRandPool(seed);
+  MyRandom myRand(params.seed);
+
+  init_flock(boidsData, myRand, params);
+  shuffleEnnemies(boidsData, myRand, 1.0);
+
+  std::cout << "Box accumulation : " << kboids::box_accumulation_name(boidsData.accumulation)
+            << (params.accumulation == kboids::BoxAccumulation::AUTO ? " (auto)" : "") << "\n";
 
-  initPositions(boidsData, myRandPool.pool);
-  shuffleEnnemies(boidsData, myRandPool.pool, 1.0);
+  // data of the selected update mode only
+  FlightMode mode(params, boidsData);
+
+  if (mode.tree)
+    std::cout << "Barnes-Hut cohesion : theta " << mode.tree->theta << ", quadtree depth "
+              << mode.tree->depth << " (" << mode.tree->nLeaves << " leaves)\n";
 
   Timer timer;
 
@@ -47,7 +295,54 @@ void run_boids_flight(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool dump_
       LIKWID_MARKER_START("updatePositions");
     }
 
-    updatePositions(boidsData);
+    if (mode.verlet)
+    {
+      Timer stepTimer;
+      stepTimer.start();
+      const bool rebuilt = updatePositions(boidsData, *mode.verlet);
+      stepTimer.stop();
+
+      (rebuilt ? mode.verlet->buildStepsTime : mode.verlet->reuseStepsTime) += stepTimer.elapsed();
+    }
+    else if (mode.binning)
+    {
+      updatePositions(boidsData, *mode.binning);
+    }
+    else if (mode.adaptiveSort)
+    {
+      updatePositions(boidsData, *mode.adaptiveSort);
+    }
+    else if (mode.tree)
+    {
+      updatePositions(boidsData, *mode.tree);
+    }
+    else if (mode.refined)
+    {
+      updatePositions(boidsData, *mode.refined);
+    }
+    else if (mode.tiles)
+    {
+      updatePositions(boidsData, *mode.tiles);
+    }
+    else if (mode.knn)
+    {
+      Timer stepTimer, searchTimer;
+      stepTimer.start();
+
+      searchTimer.start();
+      findNearestNeighbours(boidsData, *mode.knn);
+      searchTimer.stop();
+
+      updatePositionsFromNeighbours(boidsData, *mode.knn);
+      stepTimer.stop();
+
+      mode.knn->searchTime += searchTimer.elapsed();
+      mode.knn->stepTime   += stepTimer.elapsed();
+    }
+    else
+    {
+      updatePositions(boidsData);
+    }
 
 #ifdef _OPENMP
 #pragma omp parallel
@@ -57,7 +352,7 @@ void run_boids_flight(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool dump_
     }
 
     if (iTime % 200 == 0)
-      shuffleEnnemies(boidsData, myRandPool.pool, 0.1);
+      shuffleEnnemies(boidsData, myRand, 0.1);
 
     timer.stop();
 
@@ -68,22 +363,296 @@ void run_boids_flight(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool dump_
   std::cout << "Total time : " << time_seconds << " seconds\n";
   std::cout << "Throughput : " << (nBoids*nIter)/time_seconds/1e6 << " MBoids-updates/s \n";
 
+  // boids moved since they were last sorted (and not at all with verlet
+  // lists or adaptive sort), sort them by box (cell) again before the walk
+  if (mode.refined)
+  {
+    computeBoxData(boidsData, *mode.refined);
+    reportNeighbourStats(boidsData, *mode.refined);
+  }
+  else
+  {
+    computeBoxData(boidsData);
+    reportNeighbourStats(boidsData);
+  }
+
+  report_flock_stats(boidsData);
+
+  if (mode.verlet)
+    report_verlet_stats(*mode.verlet, nBoids);
+  else if (mode.binning)
+    report_binning_stats(*mode.binning, nBoids);
+  else if (mode.adaptiveSort)
+    report_sort_stats(*mode.adaptiveSort);
+  else if (mode.tiles)
+    report_tile_stats(*mode.tiles);
+  else if (mode.knn)
+    report_knn_stats(*mode.knn);
+
 } // run_boids_flight
 
+// =====================================================================================
+// =====================================================================================
+/**
+ * Time the walk over neighbour boxes (see neighbourTraversal) of a uniform flock
+ * with row major and Morton boxes numbering.
+ *
+ * With a large grid, boxes of the rows above and below a box are far away in
+ * memory with row major numbering; run with likwid-perfctr (regions
+ * neighbourTraversal_row and neighbourTraversal_morton) to measure cache misses
+ * (see readme_likwid.md).
+ */
+void run_cell_order_benchmark(const RunParams& params)
+{
+
+  const auto nBoids = params.nBoids;
+  const int  nIter  = params.nIter;
+
+  const kboids::CellOrder orders[] = {kboids::CellOrder::ROW_MAJOR, kboids::CellOrder::MORTON};
+
+  double time_row_major = 0;
+
+  for (auto order : orders)
+  {
+    RunParams orderParams = params;
+    orderParams.cellOrder = order;
+
+    BoidsData boidsData(nBoids, make_grid(orderParams), params.minDistance, params.accumulation);
+
+    // same (uniform) flock for both orders, sorted by box
+    MyRandom myRand(params.seed);
+    initPositions(boidsData, myRand);
+    computeBoxData(boidsData);
+
+    BoidsData::compute_t checksum = 0;
+
+    // one LIKWID region per order
+    [[maybe_unused]] const char* region = (order == kboids::CellOrder::MORTON) ?
+      "neighbourTraversal_morton" : "neighbourTraversal_row";
+
+    Timer timer;
+    timer.start();
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      LIKWID_MARKER_START(region);
+    }
+
+    for (int iTime=0; iTime<nIter; ++iTime)
+      checksum += neighbourTraversal(boidsData);
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+      LIKWID_MARKER_STOP(region);
+    }
+
+    timer.stop();
+
+    const double time_seconds = timer.elapsed();
+    if (order == kboids::CellOrder::ROW_MAJOR)
+      time_row_major = time_seconds;
+
+    std::cout << "  " << kboids::cell_order_name(order) << " order : "
+              << time_seconds/nIter*1e3 << " ms per traversal, "
+              << (double(nBoids)*nIter)/time_seconds/1e6 << " MBoids/s, "
+              << "gathers farther than 1K / 64K boids "
+              << 100*farGatherFraction(boidsData, 1<<10) << "% / "
+              << 100*farGatherFraction(boidsData, 1<<16) << "%, "
+              << "speedup " << time_row_major/time_seconds
+              << " (checksum " << checksum/nIter << ")\n";
+  }
+
+} // run_cell_order_benchmark
+
+// =====================================================================================
+// =====================================================================================
+/**
+ * Barnes-Hut cohesion of the initial flock (uniform, or clustered with
+ * --clusters) : time of quadtree build and traversal
+ * versus the number of boids (opening angle --theta), then accuracy versus the
+ * opening angle (relative RMS error against the exact sum on sample boids).
+ */
+void run_barnes_hut_benchmark(const RunParams& params)
+{
+
+  const int nIter = params.nIter;
+
+  // number of sample boids for accuracy (exact sum is O(N) per boid)
+  const int nSamples = 256;
+
+  std::cout << "Barnes-Hut : time versus number of boids (theta " << params.theta << ")\n";
+
+  // at least 2 boids : timings are normalized by N log2(N)
+  const int nBoidsMin = std::max(2, int(params.nBoids/8));
+
+  for (int nBoids = nBoidsMin; nBoids <= (int) params.nBoids; nBoids *= 2)
+  {
+    RunParams nParams = params;
+    nParams.nBoids = nBoids;
+
+    BoidsData boidsData(nBoids, make_grid(nParams), params.minDistance, params.accumulation);
+
+    MyRandom myRand(params.seed);
+    init_flock(boidsData, myRand, nParams);
+    computeBoxData(boidsData);
+    updateFlockStats(boidsData);
+
+    QuadTree tree(nBoids, params.theta);
+
+    Timer buildTimer, traversalTimer;
+    double nInteractions = 0;
+
+    for (int iTime=0; iTime<nIter; ++iTime)
+    {
+      buildTimer.start();
+      buildQuadTree(boidsData, tree);
+      Kokkos::fence();
+      buildTimer.stop();
+
+      traversalTimer.start();
+      nInteractions = barnesHutTraversal(boidsData, tree);
+      traversalTimer.stop();
+    }
+
+    const double build     = buildTimer.elapsed()/nIter;
+    const double traversal = traversalTimer.elapsed()/nIter;
+
+    std::cout << "  " << nBoids << " boids (depth " << tree.depth << ") : build "
+              << build*1e3 << " ms, traversal " << traversal*1e3 << " ms, "
+              << nInteractions << " interactions per boid, "
+              << (build+traversal)/(nBoids*log2(double(nBoids)))*1e9 << " ns per N log2(N)\n";
+  }
+
+  std::cout << "Barnes-Hut : accuracy versus theta (" << params.nBoids << " boids, "
+            << nSamples << " samples)\n";
+
+  BoidsData boidsData(params.nBoids, make_grid(params), params.minDistance, params.accumulation);
+
+  MyRandom myRand(params.seed);
+  init_flock(boidsData, myRand, params);
+  computeBoxData(boidsData);
+  updateFlockStats(boidsData);
+
+  QuadTree tree(params.nBoids);
+
+  const float thetas[] = {0.25, 0.5, 0.75, 1.0};
+
+  for (auto theta : thetas)
+  {
+    tree.theta = theta;
+    buildQuadTree(boidsData, tree);
+
+    Timer timer;
+    timer.start();
+    const double nInteractions = barnesHutTraversal(boidsData, tree);
+    timer.stop();
+
+    double cohesionError, alignmentError;
+    barnesHutError(boidsData, tree, nSamples, cohesionError, alignmentError);
+
+    std::cout << "  theta " << theta << " : traversal " << timer.elapsed()*1e3 << " ms, "
+              << nInteractions << " interactions per boid (exact : " << params.nBoids-1
+              << "), error " << 100*cohesionError << "% (cohesion) "
+              << 100*alignmentError << "% (alignment)\n";
+  }
+
+} // run_barnes_hut_benchmark
+
+// =====================================================================================
+// =====================================================================================
+/**
+ * Binning (computeBoxData) and neighbour traversal (see neighbourTraversal) of a
+ * clustered flock (--clusters, 16 if not set), with the flat grid and with crowded
+ * boxes refined (see RefinedGrid).
+ */
+void run_grid_benchmark(const RunParams& params)
+{
+
+  const auto nBoids = params.nBoids;
+  const int  nIter  = params.nIter;
+
+  RunParams clusteredParams = params;
+  if (clusteredParams.nClusters <= 0)
+    clusteredParams.nClusters = 16;
+
+  std::cout << "Clustered flock : " << clusteredParams.nClusters << " clusters, radius "
+            << clusteredParams.clusterRadius << "\n";
+
+  BoidsData boidsData(nBoids, make_grid(params), params.minDistance, params.accumulation);
+
+  RefinedGrid refined(nBoids, boidsData.grid.nBoxes(), params.refineThreshold);
+
+  double time_flat = 0;
+
+  for (const bool refine : {false, true})
+  {
+    // same flock for both grids
+    MyRandom myRand(params.seed);
+    init_flock(boidsData, myRand, clusteredParams);
+
+    BoidsData::compute_t checksum = 0;
+
+    Timer binTimer, traversalTimer;
+
+    for (int iTime=0; iTime<nIter; ++iTime)
+    {
+      binTimer.start();
+      if (refine)
+        computeBoxData(boidsData, refined);
+      else
+        computeBoxData(boidsData);
+      Kokkos::fence();
+      binTimer.stop();
+
+      traversalTimer.start();
+      checksum += refine ?
+        neighbourTraversal(boidsData, refined) :
+        neighbourTraversal(boidsData);
+      traversalTimer.stop();
+    }
+
+    const double time_seconds = (binTimer.elapsed() + traversalTimer.elapsed())/nIter;
+    if (not refine)
+      time_flat = time_seconds;
+
+    std::cout << "  " << (refine ? "refined" : "flat") << " grid : binning "
+              << binTimer.elapsed()/nIter*1e3 << " ms, traversal "
+              << traversalTimer.elapsed()/nIter*1e3 << " ms, speedup "
+              << time_flat/time_seconds << " (checksum " << checksum/nIter << ")\n  ";
+
+    if (refine)
+      reportNeighbourStats(boidsData, refined);
+    else
+      reportNeighbourStats(boidsData);
+  }
+
+} // run_grid_benchmark
+
 #ifdef FORGE_ENABLED
 // =====================================================================================
 // =====================================================================================
-void run_boids_flight_gui(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool dump_data)
+void run_boids_flight_gui(const RunParams& params)
 {
 
+  const auto nBoids = params.nBoids;
+
   // create a BoidsData object
-  BoidsData boidsData(nBoids);
+  BoidsData boidsData(nBoids, make_grid(params), params.minDistance, params.accumulation);
 
   // init friends and ennemies
-  MyRandomPool myRandPool(seed);
+  MyRandom myRand(params.seed);
+
+  init_flock(boidsData, myRand, params);
+  shuffleEnnemies(boidsData, myRand, 1.0);
+
+  // data of the selected update mode only
+  FlightMode mode(params, boidsData);
 
-  initPositions(boidsData, myRandPool.pool);
-  shuffleEnnemies(boidsData, myRandPool.pool, 1.0);
+  const Grid& grid = boidsData.grid;
 
   // Forge init
   const int DIMX=800;
@@ -92,12 +661,12 @@ void run_boids_flight_gui(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool d
   wnd.makeCurrent();
 
   forge::Chart chart(FG_CHART_2D);
-  auto deltaX = BoidsData::XMAX-BoidsData::XMIN;
-  auto deltaY = BoidsData::YMAX-BoidsData::YMIN;
-  chart.setAxesLimits(BoidsData::XMIN-0.5*deltaX,
-                      BoidsData::XMAX+0.5*deltaX,
-                      BoidsData::YMIN-0.5*deltaY,
-                      BoidsData::YMAX+0.5*deltaY);
+  auto deltaX = grid.xmax-grid.xmin;
+  auto deltaY = grid.ymax-grid.ymin;
+  chart.setAxesLimits(grid.xmin-0.5*deltaX,
+                      grid.xmax+0.5*deltaX,
+                      grid.ymin-0.5*deltaY,
+                      grid.ymax+0.5*deltaY);
 
   forge::Plot boidsXY =
     chart.plot(nBoids, forge::f32, FG_PLOT_SCATTER, FG_MARKER_CIRCLE);
@@ -112,13 +681,28 @@ void run_boids_flight_gui(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool d
   do
   {
 
-    updatePositions(boidsData);
+    if (mode.verlet)
+      updatePositions(boidsData, *mode.verlet);
+    else if (mode.binning)
+      updatePositions(boidsData, *mode.binning);
+    else if (mode.adaptiveSort)
+      updatePositions(boidsData, *mode.adaptiveSort);
+    else if (mode.tree)
+      updatePositions(boidsData, *mode.tree);
+    else if (mode.refined)
+      updatePositions(boidsData, *mode.refined);
+    else if (mode.tiles)
+      updatePositions(boidsData, *mode.tiles);
+    else if (mode.knn)
+      updatePositions(boidsData, *mode.knn);
+    else
+      updatePositions(boidsData);
     if (iTime % 200 == 0)
-      shuffleEnnemies(boidsData, myRandPool.pool, 0.1);
+      shuffleEnnemies(boidsData, myRand, 0.1);
 
     copyPositionsForRendering(boidsData);
 
-    copyToGLBuffer(handles, (ComputeResourceHandle)boidsData.xy.data(),
+    copyToGLBuffer(handles, (ComputeResourceHandle)boidsData.renderData(),
                    boidsXY.verticesSize());
     wnd.draw(chart);
 
@@ -1,7 +1,110 @@
 #pragma once
 
-void run_boids_flight(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool dump_data);
+#include <cstdint>
+
+#include "utils/kernel-type.h"
+
+// ===================================================
+// ===================================================
+//! run parameters (as read from the command line)
+struct RunParams
+{
+  //! number of boids
+  uint32_t nBoids = 1000;
+
+  //! number of time steps
+  uint32_t nIter = 100;
+
+  //! random seed
+  uint64_t seed = 42;
+
+  //! dump data to PNG files
+  bool dump_data = false;
+
+  //! flight domain size (square [0,size]^2), if <= 0 scaled with the number of boids
+  float domainSize = 0;
+
+  //! number of boxes along x and y, if <= 0 chosen from nBoids and minDistance
+  int nbox_x = 0;
+  int nbox_y = 0;
+
+  //! neighbour distance
+  float minDistance = 20;
+
+  //! periodic (toroidal) domain
+  bool periodic = false;
+
+  //! boxes numbering
+  kboids::CellOrder cellOrder = kboids::CellOrder::MORTON;
+
+  //! compare boxes numberings on neighbour boxes traversal (instead of flying)
+  bool cell_order_benchmark = false;
+
+  //! clustered initial flock : number of clusters (0 : uniform flock), and their radius
+  int nClusters = 0;
+  float clusterRadius = 40;
+
+  //! refine crowded boxes (two level grid)
+  bool refine = false;
+
+  //! box population above which a box is refined
+  int refineThreshold = 64;
+
+  //! compare flat and refined grids on a clustered flock (instead of flying)
+  bool grid_benchmark = false;
+
+  //! separation computed box by box in team scratch memory
+  bool tiled = false;
+
+  //! number of boids staged per team (0 : as many as fit in scratch memory)
+  int tileCapacity = 0;
+
+  //! box data accumulation strategy
+  kboids::BoxAccumulation accumulation = kboids::BoxAccumulation::AUTO;
+
+  //! update box data incrementally (only boids that changed box are moved)
+  bool incremental = false;
+
+  //! fraction of boids changing box above which box data are fully recomputed
+  float rebinThreshold = 0.25;
+
+  //! only sort boids by box when too many of them left their box
+  bool adaptiveSort = false;
+
+  //! fraction of boids out of their box above which boids are sorted
+  float sortThreshold = 0.5;
+
+  //! cohesion and alignment from a Barnes-Hut quadtree (distance-weighted)
+  bool barnesHut = false;
+
+  //! Barnes-Hut opening angle
+  float theta = 0.5;
+
+  //! time and check accuracy of Barnes-Hut cohesion (instead of flying)
+  bool barnes_hut_benchmark = false;
+
+  //! topological neighbours : boids interact with their k nearest neighbours
+  bool topological = false;
+
+  //! number of topological neighbours
+  int k = 7;
+
+  //! use Verlet neighbour lists
+  bool verlet = false;
+
+  //! Verlet lists skin (margin added to the neighbour distance), the speed limit by default
+  float skin = 20;
+
+}; // struct RunParams
+
+void run_boids_flight(const RunParams& params);
+
+void run_cell_order_benchmark(const RunParams& params);
+
+void run_barnes_hut_benchmark(const RunParams& params);
+
+void run_grid_benchmark(const RunParams& params);
 
 #ifdef FORGE_ENABLED
-void run_boids_flight_gui(uint32_t nBoids, uint32_t nIter, uint64_t seed, bool dump_data);
+void run_boids_flight_gui(const RunParams& params);
 #endif